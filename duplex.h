@@ -0,0 +1,186 @@
+#ifndef __DUPLEX_H__
+#define __DUPLEX_H__
+
+/**********************************************************************/
+/*** Full-duplex test of two cross-connected TTYs, or a pty pair:   ***/
+/*** both directions at once, and the cost of the reverse stream    ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pDUPLEX        - Struct with the two ends and options
+ * duplex_open_pty(...)        - Open pty pair as the two ends
+ * duplex_run(...)             - Run one or both directions
+ * duplex_rate(...)            - Throughput of one direction
+ * duplex_cost(...)            - Report one direction, alone vs. duplex
+ * run_duplex(...)             - Run duplex test, optionally baseline
+ *
+ * Usage
+ * =====
+ * Ends A and B are wired TX to RX each way (null modem), or are the
+ * master and slave of a pty pair.  The test is two multiport.h ports:
+ * A -> B writes A and reads and verifies B, and B -> A the reverse;
+ * each has its own writer and verifier, and both run at full rate at
+ * the same time, with a thread per direction or one event loop
+ * (cf. --multi=...).
+ *
+ * With baseline, each direction is first run alone, then both
+ * together, and for each direction the throughput alone and in
+ * duplex, and the change, are reported:  the cost of the reverse
+ * stream (e.g. interrupt load, DMA or FIFO sharing, CPU).
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "multiport.h"
+/* pty_open_pair(...) */
+#include "ptyloop.h"
+
+#define DUPLEX_AB 1
+#define DUPLEX_BA 2
+#define DUPLEX_BOTH (DUPLEX_AB | DUPLEX_BA)
+
+
+/**********************************************************************/
+/* The two ends and options */
+typedef struct DUPLEXstr
+{
+    char* name_a;            /* TTY of end A */
+    char* name_b;            /* TTY of end B */
+    int fd_a;                /* Open fd of end A (pty master), or -1 */
+    int fd_b;                /* Open fd of end B (pty slave), or -1 */
+    char pty_name[64];       /* Slave name, for a pty pair */
+    char* speed;             /* Speed token, or NULL to leave as is */
+    size_t count;            /* How many characters to send each way */
+    int threads;             /* Non-zero for thread per direction */
+    size_t chunk;            /* Maximum chars per write(), or 0 */
+    int do_raw_config;       /* Non-zero to configure raw data */
+    int keep_tty_settings;   /* Non-zero to not restore TTYs at exit */
+    int baseline;            /* Non-zero to run each direction alone */
+    int debug;
+} DUPLEX, *pDUPLEX;
+
+
+/**********************************************************************/
+/* Open pty pair as the two ends:  A is the master, B the slave, both
+ * non-blocking, and the slave configured for raw data
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+duplex_open_pty(pDUPLEX pdx)
+{
+    if (pty_open_pair(&pdx->fd_a, pdx->pty_name, sizeof pdx->pty_name
+                     , O_NONBLOCK))
+    {
+        return -1;
+    }
+    if (0 > (pdx->fd_b = open(pdx->pty_name, O_RDWR | O_NOCTTY | O_NONBLOCK)))
+    {
+        perror(pdx->pty_name);
+        return -1;
+    }
+    pdx->name_a = "ptmx";
+    pdx->name_b = pdx->pty_name;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Run one or both directions (DUPLEX_AB, DUPLEX_BA), and return the
+ * ports in *pset, so callers can compare their counts and times
+ * Return value:  0 if every direction passed; -1 otherwise
+ */
+static int
+duplex_run(pDUPLEX pdx, int which, pMPORTSET pset)
+{
+    memset(pset, 0, sizeof *pset);
+    pset->threads = pdx->threads;
+    pset->chunk = pdx->chunk;
+    pset->do_raw_config = pdx->do_raw_config;
+    pset->keep_tty_settings = pdx->keep_tty_settings;
+    pset->debug = pdx->debug;
+
+    if ((which & DUPLEX_AB)
+     && mport_add_link(pset, pdx->name_a, pdx->name_b, pdx->fd_a, pdx->fd_b
+                      , pdx->speed, pdx->count))
+    {
+        return -1;
+    }
+    if ((which & DUPLEX_BA)
+     && mport_add_link(pset, pdx->name_b, pdx->name_a, pdx->fd_b, pdx->fd_a
+                      , pdx->speed, pdx->count))
+    {
+        return -1;
+    }
+
+    fprintf(stderr, "Duplex:  %s\n"
+                  , DUPLEX_BOTH==which ? "both directions at once"
+                  : (DUPLEX_AB==which ? "A -> B alone" : "B -> A alone"));
+    return run_multiport(pset);
+}
+
+
+/**********************************************************************/
+/* Throughput of port, chars/s */
+static double
+duplex_rate(pMPORT pp)
+{
+    uint64_t dt = pp->t_end - pp->t_start;
+    return dt ? pp->received / (dt * 1e-9) : 0.0;
+}
+
+
+/**********************************************************************/
+/* Report one direction's throughput and loss, alone vs. duplex */
+static void
+duplex_cost(FILE* f, pMPORT palone, pMPORT pboth)
+{
+    double alone = duplex_rate(palone);
+    double both = duplex_rate(pboth);
+    fprintf(f, "Reverse-stream cost [%s -> %s]:  alone %.1f chars/s"
+               ", %lu lost; duplex %.1f chars/s, %lu lost; %+.2f%%\n"
+             , pboth->tty_name, pboth->rx_name
+             , alone, (unsigned long) (palone->verify.counts.dropped
+                                      + palone->verify.counts.inserted
+                                      + palone->verify.counts.corrupted)
+             , both, (unsigned long) (pboth->verify.counts.dropped
+                                     + pboth->verify.counts.inserted
+                                     + pboth->verify.counts.corrupted)
+             , alone > 0.0 ? 100.0 * (both - alone) / alone : 0.0);
+}
+
+
+/**********************************************************************/
+/* Run duplex test; with baseline, first run each direction alone, and
+ * report the cost of the reverse stream to each direction
+ * Return value:  0 if every run passed; -1 otherwise
+ */
+static int
+run_duplex(pDUPLEX pdx)
+{
+    static MPORTSET ab;
+    static MPORTSET ba;
+    static MPORTSET both;
+    int rtn = 0;
+
+    if (pdx->baseline)
+    {
+        rtn |= duplex_run(pdx, DUPLEX_AB, &ab);
+        rtn |= duplex_run(pdx, DUPLEX_BA, &ba);
+    }
+    rtn |= duplex_run(pdx, DUPLEX_BOTH, &both);
+
+    if (pdx->baseline && 1==ab.n && 1==ba.n && 2==both.n)
+    {
+        duplex_cost(stderr, ab.ports, both.ports);
+        duplex_cost(stderr, ba.ports, both.ports + 1);
+    }
+    return rtn ? -1 : 0;
+}
+
+#endif/*__DUPLEX_H__*/
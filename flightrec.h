@@ -0,0 +1,449 @@
+#ifndef __FLIGHTREC_H__
+#define __FLIGHTREC_H__
+
+/**********************************************************************/
+/*** Flight recorder:  binary events in a ring, in a file mapped    ***/
+/*** MAP_SHARED, synced periodically, so they survive a crash and   ***/
+/*** reboot; and a decoder of the last events                       ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * FLIGHTREC_RECORDS           - Default ring size, records
+ * FLIGHTREC_SYNC_MS           - Default interval between msync()s
+ * FLIGHTREC_SST_H, etc.       - File ids of event sites
+ * FLIGHTREC_SITE(...)         - Site id:  file id and __LINE__
+ * typedef ... *pFLIGHTHDR     - Struct with file header
+ * typedef ... *pFLIGHTREC     - Struct with one event record
+ * typedef ... *pFLIGHTRECORDER - Struct with recorder state
+ * flightrec                   - The recorder of this process
+ * flightrec_files[]           - Names of files, by file id
+ * flightrec_event(...)        - Record one event, if recording
+ * flightrec_after_fork()      - Note pid of a forked child
+ * flightrec_sync_thread(...)  - msync() loop, in its own thread
+ * flightrec_parse(...)        - Parse PATH[,records=N][,sync-ms=M]
+ * flightrec_start()           - Create and map file, start syncs
+ * flightrec_stop(...)         - Stop syncs, sync, unmap, report
+ * flightrec_dump(...)         - Decode last N events of a file
+ *
+ * Why
+ * ===
+ * The TOHERE(I) sites in sst.h mark the steps of the writer and reader
+ * hot loops, to find the last step before a crash (8M+ baud runs could
+ * reboot a Jetson).  They used to fprintf(...) and fflush(...) each
+ * step to stderr, which slowed the loops enough to change the timing
+ * being reproduced, and were compiled in only with -DDOTOHERE.  Now
+ * each step stores one fixed-size record, with no syscall:
+ *
+ *   seq (8), time (CLOCK_MONOTONIC ns, 8), value (8), site (4), pid (4)
+ *
+ * into a ring in a file mapped MAP_SHARED; the forked reader inherits
+ * the mapping, so both processes record into the same ring, ordered by
+ * seq (one atomic fetch-and-add per event).  A thread of the process
+ * that started the recorder calls msync(MS_SYNC) every sync-ms, so at
+ * most the last sync-ms of events are lost if the kernel dies; on a
+ * crash of sst alone, nothing is lost, since the page cache keeps the
+ * file.  With no --flight-recorder=..., each site costs one predictable
+ * branch.
+ *
+ * Decoding
+ * ========
+ * After a reboot, sst --flight-dump=PATH[,last=N] prints the last N
+ * events (default 50):  seq, wall-clock time (from the pair of clocks
+ * in the header), time before the last event, pid, file:line of the
+ * site, and value.  A record whose seq does not match its slot was
+ * being written (or not yet synced) when the crash came; it is shown
+ * as lost.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* monotonic_ns() */
+#include "timing.h"
+
+#define FLIGHTREC_RECORDS 65536
+#define FLIGHTREC_SYNC_MS 100
+
+#define FLIGHTREC_MAGIC 0x46545353U     /* Bytes "SSTF" */
+#define FLIGHTREC_VERSION 1
+
+/* File ids of event sites */
+#define FLIGHTREC_SST_H 1
+
+/* Site id:  file id, and line of the site in that file */
+#define FLIGHTREC_SITE(FILE_ID) (((uint32_t) (FILE_ID) << 20) | __LINE__)
+
+
+/**********************************************************************/
+/* File header; the ring of records follows, at offset sizeof header */
+typedef struct FLIGHTHDRstr
+{
+    uint32_t magic;          /* FLIGHTREC_MAGIC */
+    uint32_t version;        /* FLIGHTREC_VERSION */
+    uint32_t lrec;           /* sizeof(FLIGHTREC) */
+    uint32_t nrec;           /* Records in ring, a power of 2 */
+    uint64_t head;           /* Next seq, i.e. count of events */
+    uint64_t mono0_ns;       /* CLOCK_MONOTONIC at start ... */
+    uint64_t real0_ns;       /* ... and CLOCK_REALTIME, together */
+    uint64_t syncs;          /* Count of msync()s */
+    uint32_t pid;            /* Process that started the recorder */
+    uint32_t pad[5];
+} FLIGHTHDR, *pFLIGHTHDR;
+
+
+/**********************************************************************/
+/* One event record */
+typedef struct FLIGHTRECstr
+{
+    uint64_t seq;            /* seq + 1 of the event; 0 if never used */
+    uint64_t t_ns;           /* CLOCK_MONOTONIC */
+    int64_t value;           /* Value at site, e.g. a count or errno */
+    uint32_t site;           /* FLIGHTREC_SITE(...) */
+    uint32_t pid;            /* Process that recorded it */
+} FLIGHTREC, *pFLIGHTREC;
+
+
+/**********************************************************************/
+/* Recorder state */
+typedef struct FLIGHTRECORDERstr
+{
+    char* path;              /* File, or NULL if not recording */
+    unsigned nrec;           /* Records in ring */
+    unsigned sync_ms;        /* Interval between msync()s */
+    pFLIGHTHDR hdr;          /* Mapping of whole file, or NULL */
+    size_t len;
+    pFLIGHTREC recs;
+    uint64_t mask;           /* nrec - 1 */
+    uint32_t pid;            /* This process */
+    pthread_t thread;
+    pthread_mutex_t lock;    /* Guards stop, for wake */
+    pthread_cond_t wake;     /* Signalled to stop sync thread */
+    int running;             /* Non-zero while sync thread exists */
+    int stop;                /* Set to stop sync thread */
+    uint64_t sync_ns;        /* Total time in msync() */
+} FLIGHTRECORDER, *pFLIGHTRECORDER;
+
+/* The recorder of this process, set up e.g. by main() */
+static FLIGHTRECORDER flightrec = { .nrec = FLIGHTREC_RECORDS
+                                  , .sync_ms = FLIGHTREC_SYNC_MS };
+
+/* Names of files, by file id */
+static const char* flightrec_files[] = { "?", "sst.h" };
+
+
+/**********************************************************************/
+/* Record one event, if recording:  take next seq, fill its slot, then
+ * store seq + 1 last, so a decoder can tell a complete record
+ */
+static inline void
+flightrec_event(uint32_t site, int64_t value)
+{
+    pFLIGHTREC pr;
+    uint64_t seq;
+
+    if (!flightrec.hdr) { return; }
+    seq = __atomic_fetch_add(&flightrec.hdr->head, 1, __ATOMIC_RELAXED);
+    pr = flightrec.recs + (seq & flightrec.mask);
+    pr->t_ns = monotonic_ns();
+    pr->value = value;
+    pr->site = site;
+    pr->pid = flightrec.pid;
+    __atomic_store_n(&pr->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/**********************************************************************/
+/* Note pid of a forked child, which records into the inherited
+ * mapping; the sync thread stays with the parent
+ */
+static void
+flightrec_after_fork()
+{
+    flightrec.pid = (uint32_t) getpid();
+    flightrec.running = 0;
+}
+
+
+/**********************************************************************/
+/* msync() loop, in its own thread:  every sync_ms, write the mapping
+ * back to the file, waiting until it is written; flightrec_stop()
+ * wakes it at once, via pf->wake
+ */
+static void*
+flightrec_sync_thread(void* arg)
+{
+    pFLIGHTRECORDER pf = (pFLIGHTRECORDER) arg;
+    struct timespec ts;
+    uint64_t t0;
+
+    pthread_mutex_lock(&pf->lock);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    while (!pf->stop)
+    {
+        ts.tv_nsec += (pf->sync_ms % 1000) * 1000000L;
+        ts.tv_sec += pf->sync_ms / 1000 + ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        while (!pf->stop
+            && ETIMEDOUT != pthread_cond_timedwait(&pf->wake, &pf->lock, &ts))
+            ;
+        if (pf->stop) { break; }
+        t0 = monotonic_ns();
+        msync(pf->hdr, pf->len, MS_SYNC);
+        pf->sync_ns += monotonic_ns() - t0;
+        __atomic_fetch_add(&pf->hdr->syncs, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+
+/**********************************************************************/
+/* Parse PATH[,records=N][,sync-ms=M] into flightrec; N is rounded up
+ * to a power of 2
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+flightrec_parse(char* spec)
+{
+    char* comma = strchr(spec, ',');
+    unsigned nrec = FLIGHTREC_RECORDS;
+    unsigned sync_ms = FLIGHTREC_SYNC_MS;
+    unsigned v;
+    int n;
+
+    while (comma)
+    {
+        char* p = comma + 1;
+        if (1==sscanf(p, "records=%u%n", &v, &n) && v >= 2 && v <= (1U<<30))
+        {
+            nrec = v;
+        }
+        else if (1==sscanf(p, "sync-ms=%u%n", &v, &n) && v)
+        {
+            sync_ms = v;
+        }
+        else { return -1; }
+        if (p[n] && ',' != p[n]) { return -1; }
+        *comma = '\0';
+        comma = p[n] ? p + n : NULL;
+    }
+    if (!*spec) { return -1; }
+    for (v=2; v < nrec; v <<= 1) ;
+    flightrec.path = spec;
+    flightrec.nrec = v;
+    flightrec.sync_ms = sync_ms;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Create (or truncate) and map file of flightrec.path, write header,
+ * sync it, and start the sync thread
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+flightrec_start()
+{
+    pFLIGHTRECORDER pf = &flightrec;
+    struct timespec rt;
+    pthread_condattr_t ca;
+    int fd;
+    int rtn;
+    void* p;
+
+    pf->len = sizeof(FLIGHTHDR) + (size_t) pf->nrec * sizeof(FLIGHTREC);
+    if (0 > (fd = open(pf->path, O_RDWR | O_CREAT | O_TRUNC, 0644)))
+    {
+        perror(pf->path);
+        return -1;
+    }
+    if (ftruncate(fd, pf->len))
+    {
+        perror("flightrec_start=>ftruncate");
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, pf->len, PROT_READ | PROT_WRITE
+           , MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p)
+    {
+        perror("flightrec_start=>mmap");
+        return -1;
+    }
+
+    /* Header; the ring is zero (no records) from ftruncate(...) */
+    pf->hdr = (pFLIGHTHDR) p;
+    pf->recs = (pFLIGHTREC) (pf->hdr + 1);
+    pf->mask = pf->nrec - 1;
+    pf->pid = (uint32_t) getpid();
+    pf->hdr->version = FLIGHTREC_VERSION;
+    pf->hdr->lrec = sizeof(FLIGHTREC);
+    pf->hdr->nrec = pf->nrec;
+    pf->hdr->pid = pf->pid;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    pf->hdr->mono0_ns = monotonic_ns();
+    pf->hdr->real0_ns = ((uint64_t) rt.tv_sec * 1000000000) + rt.tv_nsec;
+    pf->hdr->magic = FLIGHTREC_MAGIC;
+    msync(pf->hdr, pf->len, MS_SYNC);
+
+    pf->stop = 0;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&pf->wake, &ca);
+    pthread_condattr_destroy(&ca);
+    if ((rtn = pthread_create(&pf->thread, NULL, flightrec_sync_thread, pf)))
+    {
+        errno = rtn;
+        perror("flightrec_start=>pthread_create");
+        return -1;
+    }
+    pf->running = 1;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Stop sync thread, sync, unmap; report events and syncs to f, if not
+ * NULL; only the process that started the recorder stops it
+ */
+static void
+flightrec_stop(FILE* f)
+{
+    pFLIGHTRECORDER pf = &flightrec;
+    uint64_t syncs;
+
+    if (!pf->hdr || !pf->running) { return; }
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = 1;
+    pthread_cond_signal(&pf->wake);
+    pthread_mutex_unlock(&pf->lock);
+    pthread_join(pf->thread, NULL);
+    pf->running = 0;
+    msync(pf->hdr, pf->len, MS_SYNC);
+    syncs = pf->hdr->syncs;
+    if (f)
+    {
+        fprintf(f, "Flight recorder [%s]:  events=%lu; ring=%u; syncs=%lu"
+                   "; mean sync=%.1fus\n"
+                 , pf->path, (unsigned long) pf->hdr->head, pf->nrec
+                 , (unsigned long) syncs
+                 , syncs ? pf->sync_ns * 1e-3 / syncs : 0.0);
+    }
+    munmap(pf->hdr, pf->len);
+    pf->hdr = NULL;
+}
+
+
+/**********************************************************************/
+/* Decode last events of a recorder file, PATH[,last=N], to f
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+flightrec_dump(FILE* f, char* spec)
+{
+    char* comma = strchr(spec, ',');
+    unsigned long last = 50;
+    FLIGHTHDR hdr;
+    FLIGHTREC r;
+    FILE* fin;
+    uint64_t first;
+    uint64_t seq;
+    uint64_t t_last = 0;
+    size_t lost = 0;
+
+    if (comma)
+    {
+        if (1 != sscanf(comma, ",last=%lu", &last) || !last) { return -1; }
+        *comma = '\0';
+    }
+    if (!(fin = fopen(spec, "rb")))
+    {
+        perror(spec);
+        return -1;
+    }
+    if (1 != fread(&hdr, sizeof hdr, 1, fin)
+     || FLIGHTREC_MAGIC != hdr.magic || FLIGHTREC_VERSION != hdr.version
+     || sizeof(FLIGHTREC) != hdr.lrec || !hdr.nrec
+     || (hdr.nrec & (hdr.nrec - 1)))
+    {
+        fprintf(stderr, "ERROR:  [%s] is not a flight recorder file\n"
+                      , spec);
+        fclose(fin);
+        return -1;
+    }
+
+    /* Last N events still in the ring */
+    if (last > hdr.nrec) { last = hdr.nrec; }
+    first = hdr.head > last ? hdr.head - last : 0;
+
+    /* Last complete event's time, as the reference for times before it */
+    for (seq = hdr.head; seq-- > first; )
+    {
+        fseek(fin, sizeof hdr + (seq & (hdr.nrec - 1)) * sizeof r, SEEK_SET);
+        if (1==fread(&r, sizeof r, 1, fin) && r.seq == seq + 1)
+        {
+            t_last = r.t_ns;
+            break;
+        }
+    }
+
+    fprintf(f, "Flight recorder [%s]:  events=%lu; ring=%u; syncs=%lu"
+               "; started by pid %u\n"
+             , spec, (unsigned long) hdr.head, hdr.nrec
+             , (unsigned long) hdr.syncs, hdr.pid);
+    fprintf(f, "%12s  %-26s  %12s  %7s  %-14s  %s\n"
+             , "seq", "time (UTC)", "before-last", "pid", "site", "value");
+    for (seq = first; seq < hdr.head; ++seq)
+    {
+        char when[32];
+        char site[32];
+        uint64_t real_ns;
+        time_t secs;
+        struct tm tm;
+        unsigned file_id;
+
+        fseek(fin, sizeof hdr + (seq & (hdr.nrec - 1)) * sizeof r, SEEK_SET);
+        if (1 != fread(&r, sizeof r, 1, fin) || r.seq != seq + 1)
+        {
+            fprintf(f, "%12lu  (lost:  not written, or not synced)\n"
+                     , (unsigned long) seq);
+            ++lost;
+            continue;
+        }
+        real_ns = hdr.real0_ns + (r.t_ns - hdr.mono0_ns);
+        secs = (time_t) (real_ns / 1000000000);
+        if (gmtime_r(&secs, &tm))
+        {
+            size_t n = strftime(when, sizeof when, "%Y-%m-%dT%H:%M:%S", &tm);
+            snprintf(when + n, sizeof when - n, ".%06luZ"
+                    , (unsigned long) ((real_ns % 1000000000) / 1000));
+        }
+        else { strcpy(when, "?"); }
+        file_id = r.site >> 20;
+        snprintf(site, sizeof site, "%s:%u"
+                , file_id < sizeof flightrec_files / sizeof *flightrec_files
+                  ? flightrec_files[file_id] : "?"
+                , r.site & 0xfffff);
+        fprintf(f, "%12lu  %-26s  %10.3fms  %7u  %-14s  %ld\n"
+                 , (unsigned long) seq, when
+                 , (double) (int64_t) (t_last - r.t_ns) * 1e-6
+                 , r.pid, site, (long) r.value);
+    }
+    if (lost) { fprintf(f, "Lost records:  %lu\n", (unsigned long) lost); }
+    fclose(fin);
+    return 0;
+}
+
+#endif/*__FLIGHTREC_H__*/
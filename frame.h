@@ -0,0 +1,362 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+/**********************************************************************/
+/*** Sequence-numbered frames with CRC32C, to locate, in a long     ***/
+/*** run, which frames were missing, duplicated or corrupted        ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * FRAME_...                   - Frame layout
+ * frame_put(...), frame_get() - Store, load little-endian values
+ * frame_build(...)            - Build one frame
+ * typedef ... *pFRAMERANGES   - Struct with first ranges of sequence nos.
+ * frame_range_add(...)        - Add sequence number(s) to ranges
+ * typedef ... *pFRAMECOUNTS   - Struct with receiver counts and ranges
+ * typedef ... *pFRAMERX       - Struct with receiver state
+ * frame_rx_init(...)          - Set up receiver
+ * frame_rx_gap(...)           - Account for frames skipped over
+ * frame_rx_one(...)           - Account for one frame, good or corrupted
+ * frame_rx_feed(...)          - Parse received data into frames
+ * frame_rx_finish(...)        - Count frames never received as missing
+ * frame_rx_free(...)          - Release receiver
+ * frame_print_ranges(...)     - Print one kind of range
+ * frame_print(...)            - Summarize counts and ranges
+ *
+ * Frame layout (multi-byte fields are little-endian)
+ * ============
+ *   offset  length  field
+ *        0       4  FRAME_MAGIC
+ *        4       8  sequence number, from 0
+ *       12       2  payload length, L
+ *       14       L  payload:  pseudo-random bytes from sequence number
+ *     14+L       4  CRC32C of sequence number, length and payload
+ *
+ * Receiver
+ * ========
+ * All frames in a run have the same payload length, so the receiver
+ * knows each frame's length.  It finds FRAME_MAGIC, waits for the rest
+ * of the frame, and checks the CRC; then, with next as the sequence
+ * number expected:
+ * - good frame, seq == next:  count good;
+ * - good frame, seq > next:  next ... seq-1 are missing;
+ * - good frame, seq < next:  seq is duplicated;
+ * - bad CRC, seq == next:  next is corrupted;
+ * - bad CRC, any other seq:  the seq field may be what was corrupted,
+ *   so next is not moved; the next good frame, seq > next, then counts
+ *   as many frames from next as there were such bad CRCs as corrupted,
+ *   and the rest up to seq-1 as missing.
+ * After a bad CRC or a bad length, the receiver looks for FRAME_MAGIC
+ * again from the next byte, so a frame with dropped bytes costs only
+ * that frame.  The first FRAME_NRANGES ranges of each kind are kept.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#define FRAME_MAGIC 0x5AA50FF5U     /* Bytes F5 0F A5 5A */
+#define FRAME_HEADER 14
+#define FRAME_OVERHEAD (FRAME_HEADER + 4)
+#define FRAME_MAXPAYLOAD 65535
+#define FRAME_NRANGES 16
+
+
+/**********************************************************************/
+/* Store little-endian values */
+static inline void
+frame_put(unsigned char* p, uint64_t v, int n)
+{
+    while (n-- > 0) { *(p++) = (unsigned char) v; v >>= 8; }
+}
+
+static inline uint64_t
+frame_get(const unsigned char* p, int n)
+{
+    uint64_t v = 0;
+    while (n-- > 0) { v = (v << 8) | p[n]; }
+    return v;
+}
+
+
+/**********************************************************************/
+/* Build frame with sequence number seq and lpayload bytes of payload
+ * into buf, which must hold lpayload + FRAME_OVERHEAD bytes
+ * Return value:  frame length
+ */
+static size_t
+frame_build(char* buf, uint64_t seq, size_t lpayload)
+{
+    unsigned char* p = (unsigned char*) buf;
+    uint64_t x = seq * 0x9E3779B97F4A7C15ULL + 1;   /* xorshift state */
+    size_t i;
+
+    frame_put(p, FRAME_MAGIC, 4);
+    frame_put(p + 4, seq, 8);
+    frame_put(p + 12, lpayload, 2);
+    for (i=0; i<lpayload; ++i)
+    {
+        if (!(i & 7))
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+        }
+        p[FRAME_HEADER + i] = (unsigned char) (x >> ((i & 7) * 8));
+    }
+    frame_put(p + FRAME_HEADER + lpayload
+             , crc32c(0, p + 4, FRAME_HEADER - 4 + lpayload), 4);
+    return lpayload + FRAME_OVERHEAD;
+}
+
+
+/**********************************************************************/
+/* First ranges of sequence numbers of one kind */
+typedef struct FRAMERANGESstr
+{
+    size_t total;            /* Count of frames of this kind */
+    size_t n;                /* Count of ranges kept */
+    size_t more;             /* Non-zero if ranges were not kept */
+    uint64_t first[FRAME_NRANGES];
+    uint64_t last[FRAME_NRANGES];
+} FRAMERANGES, *pFRAMERANGES;
+
+
+/**********************************************************************/
+/* Add sequence numbers first ... last to ranges, merging with the last
+ * range kept when contiguous
+ */
+static void
+frame_range_add(pFRAMERANGES pr, uint64_t first, uint64_t last)
+{
+    pr->total += (last - first) + 1;
+    if (pr->n && (pr->last[pr->n-1] + 1) == first)
+    {
+        pr->last[pr->n-1] = last;
+        return;
+    }
+    if (pr->n >= FRAME_NRANGES) { pr->more = 1; return; }
+    pr->first[pr->n] = first;
+    pr->last[pr->n] = last;
+    ++pr->n;
+}
+
+
+/**********************************************************************/
+/* Receiver counts and ranges, returned from forked reader */
+typedef struct FRAMECOUNTSstr
+{
+    uint64_t next;           /* Next sequence number expected */
+    size_t good;             /* Count of frames received intact */
+    size_t skipped;          /* Count of bytes skipped to find frames */
+    size_t bad_crc;          /* Count of frames with bad CRC */
+    FRAMERANGES missing;
+    FRAMERANGES duplicated;
+    FRAMERANGES corrupted;
+} FRAMECOUNTS, *pFRAMECOUNTS;
+
+
+/**********************************************************************/
+/* Receiver state */
+typedef struct FRAMERXstr
+{
+    size_t lframe;           /* Length of each frame */
+    char* buf;               /* Data received, not yet parsed */
+    size_t lbuf;             /* Count of bytes in buf */
+    size_t size;             /* Size of buf */
+    size_t bad_pending;      /* Bad CRCs, seq != next, since last frame */
+    FRAMECOUNTS counts;
+} FRAMERX, *pFRAMERX;
+
+
+/**********************************************************************/
+/* Set up receiver for frames with lpayload bytes of payload
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+frame_rx_init(pFRAMERX pfr, size_t lpayload)
+{
+    memset(pfr, 0, sizeof *pfr);
+    pfr->lframe = lpayload + FRAME_OVERHEAD;
+    pfr->size = 2 * pfr->lframe + 4096;
+    if (!(pfr->buf = malloc(pfr->size))) { return -1; }
+    crc32c_init();
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Account for frames from next up to seq-1 that arrived only with a
+ * bad CRC and unusable seq as corrupted, and any others as missing
+ */
+static void
+frame_rx_gap(pFRAMERX pfr, uint64_t seq)
+{
+    pFRAMECOUNTS pc = &pfr->counts;
+    uint64_t n = seq - pc->next;
+
+    if (pfr->bad_pending < n) { n = pfr->bad_pending; }
+    pfr->bad_pending = 0;
+    if (n)
+    {
+        frame_range_add(&pc->corrupted, pc->next, pc->next + n - 1);
+        pc->next += n;
+    }
+    if (seq > pc->next) { frame_range_add(&pc->missing, pc->next, seq-1); }
+}
+
+
+/**********************************************************************/
+/* Account for one frame with sequence number seq; good is non-zero
+ * for a good CRC
+ */
+static void
+frame_rx_one(pFRAMERX pfr, uint64_t seq, int good)
+{
+    pFRAMECOUNTS pc = &pfr->counts;
+    if (good && seq < pc->next)
+    {
+        frame_range_add(&pc->duplicated, seq, seq);
+        return;
+    }
+    frame_rx_gap(pfr, seq);
+    if (good) { ++pc->good; }
+    else      { frame_range_add(&pc->corrupted, seq, seq); }
+    pc->next = seq + 1;
+}
+
+
+/**********************************************************************/
+/* Parse len bytes of received data, plus any left from before, into
+ * frames
+ */
+static void
+frame_rx_feed(pFRAMERX pfr, const char* data, size_t len)
+{
+    unsigned char* p;
+    unsigned char* end;
+    size_t n;
+
+    while (len > 0)
+    {
+        /* Append as much as fits */
+        n = pfr->size - pfr->lbuf;
+        if (n > len) { n = len; }
+        memcpy(pfr->buf + pfr->lbuf, data, n);
+        pfr->lbuf += n;
+        data += n;
+        len -= n;
+
+        /* Parse complete frames */
+        p = (unsigned char*) pfr->buf;
+        end = p + pfr->lbuf;
+        while ((size_t) (end - p) >= pfr->lframe)
+        {
+            uint64_t seq;
+            uint32_t crc;
+
+            if (FRAME_MAGIC != frame_get(p, 4)
+             || (pfr->lframe - FRAME_OVERHEAD) != frame_get(p + 12, 2))
+            {
+                ++p;
+                ++pfr->counts.skipped;
+                continue;
+            }
+            seq = frame_get(p + 4, 8);
+            crc = crc32c(0, p + 4, pfr->lframe - 8);
+            if (crc == frame_get(p + pfr->lframe - 4, 4))
+            {
+                frame_rx_one(pfr, seq, 1);
+                p += pfr->lframe;
+                continue;
+            }
+
+            /* Bad CRC:  corrupted only if seq is the one expected, as
+             * one flipped bit of seq would otherwise move next; look
+             * for next frame from next byte, in case this one lost bytes
+             */
+            ++pfr->counts.bad_crc;
+            if (seq == pfr->counts.next) { frame_rx_one(pfr, seq, 0); }
+            else                         { ++pfr->bad_pending; }
+            ++p;
+            ++pfr->counts.skipped;
+        }
+
+        /* Keep incomplete frame for next time */
+        pfr->lbuf = end - p;
+        memmove(pfr->buf, p, pfr->lbuf);
+    }
+}
+
+
+/**********************************************************************/
+/* Count frames never received, up to nframes, as missing (or, after
+ * bad CRCs, as corrupted)
+ */
+static void
+frame_rx_finish(pFRAMERX pfr, uint64_t nframes)
+{
+    if (pfr->counts.next < nframes)
+    {
+        frame_rx_gap(pfr, nframes);
+        pfr->counts.next = nframes;
+    }
+}
+
+
+/**********************************************************************/
+/* Release receiver */
+static void
+frame_rx_free(pFRAMERX pfr)
+{
+    free(pfr->buf);
+    pfr->buf = NULL;
+}
+
+
+/**********************************************************************/
+/* Print total and ranges of one kind, e.g. missing=3 [7-8,12] */
+static void
+frame_print_ranges(FILE* f, const char* label, pFRAMERANGES pr)
+{
+    size_t i;
+    fprintf(f, "%s=%lu", label, (unsigned long) pr->total);
+    for (i=0; i<pr->n; ++i)
+    {
+        if (pr->first[i] == pr->last[i])
+        {
+            fprintf(f, "%s%lu", i ? "," : " [", (unsigned long) pr->first[i]);
+        }
+        else
+        {
+            fprintf(f, "%s%lu-%lu", i ? "," : " ["
+                     , (unsigned long) pr->first[i]
+                     , (unsigned long) pr->last[i]);
+        }
+    }
+    if (pr->n) { fprintf(f, "%s]", pr->more ? ",..." : ""); }
+}
+
+
+/**********************************************************************/
+/* Summarize counts and ranges */
+static void
+frame_print(FILE* f, pFRAMECOUNTS pc, size_t nframes)
+{
+    if (!f) { return; }
+    fprintf(f, "Frames:  sent=%lu; good=%lu; "
+             , (unsigned long) nframes, (unsigned long) pc->good);
+    frame_print_ranges(f, "missing", &pc->missing);
+    fprintf(f, "; ");
+    frame_print_ranges(f, "duplicated", &pc->duplicated);
+    fprintf(f, "; ");
+    frame_print_ranges(f, "corrupted", &pc->corrupted);
+    fprintf(f, "; bad-crc=%lu; skipped-bytes=%lu\n"
+             , (unsigned long) pc->bad_crc, (unsigned long) pc->skipped);
+}
+
+#endif/*__FRAME_H__*/
@@ -0,0 +1,72 @@
+/***********************************************************************
+ * frame_test.c - check of the frame.h receiver, without a TTY
+ *
+ * Usage:  ./frame_test
+ *
+ * Builds a run of frames, corrupts one bit of one frame's sequence
+ * number, feeds the run to the receiver, and checks that the frame is
+ * counted as corrupted, with no frames missing or duplicated.
+ *
+ * Exit status:  0 if all checks pass; 1 otherwise
+ */
+
+#include <stdio.h>
+
+#include "frame.h"
+
+#define NFRAMES 10
+#define PAYLOAD 32
+#define LFRAME (PAYLOAD + FRAME_OVERHEAD)
+
+
+/**********************************************************************/
+/* Feed NFRAMES frames, with bit flipped in the seq of frame bad, and
+ * check the counts
+ * Return value:  0 if the checks pass; 1 otherwise
+ */
+static int
+frame_test_seq_bit(int bad, int bit)
+{
+    char run[NFRAMES * LFRAME];
+    FRAMERX fr;
+    pFRAMECOUNTS pc = &fr.counts;
+    int i;
+    int fail;
+
+    for (i=0; i<NFRAMES; ++i)
+    {
+        frame_build(run + (i * LFRAME), i, PAYLOAD);
+    }
+    run[(bad * LFRAME) + 4 + (bit / 8)] ^= 1 << (bit % 8);
+
+    if (frame_rx_init(&fr, PAYLOAD))
+    {
+        perror("frame_test=>frame_rx_init");
+        return 1;
+    }
+    frame_rx_feed(&fr, run, sizeof run);
+    frame_rx_finish(&fr, NFRAMES);
+
+    fail = pc->missing.total || pc->duplicated.total
+        || 1 != pc->corrupted.total || 1 != pc->bad_crc
+        || (NFRAMES-1) != pc->good || NFRAMES != pc->next
+        || (uint64_t) bad != pc->corrupted.first[0];
+    printf("%s:  seq bit %d of frame %d:  ", fail ? "FAIL" : "ok", bit, bad);
+    frame_print(stdout, pc, NFRAMES);
+    frame_rx_free(&fr);
+    return fail;
+}
+
+
+/**********************************************************************/
+int
+main(void)
+{
+    int fail = 0;
+
+    fail |= frame_test_seq_bit(3, 3);    /* seq 3 => 11, ahead of next */
+    fail |= frame_test_seq_bit(3, 1);    /* seq 3 => 1, behind next */
+    fail |= frame_test_seq_bit(3, 40);   /* seq far ahead of next */
+    fail |= frame_test_seq_bit(9, 3);    /* Last frame */
+    return fail;
+}
@@ -0,0 +1,148 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+/**********************************************************************/
+/*** Fixed-size log-linear (HDR-style) histogram of 64-bit values,  ***/
+/*** e.g. latencies in ns; no allocation when recording             ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * HIST_SUBBITS, HIST_BUCKETS  - Histogram resolution and size
+ * typedef ... *pHISTOGRAM     - Struct with counts
+ * hist_init(...)              - Clear histogram
+ * hist_index(...)             - Bucket index of a value
+ * hist_value(...)             - Highest value in a bucket
+ * hist_record(...)            - Count one value
+ * hist_percentile(...)        - Value at or below which pct% of counts
+ * hist_print(...)             - One-line summary:  p50 p99 p99.9 max
+ *
+ * Layout
+ * ======
+ * Values below 2*HIST_SUB are counted exactly; above that, each power
+ * of two is split into HIST_SUB linear sub-buckets, so any value is
+ * resolved to better than 1 part in HIST_SUB (~3% for HIST_SUBBITS=5)
+ * over the whole 64-bit range, in HIST_BUCKETS counters.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HIST_SUBBITS 5
+#define HIST_SUB (1 << HIST_SUBBITS)
+#define HIST_BUCKETS ((64 - HIST_SUBBITS + 1) * HIST_SUB)
+
+
+/**********************************************************************/
+/* Histogram */
+typedef struct HISTOGRAMstr
+{
+    uint64_t count;          /* Count of values recorded */
+    uint64_t sum;            /* Sum of values recorded */
+    uint64_t min;            /* Exact minimum value */
+    uint64_t max;            /* Exact maximum value */
+    uint64_t buckets[HIST_BUCKETS];
+} HISTOGRAM, *pHISTOGRAM;
+
+
+/**********************************************************************/
+/* Clear histogram */
+static void
+hist_init(pHISTOGRAM ph)
+{
+    memset(ph, 0, sizeof *ph);
+    ph->min = UINT64_MAX;
+}
+
+
+/**********************************************************************/
+/* Bucket index of a value */
+static inline size_t
+hist_index(uint64_t v)
+{
+    int shift;
+    if (v < (2 * HIST_SUB)) { return (size_t) v; }
+    shift = (63 - __builtin_clzll(v)) - HIST_SUBBITS;
+    return ((shift + 1) * HIST_SUB) + ((v >> shift) - HIST_SUB);
+}
+
+
+/**********************************************************************/
+/* Highest value in a bucket */
+static uint64_t
+hist_value(size_t idx)
+{
+    int shift;
+    if (idx < (2 * HIST_SUB)) { return idx; }
+    shift = (idx / HIST_SUB) - 1;
+    return ((((uint64_t) HIST_SUB + (idx % HIST_SUB)) + 1) << shift) - 1;
+}
+
+
+/**********************************************************************/
+/* Count one value */
+static inline void
+hist_record(pHISTOGRAM ph, uint64_t v)
+{
+    ++ph->buckets[hist_index(v)];
+    ++ph->count;
+    ph->sum += v;
+    if (v < ph->min) { ph->min = v; }
+    if (v > ph->max) { ph->max = v; }
+}
+
+
+/**********************************************************************/
+/* Value at or below which pct percent of values were recorded, to the
+ * resolution of the buckets, but never more than the exact maximum
+ */
+static uint64_t
+hist_percentile(pHISTOGRAM ph, double pct)
+{
+    uint64_t target;
+    uint64_t seen = 0;
+    size_t idx;
+    uint64_t v;
+
+    if (!ph->count) { return 0; }
+    target = (uint64_t) ((pct / 100.0) * ph->count);
+    if (target < 1) { target = 1; }
+    if (target > ph->count) { target = ph->count; }
+    for (idx=0; idx<HIST_BUCKETS; ++idx)
+    {
+        seen += ph->buckets[idx];
+        if (seen >= target) { break; }
+    }
+    v = hist_value(idx);
+    return v > ph->max ? ph->max : v;
+}
+
+
+/**********************************************************************/
+/* Print one-line summary, with values divided by scale (e.g. 1000 to
+ * print ns values as us), to a stream
+ */
+static void
+hist_print(FILE* f, const char* label, pHISTOGRAM ph
+          , double scale, const char* units)
+{
+    if (!f) { return; }
+    if (!ph->count)
+    {
+        fprintf(f, "%s:  count=0\n", label);
+        return;
+    }
+    fprintf(f, "%s:  count=%lu; min=%.3f%s; mean=%.3f%s"
+               "; p50=%.3f%s; p99=%.3f%s; p99.9=%.3f%s; max=%.3f%s\n"
+             , label, (unsigned long) ph->count
+             , ph->min / scale, units
+             , ((double) ph->sum / ph->count) / scale, units
+             , hist_percentile(ph, 50.0) / scale, units
+             , hist_percentile(ph, 99.0) / scale, units
+             , hist_percentile(ph, 99.9) / scale, units
+             , ph->max / scale, units
+             );
+}
+
+#endif/*__HISTOGRAM_H__*/
@@ -0,0 +1,98 @@
+#ifndef __ICOUNT_H__
+#define __ICOUNT_H__
+
+/**********************************************************************/
+/*** Routines to capture UART driver counters (TIOCGICOUNT):  chars ***/
+/*** transferred, and overrun, framing, parity and break errors     ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pICOUNT        - Struct serial_icounter_struct
+ * icount_get(...)             - Snapshot counters of a TTY fd
+ * icount_delta(...)           - Difference of two snapshots
+ * icount_errors(...)          - Sum of error counters
+ * icount_print(...)           - One-line summary of counters
+ *
+ * Which buffer overflowed
+ * =======================
+ * - overrun:      the UART hardware FIFO overflowed before the driver
+ *                 emptied it (e.g. interrupt or DMA latency)
+ * - buf_overrun:  the tty flip buffer was full, so the driver dropped
+ *                 chars it had taken from the UART (reader too slow)
+ * - frame, parity, brk:  line errors (e.g. baud mismatch or noise)
+ *
+ * Drivers without the ioctl (e.g. ptys, USB serial adapters with no
+ * counters) fail with ENOTTY or EINVAL; callers then report the
+ * counters as unavailable.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+typedef struct serial_icounter_struct ICOUNT, *pICOUNT;
+
+
+/**********************************************************************/
+/* Snapshot counters of a TTY fd
+ * Return value:  0 on success; -1 if unsupported or not a TTY
+ */
+static int
+icount_get(int fd, pICOUNT pic)
+{
+    memset(pic, 0, sizeof *pic);
+    if (ioctl(fd, TIOCGICOUNT, pic))
+    {
+        errno = 0;
+        return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Difference of two snapshots:  *pdelta = *pafter - *pbefore */
+static void
+icount_delta(pICOUNT pdelta, pICOUNT pafter, pICOUNT pbefore)
+{
+    memset(pdelta, 0, sizeof *pdelta);
+    pdelta->cts = pafter->cts - pbefore->cts;
+    pdelta->dsr = pafter->dsr - pbefore->dsr;
+    pdelta->rng = pafter->rng - pbefore->rng;
+    pdelta->dcd = pafter->dcd - pbefore->dcd;
+    pdelta->rx = pafter->rx - pbefore->rx;
+    pdelta->tx = pafter->tx - pbefore->tx;
+    pdelta->frame = pafter->frame - pbefore->frame;
+    pdelta->overrun = pafter->overrun - pbefore->overrun;
+    pdelta->parity = pafter->parity - pbefore->parity;
+    pdelta->brk = pafter->brk - pbefore->brk;
+    pdelta->buf_overrun = pafter->buf_overrun - pbefore->buf_overrun;
+}
+
+
+/**********************************************************************/
+/* Sum of error counters */
+static long
+icount_errors(pICOUNT pic)
+{
+    return (long) pic->overrun + pic->buf_overrun
+         + pic->frame + pic->parity + pic->brk;
+}
+
+
+/**********************************************************************/
+/* One-line summary of counters */
+static void
+icount_print(FILE* f, const char* label, pICOUNT pic)
+{
+    if (!f) { return; }
+    fprintf(f, "%s:  rx=%d; tx=%d; overrun=%d; buf_overrun=%d"
+               "; frame=%d; parity=%d; brk=%d\n"
+             , label, pic->rx, pic->tx, pic->overrun, pic->buf_overrun
+             , pic->frame, pic->parity, pic->brk);
+}
+
+#endif/*__ICOUNT_H__*/
@@ -0,0 +1,557 @@
+#ifndef __MULTIPORT_H__
+#define __MULTIPORT_H__
+
+/**********************************************************************/
+/*** Routines to stress several TTYs at once from one process, with ***/
+/*** a thread per port, or with one event loop for all ports        ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * MPORT_...                   - Limits and defaults
+ * typedef ... *pMPORT         - Struct with state of one port
+ * typedef ... *pMPORTSET      - Struct with ports and options
+ * mport_add_link(...)         - Add port writing one TTY, reading another
+ * mport_add(...)              - Add port from PATH[,speed=S][,count=N]
+ * mport_open(...)             - Open and configure port, set up verifier
+ * mport_close(...)            - Close port, release memory
+ * mport_write(...)            - One non-blocking write to port
+ * mport_read(...)             - Read and verify what port has received
+ * mport_check(...)            - Note whether port has finished
+ * mport_loop(...)             - poll(...) loop over some ports
+ * mport_thread(...)           - Thread running loop for one port
+ * mport_print(...)            - Summarize one port
+ * run_multiport(...)          - Run all ports, report per port and total
+ *
+ * Usage
+ * =====
+ * Each port writes the same stream as send_chunks(...) in sst.h, from
+ * a heap copy of the cycle of lines (cf. ring.h), in non-blocking
+ * writes of up to chunk chars, and reads and verifies (cf. verify.h)
+ * its loopback data on a second, non-blocking fd in the same process;
+ * there is no forked reader.  A port may also write one TTY and read
+ * another wired to it (cf. duplex.h), or use fds already open, e.g.
+ * the two sides of a pty pair.  A port is finished after all writes,
+ * when every char sent is received intact, or when no data arrive for
+ * as long as the rest could take (cf. recv_tail_ms(...) in sst.h);
+ * chars not received are then counted as dropped.
+ *
+ * - threads:  one thread per port, each polling its own two fds
+ * - poll:     one thread polling all fds of all ports
+ *
+ * Both use mport_loop(...); they differ only in how many ports each
+ * call services, so CPU use (e.g. for 1 to 64 ptys) compares the cost
+ * of threads against one event loop directly.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* parse_speed_value(...), stty_get_line_fd(...) */
+#include "raw_settings.h"
+/* profile_configure_fd(...):  raw settings and speed in one ioctl;
+ * profile_keep_original(...)
+ */
+#include "profile.h"
+/* fill_cycle(), cycle, LCYCLE, RING, VERIFY, timing, recv_tail_ms(...) */
+#include "sst.h"
+
+#define MPORT_MAX 64
+#define MPORT_CHUNK 4096
+
+
+/**********************************************************************/
+/* State of one port */
+typedef struct MPORTstr
+{
+    char* tty_name;          /* TTY to write */
+    char* rx_name;           /* TTY to read, or NULL for tty_name */
+    int fdw_pre;             /* Open fd to dup for writes, or -1 */
+    int fdr_pre;             /* Open fd to dup for reads, or -1 */
+    char* speed;             /* Speed token, or NULL to leave as is */
+    size_t count;            /* How many characters to send */
+    int fdw;                 /* Non-blocking write fd */
+    int fdr;                 /* Non-blocking read fd */
+    RING ring;               /* Data to send */
+    size_t pos;              /* Offset in ring of next char to send */
+    size_t chunk;            /* Maximum chars per write() */
+    size_t sent;             /* Count of chars written */
+    size_t received;         /* Count of chars read */
+    size_t tries;            /* Count of write()'s */
+    size_t eagains;          /* Count of EAGAIN write errors */
+    size_t reads;            /* Count of read()'s with data */
+    VERIFY verify;
+    double char_ns;          /* Time of one char at line rate, or 0 */
+    uint64_t t_start;        /* Start time */
+    uint64_t t_first;        /* Time of first char read, or 0 */
+    uint64_t t_last;         /* Time of last char read, or of start */
+    uint64_t t_sent;         /* Time of last write, once all are sent */
+    uint64_t t_end;          /* Time finished */
+    int done;                /* Non-zero when finished */
+    int failed;              /* Non-zero after a write or read error */
+    pthread_t thread;
+    int threaded;            /* Non-zero if thread above was started */
+} MPORT, *pMPORT;
+
+
+/**********************************************************************/
+/* Ports and options */
+typedef struct MPORTSETstr
+{
+    size_t n;                /* Count of ports */
+    MPORT ports[MPORT_MAX];
+    int threads;             /* Non-zero for thread per port */
+    size_t chunk;            /* Maximum chars per write(), or 0 */
+    int do_raw_config;       /* Non-zero to configure raw data */
+    int keep_tty_settings;   /* Non-zero to not restore TTYs at exit */
+    int debug;
+} MPORTSET, *pMPORTSET;
+
+
+/**********************************************************************/
+/* Add port writing tx_name (or dup of fdw_pre, if not -1) and reading
+ * rx_name (or dup of fdr_pre), with speed token (or NULL) and count
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+mport_add_link(pMPORTSET pset, char* tx_name, char* rx_name
+              , int fdw_pre, int fdr_pre, char* speed, size_t count)
+{
+    pMPORT pp;
+
+    if (pset->n >= MPORT_MAX)
+    {
+        fprintf(stderr,"ERROR:  more than %d ports\n", MPORT_MAX);
+        return -1;
+    }
+    if (!count)
+    {
+        fprintf(stderr,"ERROR:  no send count for port [%s]\n", tx_name);
+        return -1;
+    }
+    pp = pset->ports + pset->n;
+    memset(pp, 0, sizeof *pp);
+    pp->fdw = pp->fdr = -1;
+    pp->tty_name = tx_name;
+    pp->rx_name = rx_name;
+    pp->fdw_pre = fdw_pre;
+    pp->fdr_pre = fdr_pre;
+    pp->speed = speed;
+    pp->count = count;
+    ++pset->n;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Add port from spec PATH[,speed=S][,count=N], e.g.
+ *   /dev/ttyTHS1,speed=4M,count=4000000
+ * with speed and count defaulting to default_speed and default_count;
+ * spec is modified (commas become NULs)
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+mport_add(pMPORTSET pset, char* spec, char* default_speed
+         , size_t default_count)
+{
+    char* speed = default_speed;
+    size_t count = default_count;
+    char* opt;
+
+    for (opt = strchr(spec, ','); opt; opt = strchr(opt, ','))
+    {
+        *(opt++) = '\0';
+        if (!strncmp(opt, "speed=", 6))
+        {
+            speed = opt + 6;
+        }
+        else if (!strncmp(opt, "count=", 6))
+        {
+            char* comma = strchr(opt, ',');
+            if (comma) { *comma = '\0'; }
+            count = (size_t) parse_speed_value(opt + 6);
+            if (comma) { *comma = ','; }
+        }
+        else
+        {
+            fprintf(stderr,"ERROR:  bad port option [%s] for [%s]\n"
+                          , opt, spec);
+            return -1;
+        }
+    }
+    return mport_add_link(pset, spec, NULL, -1, -1, speed, count);
+}
+
+
+/**********************************************************************/
+/* Open and configure port, set up data to send and verifier
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+mport_open(pMPORTSET pset, pMPORT pp)
+{
+    char* rx_name = pp->rx_name ? pp->rx_name : pp->tty_name;
+    unsigned long baud;
+    int bits;
+
+    pp->chunk = pset->chunk ? pset->chunk : MPORT_CHUNK;
+
+    /* Open, or dup, non-blocking fds:  a port that reads what it
+     * writes opens its TTY once, read/write, and writes a dup
+     */
+    pp->fdr = 0 <= pp->fdr_pre
+            ? dup(pp->fdr_pre)
+            : open(rx_name, O_RDWR | O_NONBLOCK | O_NOCTTY);
+    if (0 > pp->fdr) { perror(rx_name); return -1; }
+    pp->fdw = 0 <= pp->fdw_pre
+            ? dup(pp->fdw_pre)
+            : rx_name == pp->tty_name
+            ? dup(pp->fdr)
+            : open(pp->tty_name, O_WRONLY | O_NONBLOCK | O_NOCTTY);
+    if (0 > pp->fdw) { perror(pp->tty_name); return -1; }
+
+    /* Configure TTYs opened by name, on the open fds, after saving
+     * their settings to restore at exit (cf. profile_keep_original(...))
+     */
+    if (0 > pp->fdw_pre && (pset->do_raw_config || pp->speed)
+     && !pset->keep_tty_settings
+     && profile_keep_original(pp->tty_name, pp->fdw) && pset->debug)
+    {
+        fprintf(stderr,"WARNING:  cannot save settings of [%s]\n"
+                      , pp->tty_name);
+    }
+    if (0 > pp->fdr_pre && rx_name != pp->tty_name
+     && (pset->do_raw_config || pp->speed)
+     && !pset->keep_tty_settings
+     && profile_keep_original(rx_name, pp->fdr) && pset->debug)
+    {
+        fprintf(stderr,"WARNING:  cannot save settings of [%s]\n"
+                      , rx_name);
+    }
+    errno = 0;
+    if (0 > pp->fdw_pre
+     && (pset->do_raw_config || pp->speed)
+     && profile_configure_fd(pp->fdw, pp->tty_name, NULL
+                            , pset->do_raw_config, pp->speed, NULL, NULL)
+     && pp->speed)
+    {
+        fprintf(stderr,"ERROR:  cannot set speed [%s] of [%s]\n"
+                      , pp->speed, pp->tty_name);
+        return -1;
+    }
+    if (0 > pp->fdr_pre && rx_name != pp->tty_name
+     && (pset->do_raw_config || pp->speed)
+     && profile_configure_fd(pp->fdr, rx_name, NULL
+                            , pset->do_raw_config, pp->speed, NULL, NULL)
+     && pp->speed)
+    {
+        fprintf(stderr,"ERROR:  cannot set speed [%s] of [%s]\n"
+                      , pp->speed, rx_name);
+        return -1;
+    }
+
+    /* Time of one char on the wire, as applied, for the last wait */
+    if (!stty_get_line_fd(pp->fdr, &baud, &bits) && baud)
+    {
+        pp->char_ns = bits * 1e9 / baud;
+    }
+    errno = 0;
+
+    fill_cycle();
+    if (ring_repeat(&pp->ring, cycle, LCYCLE, pp->chunk)
+     || verify_init(&pp->verify, cycle, LCYCLE)
+       )
+    {
+        return -1;
+    }
+    if (pp->chunk > pp->ring.lwindow) { pp->chunk = pp->ring.lwindow; }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Close port, release memory */
+static void
+mport_close(pMPORT pp)
+{
+    if (0 <= pp->fdw) { close(pp->fdw); pp->fdw = -1; }
+    if (0 <= pp->fdr) { close(pp->fdr); pp->fdr = -1; }
+    ring_free(&pp->ring);
+    verify_free(&pp->verify);
+}
+
+
+/**********************************************************************/
+/* One non-blocking write to port */
+static void
+mport_write(pMPORT pp)
+{
+    size_t n = pp->count - pp->sent;
+    ssize_t iwrite;
+
+    if (n > pp->chunk) { n = pp->chunk; }
+    ++pp->tries;
+    iwrite = write(pp->fdw, pp->ring.base + pp->pos, n);
+    if (iwrite < 0)
+    {
+        if (EAGAIN==errno || EWOULDBLOCK==errno)
+        {
+            ++pp->eagains;
+            errno = 0;
+            return;
+        }
+        perror("mport_write");
+        pp->failed = 1;
+        return;
+    }
+    pp->sent += iwrite;
+    pp->pos = (pp->pos + iwrite) % pp->ring.size;
+    if (pp->sent >= pp->count) { pp->t_sent = monotonic_ns(); }
+}
+
+
+/**********************************************************************/
+/* Read and verify what port has received, until read would block */
+static void
+mport_read(pMPORT pp)
+{
+    char databuf[4096];
+    ssize_t iread;
+
+    while (0 < (iread = read(pp->fdr, databuf, sizeof databuf)))
+    {
+        ++pp->reads;
+        pp->received += iread;
+        verify_feed(&pp->verify, databuf, iread);
+        pp->t_last = monotonic_ns();
+        if (!pp->t_first) { pp->t_first = pp->t_last; }
+        if ((size_t) iread < sizeof databuf) { break; }
+    }
+    if (iread < 0 && EAGAIN!=errno && EWOULDBLOCK!=errno)
+    {
+        perror("mport_read");
+        pp->failed = 1;
+    }
+    errno = 0;
+}
+
+
+/**********************************************************************/
+/* Note whether port has finished:  all chars are sent, and every one
+ * is received intact, or none have arrived, since the last write or
+ * read, for as long as the rest could take (cf. recv_tail_ms(...) in
+ * sst.h); or a write or read failed
+ */
+static void
+mport_check(pMPORT pp, uint64_t now)
+{
+    uint64_t t_quiet = pp->t_last > pp->t_sent ? pp->t_last : pp->t_sent;
+
+    if (pp->done) { return; }
+    if ((pp->sent >= pp->count
+         && (verify_done(&pp->verify, pp->count)
+            || now > t_quiet + 1000000ULL
+                     * recv_tail_ms(pp->count > pp->received
+                                    ? pp->count - pp->received : 0
+                                   , pp->char_ns, pp->received, pp->reads
+                                   , pp->t_first, pp->t_last, NULL)))
+     || pp->failed
+       )
+    {
+        verify_finish(&pp->verify, pp->sent);
+        pp->t_end = now;
+        pp->done = 1;
+    }
+}
+
+
+/**********************************************************************/
+/* poll(...) loop over n ports, until all are finished */
+static void
+mport_loop(pMPORT* pports, size_t n)
+{
+    struct pollfd pfds[2 * MPORT_MAX];
+    pMPORT owner[2 * MPORT_MAX];
+    size_t i;
+    size_t k;
+    uint64_t now;
+
+    for (;;)
+    {
+        now = monotonic_ns();
+        for (i=k=0; i<n; ++i)
+        {
+            pMPORT pp = pports[i];
+            mport_check(pp, now);
+            if (pp->done) { continue; }
+            if (pp->sent < pp->count)
+            {
+                pfds[k].fd = pp->fdw;
+                pfds[k].events = POLLOUT;
+                pfds[k].revents = 0;
+                owner[k++] = pp;
+            }
+            pfds[k].fd = pp->fdr;
+            pfds[k].events = POLLIN;
+            pfds[k].revents = 0;
+            owner[k++] = pp;
+        }
+        if (!k) { return; }
+
+        if (0 > poll(pfds, k, 100))
+        {
+            if (EINTR==errno) { errno = 0; continue; }
+            perror("mport_loop=>poll");
+            for (i=0; i<n; ++i) { pports[i]->failed = 1; }
+            continue;
+        }
+        for (i=0; i<k; ++i)
+        {
+            if (!pfds[i].revents) { continue; }
+            if (pfds[i].events & POLLOUT) { mport_write(owner[i]); }
+            else                          { mport_read(owner[i]); }
+        }
+    }
+}
+
+
+/**********************************************************************/
+/* Thread running loop for one port */
+static void*
+mport_thread(void* arg)
+{
+    pMPORT pp = (pMPORT) arg;
+    mport_loop(&pp, 1);
+    return NULL;
+}
+
+
+/**********************************************************************/
+/* Summarize one port */
+static void
+mport_print(FILE* f, pMPORT pp)
+{
+    double dt = (pp->t_end - pp->t_start) * 1e-9;
+    fprintf(f, "Port [%s%s%s]:  sent=%lu; received=%lu; matched=%lu"
+               "; dropped=%lu; inserted=%lu; corrupted=%lu"
+               "; %.1f chars/s; writes=%lu; EAGAINs=%lu%s\n"
+             , pp->tty_name, pp->rx_name ? " -> " : ""
+             , pp->rx_name ? pp->rx_name : ""
+             , (unsigned long) pp->sent, (unsigned long) pp->received
+             , (unsigned long) pp->verify.counts.matched
+             , (unsigned long) pp->verify.counts.dropped
+             , (unsigned long) pp->verify.counts.inserted
+             , (unsigned long) pp->verify.counts.corrupted
+             , dt > 0.0 ? pp->received / dt : 0.0
+             , (unsigned long) pp->tries, (unsigned long) pp->eagains
+             , pp->failed ? "; FAILED" : "");
+}
+
+
+/**********************************************************************/
+/* Run all ports, with a thread per port or one event loop, and report
+ * per port and in total
+ * Return value:  0 if every port passed with no errors; -1 otherwise
+ */
+static int
+run_multiport(pMPORTSET pset)
+{
+    pMPORT pports[MPORT_MAX];
+    size_t i;
+    size_t sent = 0;
+    size_t received = 0;
+    size_t errors = 0;
+    size_t failed = 0;
+    uint64_t t0_ns;
+    uint64_t wall_ns;
+    double t0_cpu;
+    double cpu;
+
+    for (i=0; i<pset->n; ++i)
+    {
+        pports[i] = pset->ports + i;
+        if (mport_open(pset, pports[i]))
+        {
+            size_t j;
+            for (j=0; j<=i; ++j) { mport_close(pports[j]); }
+            return -1;
+        }
+    }
+
+    t0_cpu = cpu_seconds();
+    t0_ns = monotonic_ns();
+    for (i=0; i<pset->n; ++i)
+    {
+        pports[i]->t_start = pports[i]->t_last = t0_ns;
+    }
+
+    if (pset->threads)
+    {
+        for (i=0; i<pset->n; ++i)
+        {
+            int rtn = pthread_create(&pports[i]->thread, NULL
+                                    , mport_thread, pports[i]);
+            if (rtn)
+            {
+                /* Run this port in this thread instead */
+                errno = rtn;
+                perror("run_multiport=>pthread_create");
+                errno = 0;
+                mport_thread(pports[i]);
+                continue;
+            }
+            pports[i]->threaded = 1;
+        }
+        for (i=0; i<pset->n; ++i)
+        {
+            if (pports[i]->threaded)
+            {
+                pthread_join(pports[i]->thread, NULL);
+            }
+        }
+    }
+    else
+    {
+        mport_loop(pports, pset->n);
+    }
+
+    wall_ns = monotonic_ns() - t0_ns;
+    cpu = cpu_seconds() - t0_cpu;
+
+    for (i=0; i<pset->n; ++i)
+    {
+        pMPORT pp = pports[i];
+        mport_print(stderr, pp);
+        sent += pp->sent;
+        received += pp->received;
+        errors += pp->verify.counts.dropped + pp->verify.counts.inserted
+                + pp->verify.counts.corrupted;
+        failed += pp->failed ? 1 : 0;
+        mport_close(pp);
+    }
+
+    fprintf(stderr,"Ports=%lu (%s):  sent=%lu; received=%lu; errors=%lu"
+                   "; failed=%lu; %.1f chars/s in %.6fs"
+                   "; CPU=%.6fs (%.1f%% of one core; %.3fms per port"
+                   "; %.3fs per MB)\n"
+                  , (unsigned long) pset->n
+                  , pset->threads ? "thread per port" : "one event loop"
+                  , (unsigned long) sent, (unsigned long) received
+                  , (unsigned long) errors, (unsigned long) failed
+                  , wall_ns ? received / (wall_ns * 1e-9) : 0.0
+                  , wall_ns * 1e-9
+                  , cpu, wall_ns ? 100.0 * cpu / (wall_ns * 1e-9) : 0.0
+                  , pset->n ? 1e3 * cpu / pset->n : 0.0
+                  , received ? cpu / (received * 1e-6) : 0.0
+                  );
+    return (errors || failed) ? -1 : 0;
+}
+
+#endif/*__MULTIPORT_H__*/
@@ -0,0 +1,113 @@
+#ifndef __PACER_H__
+#define __PACER_H__
+
+/**********************************************************************/
+/*** Token-bucket pacer:  limit a writer to a target rate, sleeping ***/
+/*** to absolute deadlines so sleep overshoot does not accumulate   ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pPACER         - Struct with bucket state and statistics
+ * pacer_init(...)             - Set rate (chars/s) and bucket depth
+ * pacer_wait(...)             - Wait until chars may be written
+ * pacer_spend(...)            - Remove chars written from bucket
+ *
+ * Usage
+ * =====
+ *   n = pacer_wait(&pacer, n);     - n is clamped to bucket depth
+ *   iwrite = write(fd, p, n);
+ *   if (iwrite > 0) { pacer_spend(&pacer, iwrite); }
+ *
+ * The bucket fills at [rate] chars/s up to [burst] chars.  When fewer
+ * than n chars are in the bucket, pacer_wait(...) sleeps with
+ * clock_nanosleep(TIMER_ABSTIME) to the time at which the bucket will
+ * hold n; that deadline is computed from the time of the last refill,
+ * not from the time of the call, so late wakeups are credited back.
+ */
+
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* monotonic_ns() */
+#include "timing.h"
+
+
+/**********************************************************************/
+/* Pacer state */
+typedef struct PACERstr
+{
+    double rate;             /* Target chars/s; 0 disables pacing */
+    double burst;            /* Bucket depth, chars */
+    double tokens;           /* Chars in bucket at time t_ns */
+    uint64_t t_ns;           /* Time of last refill; 0 before first */
+    size_t sleeps;           /* Count of sleeps */
+    uint64_t sleep_ns;       /* Total time asleep */
+} PACER, *pPACER;
+
+
+/**********************************************************************/
+/* Set rate (chars/s; 0 to disable) and bucket depth (chars; 0 for
+ * default of 10ms at rate, but at least 64 chars)
+ */
+static void
+pacer_init(pPACER pp, double rate, double burst)
+{
+    memset(pp, 0, sizeof *pp);
+    pp->rate = rate > 0.0 ? rate : 0.0;
+    if (burst < 1.0) { burst = rate * 0.01; }
+    if (burst < 64.0) { burst = 64.0; }
+    pp->burst = burst;
+}
+
+
+/**********************************************************************/
+/* Wait until n chars (clamped to bucket depth) may be written
+ * Return value:  count of chars that may be written
+ */
+static size_t
+pacer_wait(pPACER pp, size_t n)
+{
+    uint64_t now;
+    uint64_t deadline;
+    struct timespec ts;
+
+    if (pp->rate <= 0.0) { return n; }
+    if (n > (size_t) pp->burst) { n = (size_t) pp->burst; }
+
+    /* Refill bucket; first call starts with full bucket */
+    now = monotonic_ns();
+    if (!pp->t_ns) { pp->tokens = pp->burst; }
+    else
+    {
+        pp->tokens += (now - pp->t_ns) * 1e-9 * pp->rate;
+        if (pp->tokens > pp->burst) { pp->tokens = pp->burst; }
+    }
+    pp->t_ns = now;
+    if (pp->tokens >= n) { return n; }
+
+    /* Sleep to absolute time when bucket will hold n chars */
+    deadline = now + (uint64_t) (((n - pp->tokens) / pp->rate) * 1e9);
+    ts.tv_sec = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0))
+    { ; }
+    ++pp->sleeps;
+    pp->sleep_ns += deadline - now;
+    pp->tokens = n;
+    pp->t_ns = deadline;
+    return n;
+}
+
+
+/**********************************************************************/
+/* Remove n chars written from bucket */
+static void
+pacer_spend(pPACER pp, size_t n)
+{
+    pp->tokens -= n;
+}
+
+#endif/*__PACER_H__*/
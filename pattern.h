@@ -0,0 +1,579 @@
+#ifndef __PATTERN_H__
+#define __PATTERN_H__
+
+/**********************************************************************/
+/*** PRBS and fixed stress patterns, generated a word at a time,    ***/
+/*** with a self-synchronizing bit-error-rate (BER) checker         ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * PAT_...                     - Pattern kinds, sync and lock limits
+ * pat_info[]                  - Names, polynomials of pattern kinds
+ * pat_lookup(...)             - Find pattern kind by name
+ * pat_period(...)             - Bytes after which pattern repeats
+ * pat_le64(...)               - Little-endian word from/to host order
+ * typedef ... *pPATGEN        - Struct with generator state
+ * pat_init(...)               - Set up generator at start of pattern
+ * pat_next(...)               - Next 64 bits of pattern
+ * pat_fill(...)               - Fill buffer with next bytes of pattern
+ * pat_rate(...)               - Measure generator throughput, MB/s
+ * typedef ... *pBERCOUNTS     - Struct with checker results
+ * typedef ... *pBERRX         - Struct with checker state
+ * ber_rx_init(...)            - Set up checker
+ * ber_sync(...)               - Try to lock onto pattern
+ * ber_word(...)               - Check one received word
+ * ber_rx_feed(...)            - Check received data
+ * ber_rx_finish(...)          - Check any partial word left
+ * ber_print(...)              - Summarize bit errors and BER
+ *
+ * Patterns
+ * ========
+ *   name    polynomial (ITU-T O.150)   period      inverted
+ *   prbs7   x^7 + x^6 + 1              2^7-1 bits  no
+ *   prbs15  x^15 + x^14 + 1            2^15-1      yes
+ *   prbs23  x^23 + x^18 + 1            2^23-1      yes
+ *   prbs31  x^31 + x^28 + 1            2^31-1      yes
+ *   alt     0x55, 0xAA, ...            2 bytes
+ *   runs    16 x 0x00, 16 x 0xFF       32 bytes
+ *   bytes   0x00, 0x01, ..., 0xFF      256 bytes
+ * PRBS bits are packed least-significant bit first, the order a UART
+ * sends them, so the bits on the wire (between start and stop bits)
+ * are the O.150 sequence.  Unlike the sawtooth lines of sst.h, these
+ * include every control character and long runs of identical bits.
+ *
+ * Word at a time
+ * ==============
+ * A PRBS with polynomial x^n + x^m + 1 satisfies b[k] = b[k-n] ^ b[k-m];
+ * squaring the polynomial j times gives b[k] = b[k-2^j n] ^ b[k-2^j m].
+ * With j chosen so 2^j m >= 64, all 64 bits of the next word depend only
+ * on the two words before it, so each word is two funnel shifts and an
+ * XOR:  several GB/s on one core.
+ *
+ * Checker
+ * =======
+ * The checker needs no seed or start marker.  Hunting, it loads the
+ * generator from PAT_SYNC received bytes (PRBS:  the first 16 bytes
+ * are the generator state; fixed:  find their phase in the period), and
+ * locks if the next 8 bytes match what the generator predicts; if not,
+ * it drops a byte and tries again.  Locked, it compares each received
+ * word with the generator and counts differing bits; if half the words
+ * in a block of PAT_BLOCK words have errors (out of step data has
+ * errors in nearly every word; even at a BER of 1e-3, only 6% of words
+ * do), lock is lost (e.g. a dropped byte), and it hunts again; that
+ * block, and any run of bad words leading into it, count as hunted
+ * bytes, not bit errors, so a lost byte costs one lock loss, not
+ * hundreds of bit errors.  BER is
+ * bit errors over bits compared while locked.  The runs are shorter
+ * than PAT_SYNC, so every sync window holds a transition to fix phase.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+
+#define PAT_SAWTOOTH 0         /* Not a pattern:  lines of sst.h */
+#define PAT_PRBS7 1
+#define PAT_PRBS15 2
+#define PAT_PRBS23 3
+#define PAT_PRBS31 4
+#define PAT_ALT 5
+#define PAT_RUNS 6
+#define PAT_BYTES 7
+#define PAT_NKINDS 8
+
+#define PAT_SYNC 24            /* Bytes to lock:  16 to load, 8 to check */
+#define PAT_BLOCK 8            /* Words per loss-of-lock block */
+#define PAT_LOSS (PAT_BLOCK / 2)   /* Words with errors per block to unlock */
+#define PAT_FIXED 256          /* Bytes of fixed pattern table period */
+
+
+/**********************************************************************/
+/* Names, polynomials (x^n + x^m + 1), and O.150 inversion of patterns;
+ * n is 0 for fixed patterns
+ */
+typedef struct PATINFOstr
+{
+    const char* name;
+    int n;
+    int m;
+    int inverted;
+} PATINFO, *pPATINFO;
+
+static const PATINFO pat_info[PAT_NKINDS] =
+{ { "sawtooth", 0, 0, 0 }
+, { "prbs7", 7, 6, 0 }
+, { "prbs15", 15, 14, 1 }
+, { "prbs23", 23, 18, 1 }
+, { "prbs31", 31, 28, 1 }
+, { "alt", 0, 0, 0 }
+, { "runs", 0, 0, 0 }
+, { "bytes", 0, 0, 0 }
+};
+
+
+/**********************************************************************/
+/* Find pattern kind by name
+ * Return value:  PAT_... kind; -1 if not found
+ */
+static int
+pat_lookup(const char* name)
+{
+    int kind;
+    for (kind=0; kind<PAT_NKINDS; ++kind)
+    {
+        if (!strcmp(name, pat_info[kind].name)) { return kind; }
+    }
+    return -1;
+}
+
+
+/**********************************************************************/
+/* Bytes after which pattern kind repeats, from its start:  the fixed
+ * table period, or for PRBS 2^n - 1, as a period of 2^n - 1 bits (odd)
+ * repeats on a byte boundary only after 2^n - 1 bytes
+ * Return value:  period, bytes; 0 for unknown or sawtooth kind
+ */
+static size_t
+pat_period(int kind)
+{
+    if (kind <= PAT_SAWTOOTH || kind >= PAT_NKINDS) { return 0; }
+    if (!pat_info[kind].n) { return PAT_FIXED; }
+    return ((size_t) 1 << pat_info[kind].n) - 1;
+}
+
+
+/**********************************************************************/
+/* Little-endian word from/to host order (same operation both ways) */
+static inline uint64_t
+pat_le64(uint64_t v)
+{
+#   if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(v);
+#   else
+    return v;
+#   endif
+}
+
+
+/**********************************************************************/
+/* Generator state */
+typedef struct PATGENstr
+{
+    int kind;                /* PAT_... */
+    int prbs;                /* Non-zero for PRBS, else fixed */
+    uint64_t w2;             /* PRBS:  word before previous, uninverted */
+    uint64_t w1;             /* PRBS:  previous word, uninverted */
+    int off_n;               /* PRBS:  128 - 2^j n, offset of b[k-2^j n] */
+    int off_m;               /* PRBS:  128 - 2^j m */
+    int primed;              /* PRBS:  count of w2, w1 already returned */
+    uint64_t invert;         /* PRBS:  ~0 if inverted, else 0 */
+    size_t pos;              /* Fixed:  offset in table of next byte */
+    unsigned char table[2 * PAT_FIXED];   /* Fixed:  two periods */
+} PATGEN, *pPATGEN;
+
+
+/**********************************************************************/
+/* Set up generator for pattern kind, at start of pattern:  PRBS from
+ * all-ones state, fixed from offset 0
+ * Return value:  0 on success; -1 for unknown or sawtooth kind
+ */
+static int
+pat_init(pPATGEN pg, int kind)
+{
+    const PATINFO* pi;
+    int lag_n;
+    int lag_m;
+    int k;
+
+    if (kind <= PAT_SAWTOOTH || kind >= PAT_NKINDS) { return -1; }
+    memset(pg, 0, sizeof *pg);
+    pg->kind = kind;
+    pi = pat_info + kind;
+
+    if (pi->n)
+    {
+        /* Square polynomial until every lag is a word or more */
+        for (lag_n=pi->n, lag_m=pi->m; lag_m < 64; lag_n*=2, lag_m*=2) ;
+        pg->prbs = 1;
+        pg->off_n = 128 - lag_n;
+        pg->off_m = 128 - lag_m;
+        pg->invert = pi->inverted ? ~(uint64_t)0 : 0;
+
+        /* First 128 bits, a bit at a time:  n ones, then recurrence */
+        for (k=0; k<128; ++k)
+        {
+            uint64_t b = 1;
+            if (k >= pi->n)
+            {
+                int kn = k - pi->n;
+                int km = k - pi->m;
+                b = ((kn < 64 ? pg->w2 >> kn : pg->w1 >> (kn-64))
+                   ^ (km < 64 ? pg->w2 >> km : pg->w1 >> (km-64))) & 1;
+            }
+            if (k < 64) { pg->w2 |= b << k; }
+            else        { pg->w1 |= b << (k-64); }
+        }
+        return 0;
+    }
+
+    for (k=0; k<2*PAT_FIXED; ++k)
+    {
+        int i = k % PAT_FIXED;
+        pg->table[k] = PAT_ALT==kind  ? ((i & 1) ? 0xAA : 0x55)
+                     : PAT_RUNS==kind ? ((i & 16) ? 0xFF : 0x00)
+                     :                  (unsigned char) i;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Next 64 bits of pattern, in host order, first byte in low bits */
+static inline uint64_t
+pat_next(pPATGEN pg)
+{
+    uint64_t x;
+
+    if (pg->prbs)
+    {
+        /* PRBS:  w2, w1 of pat_init(...) first; then from them */
+        if (pg->primed < 2)
+        {
+            return (pg->primed++ ? pg->w1 : pg->w2) ^ pg->invert;
+        }
+        x = (pg->off_n ? (pg->w2 >> pg->off_n)
+                       | (pg->w1 << (64 - pg->off_n)) : pg->w2)
+          ^ (pg->off_m ? (pg->w2 >> pg->off_m)
+                       | (pg->w1 << (64 - pg->off_m)) : pg->w2);
+        pg->w2 = pg->w1;
+        pg->w1 = x;
+        return x ^ pg->invert;
+    }
+
+    memcpy(&x, pg->table + pg->pos, 8);
+    pg->pos = (pg->pos + 8) % PAT_FIXED;
+    return pat_le64(x);
+}
+
+
+/**********************************************************************/
+/* Fill len bytes at buf with next bytes of pattern; len must be a
+ * multiple of 8 for the pattern to continue in the next call
+ */
+static void
+pat_fill(pPATGEN pg, char* buf, size_t len)
+{
+    uint64_t x;
+    for (; len >= 8; buf+=8, len-=8)
+    {
+        x = pat_le64(pat_next(pg));
+        memcpy(buf, &x, 8);
+    }
+    if (len)
+    {
+        x = pat_le64(pat_next(pg));
+        memcpy(buf, &x, len);
+    }
+}
+
+
+/**********************************************************************/
+/* Measure throughput of pat_fill(...) over len bytes, MB/s; 0 on
+ * failure
+ */
+static double
+pat_rate(int kind, size_t len)
+{
+    char* buf = malloc(len);
+    PATGEN gen;
+    uint64_t t0;
+    uint64_t dt;
+
+    if (!buf || pat_init(&gen, kind)) { free(buf); return 0.0; }
+    t0 = monotonic_ns();
+    pat_fill(&gen, buf, len);
+    dt = monotonic_ns() - t0;
+    free(buf);
+    return dt ? (len * 1e3) / dt : 0.0;
+}
+
+
+/**********************************************************************/
+/* Checker results; also passed from forked reader via pipe */
+typedef struct BERCOUNTSstr
+{
+    uint64_t bytes;          /* Count of bytes received */
+    uint64_t bits;           /* Count of bits compared while locked */
+    uint64_t bit_errors;     /* Count of those bits in error */
+    uint64_t hunt_bytes;     /* Count of bytes dropped while hunting */
+    size_t locks;            /* Count of times lock was gained */
+    size_t losses;           /* Count of times lock was lost */
+    uint64_t first_error;    /* Received-stream offset of first bad word,
+                              * or (uint64_t)-1 */
+} BERCOUNTS, *pBERCOUNTS;
+
+
+/**********************************************************************/
+/* Checker state */
+typedef struct BERRXstr
+{
+    int kind;                /* PAT_... */
+    PATGEN ref;              /* Generator in step with received data */
+    int locked;              /* Non-zero when locked */
+    size_t block_words;      /* Words compared in current block */
+    size_t block_bits;       /* Bits compared in current block */
+    size_t block_errors;     /* Bit errors in current block */
+    size_t block_bad;        /* Words with errors in current block */
+    size_t tail_bits;        /* Bits of latest run of words with errors */
+    size_t tail_errors;      /* Bit errors in that run */
+    size_t lead_bits;        /* Bits of run ending just before block */
+    size_t lead_errors;      /* Bit errors in that run */
+    size_t lacc;             /* Count of bytes in acc[] */
+    unsigned char acc[PAT_SYNC];
+    BERCOUNTS counts;
+} BERRX, *pBERRX;
+
+
+/**********************************************************************/
+/* Set up checker for pattern kind
+ * Return value:  0 on success; -1 for unknown or sawtooth kind
+ */
+static int
+ber_rx_init(pBERRX pbr, int kind)
+{
+    memset(pbr, 0, sizeof *pbr);
+    pbr->kind = kind;
+    pbr->counts.first_error = (uint64_t) -1;
+    return pat_init(&pbr->ref, kind);
+}
+
+
+/**********************************************************************/
+/* Try to lock onto pattern from PAT_SYNC bytes in acc[]:  load the
+ * generator from the first 16 bytes, and check it predicts the last 8
+ * Return value:  non-zero if locked
+ */
+static int
+ber_sync(pBERRX pbr)
+{
+    pPATGEN pg = &pbr->ref;
+    uint64_t x;
+
+    memcpy(&x, pbr->acc + 16, 8);
+    x = pat_le64(x);
+
+    if (pg->prbs)
+    {
+        uint64_t w2;
+        uint64_t w1;
+        memcpy(&w2, pbr->acc, 8);
+        memcpy(&w1, pbr->acc + 8, 8);
+        w2 = pat_le64(w2) ^ pg->invert;
+        w1 = pat_le64(w1) ^ pg->invert;
+        if (!w2 && !w1) { return 0; }        /* Not a valid PRBS state */
+        pg->w2 = w2;
+        pg->w1 = w1;
+        pg->primed = 2;
+        return x == pat_next(pg);
+    }
+    else
+    {
+        size_t p;
+        for (p=0; p<PAT_FIXED; ++p)
+        {
+            if (!memcmp(pbr->acc, pg->table + p, 16))
+            {
+                pg->pos = (p + 16) % PAT_FIXED;
+                if (x == pat_next(pg)) { return 1; }
+            }
+        }
+        return 0;
+    }
+}
+
+
+/**********************************************************************/
+/* Check one received word (host order) of len bytes, 1 to 8, against
+ * the generator; lose lock when half the words of a block have errors
+ */
+static inline void
+ber_word(pBERRX pbr, uint64_t x, size_t len)
+{
+    uint64_t diff = x ^ pat_next(&pbr->ref);
+    int errs;
+
+    if (len < 8) { diff &= ((uint64_t)1 << (8 * len)) - 1; }
+    errs = __builtin_popcountll(diff);
+    pbr->counts.bits += 8 * len;
+    pbr->counts.bytes += len;
+    pbr->block_bits += 8 * len;
+    if (errs)
+    {
+        if ((uint64_t) -1 == pbr->counts.first_error)
+        {
+            pbr->counts.first_error = pbr->counts.bytes - len;
+        }
+        pbr->counts.bit_errors += errs;
+        pbr->block_errors += errs;
+        ++pbr->block_bad;
+        pbr->tail_bits += 8 * len;
+        pbr->tail_errors += errs;
+    }
+    else
+    {
+        pbr->tail_bits = 0;
+        pbr->tail_errors = 0;
+    }
+    if (++pbr->block_words < PAT_BLOCK) { return; }
+
+    if (pbr->block_bad >= PAT_LOSS)
+    {
+        /* Out of step, not bit errors:  count block, and run of bad
+         * words leading into it, as hunted
+         */
+        size_t lbits = pbr->block_bits + pbr->lead_bits;
+        ++pbr->counts.losses;
+        pbr->counts.bits -= lbits;
+        pbr->counts.bit_errors -= pbr->block_errors + pbr->lead_errors;
+        pbr->counts.hunt_bytes += lbits / 8;
+        pbr->locked = 0;
+        pbr->tail_bits = 0;
+        pbr->tail_errors = 0;
+    }
+    pbr->block_words = 0;
+    pbr->block_bits = 0;
+    pbr->block_errors = 0;
+    pbr->block_bad = 0;
+    pbr->lead_bits = pbr->tail_bits;
+    pbr->lead_errors = pbr->tail_errors;
+}
+
+
+/**********************************************************************/
+/* Check len bytes of received data:  hunt for lock a byte at a time,
+ * then compare a word at a time
+ */
+static void
+ber_rx_feed(pBERRX pbr, const char* data, size_t len)
+{
+    uint64_t x;
+
+    while (len > 0)
+    {
+        if (!pbr->locked)
+        {
+            /* Hunting:  collect PAT_SYNC bytes, try to lock, else drop
+             * the oldest byte
+             */
+            size_t n = PAT_SYNC - pbr->lacc;
+            if (n > len) { n = len; }
+            memcpy(pbr->acc + pbr->lacc, data, n);
+            pbr->lacc += n;
+            data += n;
+            len -= n;
+            if (pbr->lacc < PAT_SYNC) { return; }
+            if (ber_sync(pbr))
+            {
+                pbr->locked = 1;
+                ++pbr->counts.locks;
+                pbr->counts.bytes += PAT_SYNC;
+                pbr->counts.bits += 8 * PAT_SYNC;
+                pbr->block_words = 0;
+                pbr->block_bits = 0;
+                pbr->block_errors = 0;
+                pbr->block_bad = 0;
+                pbr->lead_bits = 0;
+                pbr->lead_errors = 0;
+                pbr->lacc = 0;
+                continue;
+            }
+            ++pbr->counts.hunt_bytes;
+            ++pbr->counts.bytes;
+            memmove(pbr->acc, pbr->acc + 1, --pbr->lacc);
+            continue;
+        }
+
+        /* Locked:  complete any partial word, then whole words */
+        if (pbr->lacc)
+        {
+            size_t n = 8 - pbr->lacc;
+            if (n > len) { n = len; }
+            memcpy(pbr->acc + pbr->lacc, data, n);
+            pbr->lacc += n;
+            data += n;
+            len -= n;
+            if (pbr->lacc < 8) { return; }
+            memcpy(&x, pbr->acc, 8);
+            pbr->lacc = 0;
+            ber_word(pbr, pat_le64(x), 8);
+            continue;
+        }
+        while (len >= 8 && pbr->locked)
+        {
+            memcpy(&x, data, 8);
+            data += 8;
+            len -= 8;
+            ber_word(pbr, pat_le64(x), 8);
+        }
+        if (pbr->locked && len)
+        {
+            memcpy(pbr->acc, data, len);
+            pbr->lacc = len;
+            return;
+        }
+    }
+}
+
+
+/**********************************************************************/
+/* Check any partial word left; bytes of an unfinished hunt count as
+ * hunted
+ */
+static void
+ber_rx_finish(pBERRX pbr)
+{
+    if (pbr->locked && pbr->lacc)
+    {
+        uint64_t x = 0;
+        memcpy(&x, pbr->acc, pbr->lacc);
+        ber_word(pbr, pat_le64(x), pbr->lacc);
+    }
+    else if (!pbr->locked)
+    {
+        pbr->counts.hunt_bytes += pbr->lacc;
+        pbr->counts.bytes += pbr->lacc;
+    }
+    pbr->lacc = 0;
+}
+
+
+/**********************************************************************/
+/* Summarize bit errors and BER; sent is the count of bytes sent */
+static void
+ber_print(FILE* f, int kind, pBERCOUNTS pc, size_t sent)
+{
+    if (!f) { return; }
+    fprintf(f, "BER [%s]:  sent=%lu; received=%lu; bits=%lu"
+               "; bit-errors=%lu; BER=%.3e; hunt-bytes=%lu"
+               "; locks=%lu; lock-losses=%lu"
+             , pat_info[kind].name
+             , (unsigned long) sent, (unsigned long) pc->bytes
+             , (unsigned long) pc->bits, (unsigned long) pc->bit_errors
+             , pc->bits ? (double) pc->bit_errors / pc->bits : 0.0
+             , (unsigned long) pc->hunt_bytes
+             , (unsigned long) pc->locks, (unsigned long) pc->losses);
+    if ((uint64_t) -1 == pc->first_error)
+    {
+        fprintf(f, "; first-error=none\n");
+    }
+    else
+    {
+        fprintf(f, "; first-error=%lu\n", (unsigned long) pc->first_error);
+    }
+}
+
+#endif/*__PATTERN_H__*/
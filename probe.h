@@ -0,0 +1,189 @@
+#ifndef __PROBE_H__
+#define __PROBE_H__
+
+/**********************************************************************/
+/*** Timestamped latency probe frames, embedded in the test stream  ***/
+/*** with bytes the test stream never uses, and stripped on receipt ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * PROBE_...                   - Probe frame bytes and length
+ * probe_encode(...)           - Build probe frame with a timestamp
+ * typedef ... *pPROBERX       - Struct with receiver state and latencies
+ * probe_rx_init(...)          - Clear receiver
+ * probe_strip(...)            - Remove probe bytes from data, time probes
+ * probe_print(...)            - Summarize probe counts and latencies
+ *
+ * Frame
+ * =====
+ * A probe is PROBE_LEN bytes:  a start byte, then the 64-bit
+ * CLOCK_MONOTONIC send time in ns as 16 nibbles, most significant
+ * first, each sent as PROBE_NIBBLE+nibble, then PROBE_END.
+ *
+ * - Start byte is PROBE_IDLE for probes sent on an otherwise idle
+ *   line, or PROBE_LOAD for probes sent between writes of the test
+ *   stream, so the receiver keeps separate latency histograms
+ * - None of these bytes (0x1D-0x1F, 0x81-0x90) occur in the test
+ *   stream (cf. to_send[] in sst.h), and none are special to a TTY in
+ *   raw mode, so the receiver can remove every probe byte wherever it
+ *   falls in a read, and verify what remains as if no probes were sent
+ * - The writer and forked reader share CLOCK_MONOTONIC, so the
+ *   difference between the send time in a probe and the time the read
+ *   that completed it returned is the one-way latency through the
+ *   writer's TX queue, the UART FIFOs, the loopback, and the reader's
+ *   RX queue
+ * - A frame that is incomplete, or has a byte in error, is counted as
+ *   malformed and not timed
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define PROBE_IDLE 0x1D        /* Start of probe on idle line */
+#define PROBE_LOAD 0x1E        /* Start of probe within test stream */
+#define PROBE_END 0x1F         /* End of probe */
+#define PROBE_NIBBLE 0x81      /* Nibbles are 0x81 to 0x90 */
+#define PROBE_NIBBLES 16
+#define PROBE_LEN (PROBE_NIBBLES + 2)
+
+
+/**********************************************************************/
+/* Build probe frame of PROBE_LEN bytes with send time t_ns */
+static void
+probe_encode(char* frame, int idle, uint64_t t_ns)
+{
+    int i;
+    frame[0] = idle ? PROBE_IDLE : PROBE_LOAD;
+    for (i=PROBE_NIBBLES; i>0; --i, t_ns >>= 4)
+    {
+        frame[i] = (char) (PROBE_NIBBLE + (t_ns & 15));
+    }
+    frame[PROBE_LEN-1] = PROBE_END;
+}
+
+
+/**********************************************************************/
+/* Probe receiver state and latencies */
+typedef struct PROBERXstr
+{
+    int start;               /* Start byte of frame in progress, or 0 */
+    int nibbles;             /* Count of nibbles received in frame */
+    uint64_t t_ns;           /* Send time, so far, of frame */
+    size_t idle;             /* Count of idle-line probes timed */
+    size_t load;             /* Count of in-stream probes timed */
+    size_t malformed;        /* Count of incomplete or bad frames */
+    size_t bytes;            /* Count of probe bytes removed */
+    HISTOGRAM idle_ns;       /* Latency of idle-line probes */
+    HISTOGRAM load_ns;       /* Latency of in-stream probes */
+} PROBERX, *pPROBERX;
+
+
+/**********************************************************************/
+/* Clear receiver */
+static void
+probe_rx_init(pPROBERX prx)
+{
+    memset(prx, 0, sizeof *prx);
+    hist_init(&prx->idle_ns);
+    hist_init(&prx->load_ns);
+}
+
+
+/**********************************************************************/
+/* Remove probe bytes from len bytes at data, time any probes completed
+ * by them as received at t_rx_ns
+ * Return value:  count of bytes remaining, moved to start of data
+ */
+static size_t
+probe_strip(pPROBERX prx, char* data, size_t len, uint64_t t_rx_ns)
+{
+    unsigned char* src = (unsigned char*) data;
+    unsigned char* end = src + len;
+    char* dst = data;
+    unsigned char c;
+
+    for (; src < end; ++src)
+    {
+        c = *src;
+        if (PROBE_IDLE==c || PROBE_LOAD==c)
+        {
+            if (prx->start) { ++prx->malformed; }
+            prx->start = c;
+            prx->nibbles = 0;
+            prx->t_ns = 0;
+        }
+        else if (c >= PROBE_NIBBLE && c < (PROBE_NIBBLE + 16))
+        {
+            if (prx->start && prx->nibbles < PROBE_NIBBLES)
+            {
+                prx->t_ns = (prx->t_ns << 4) | (c - PROBE_NIBBLE);
+                ++prx->nibbles;
+            }
+            else if (prx->start)
+            {
+                /* Too many nibbles:  drop frame */
+                ++prx->malformed;
+                prx->start = 0;
+            }
+        }
+        else if (PROBE_END==c)
+        {
+            if (prx->start && PROBE_NIBBLES==prx->nibbles
+             && t_rx_ns >= prx->t_ns)
+            {
+                if (PROBE_IDLE==prx->start)
+                {
+                    ++prx->idle;
+                    hist_record(&prx->idle_ns, t_rx_ns - prx->t_ns);
+                }
+                else
+                {
+                    ++prx->load;
+                    hist_record(&prx->load_ns, t_rx_ns - prx->t_ns);
+                }
+            }
+            else
+            {
+                ++prx->malformed;
+            }
+            prx->start = 0;
+        }
+        else
+        {
+            *(dst++) = (char) c;
+            continue;
+        }
+        ++prx->bytes;
+    }
+    return dst - data;
+}
+
+
+/**********************************************************************/
+/* Summarize probe counts and latencies */
+static void
+probe_print(FILE* f, pPROBERX prx, size_t sent_idle, size_t sent_load)
+{
+    if (!f) { return; }
+    fprintf(f, "Probes:  idle sent=%lu, timed=%lu"
+               "; in-stream sent=%lu, timed=%lu; malformed=%lu\n"
+             , (unsigned long) sent_idle, (unsigned long) prx->idle
+             , (unsigned long) sent_load, (unsigned long) prx->load
+             , (unsigned long) (prx->malformed + (prx->start ? 1 : 0)));
+    if (sent_idle)
+    {
+        hist_print(f, "Probe latency, idle line", &prx->idle_ns
+                  , 1e3, "us");
+    }
+    if (sent_load)
+    {
+        hist_print(f, "Probe latency, in stream", &prx->load_ns
+                  , 1e3, "us");
+    }
+}
+
+#endif/*__PROBE_H__*/
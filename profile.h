@@ -0,0 +1,506 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+/**********************************************************************/
+/*** Precompiled termios2 profiles:  raw settings, speed and        ***/
+/*** framing in one binary image, applied with one ioctl; original  ***/
+/*** settings restored on exit or on SIGINT/SIGTERM                 ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pPROFILE       - Struct with header and termios2 image
+ * typedef ... *pRAWMASKS      - Struct with raw_settings[] as masks
+ * profile_parse(...)          - Apply settings text to struct termios
+ * profile_raw_masks()         - Compile raw_settings[] once, to masks
+ * profile_get(...)            - Image of a TTY's current settings
+ * profile_get_name(...)       - Same, by TTY name
+ * profile_make_raw(...)       - Apply raw settings masks to image
+ * profile_set_speed(...)      - Set speed in image
+ * profile_set_framing(...)    - Set data bits, parity, stop bits
+ * profile_apply(...)          - Apply image to TTY fd, one ioctl
+ * profile_apply_name(...)     - Same, by TTY name
+ * profile_configure_fd(...)   - Build and apply profile to open TTY
+ * profile_save(...)           - Write image to file
+ * profile_load(...)           - Read image from file
+ * profile_restore(...)        - Restore TTY settings saved at start
+ * profile_on_signal(...)      - SIGINT/SIGTERM:  restore, then die
+ * profile_on_exit()           - atexit(...):  restore
+ * profile_keep_original(...)  - Save TTY settings, restore at the end
+ *
+ * Why
+ * ===
+ * stty_raw_config(...) parses raw_settings[] with sscanf, and searches
+ * mode_info[] and control_info[] linearly, on every call; then
+ * stty_set_speed(...) opens the TTY again and sets it again, which
+ * flushes its queues a second time.  Here raw_settings[] is parsed
+ * once per process into set and clear masks per flag word (every raw
+ * setting only sets or clears bits, so x -> (x & keep) | set captures
+ * all of them), and raw settings, speed and framing are combined into
+ * one termios2 image that one TCSETSF2 (or TCSETS2) applies.
+ *
+ * Files
+ * =====
+ * A saved profile is the PROFILE struct below:  magic "SSTP", the size
+ * of struct termios2, then the image, in host byte order; it is for
+ * the same kind of host, and is refused if the header does not match.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+/* raw_settings[], stty_process_token(...), speeds[], etc. */
+#include "raw_settings.h"
+
+#define PROFILE_MAGIC 0x50545353U   /* Bytes "SSTP" */
+
+
+/**********************************************************************/
+/* Header and termios2 image */
+typedef struct PROFILEstr
+{
+    uint32_t magic;          /* PROFILE_MAGIC */
+    uint32_t size;           /* sizeof(struct termios2) */
+    struct termios2 t;
+} PROFILE, *pPROFILE;
+
+
+/**********************************************************************/
+/* raw_settings[] as masks:  flag = (flag & keep) | set, per flag word;
+ * c_cc[i] = _POSIX_VDISABLE where disable[i] is non-zero
+ */
+typedef struct RAWMASKSstr
+{
+    tcflag_t keep[4];        /* c_iflag, c_oflag, c_cflag, c_lflag */
+    tcflag_t set[4];
+    unsigned char disable[NCCS];
+    int compiled;            /* Non-zero once compiled */
+} RAWMASKS, *pRAWMASKS;
+
+static RAWMASKS profile_masks;
+
+
+/**********************************************************************/
+/* Apply a settings text (e.g. raw_settings[]) to struct termios, as
+ * stty_raw_config(...) does, without a TTY
+ */
+static void
+profile_parse(char* parser, struct termios* pt)
+{
+    char tok0[21];
+    while (*parser)
+    {
+        while (*parser && isspace(*parser)) { ++parser; }
+        if (!*parser) { break; }
+        *tok0 = '\0';
+        if (1==sscanf(parser, "%20s", tok0))
+        {
+            parser += stty_process_token(tok0, parser, pt);
+        }
+        while (*parser && '\n'!=*parser) { ++parser; }
+    }
+}
+
+
+/**********************************************************************/
+/* Compile raw_settings[] to masks, once per process:  the settings
+ * applied to all-zero flags give the bits set, and applied to all-one
+ * flags give the bits kept
+ */
+static pRAWMASKS
+profile_raw_masks()
+{
+    struct termios zeros;
+    struct termios ones;
+    int i;
+
+    if (profile_masks.compiled) { return &profile_masks; }
+    memset(&zeros, 0, sizeof zeros);
+    memset(&ones, 0xFF, sizeof ones);
+    profile_parse((char*) raw_settings, &zeros);
+    profile_parse((char*) raw_settings, &ones);
+
+    profile_masks.set[0] = zeros.c_iflag;
+    profile_masks.set[1] = zeros.c_oflag;
+    profile_masks.set[2] = zeros.c_cflag;
+    profile_masks.set[3] = zeros.c_lflag;
+    profile_masks.keep[0] = ones.c_iflag;
+    profile_masks.keep[1] = ones.c_oflag;
+    profile_masks.keep[2] = ones.c_cflag;
+    profile_masks.keep[3] = ones.c_lflag;
+    for (i=0; i<NCCS; ++i)
+    {
+        profile_masks.disable[i] = (_POSIX_VDISABLE == ones.c_cc[i]);
+    }
+    profile_masks.compiled = 1;
+    return &profile_masks;
+}
+
+
+/**********************************************************************/
+/* Image of current settings of TTY fd
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_get(int fd, pPROFILE pprof)
+{
+    memset(pprof, 0, sizeof *pprof);
+    pprof->magic = PROFILE_MAGIC;
+    pprof->size = sizeof pprof->t;
+    return ioctl(fd, TCGETS2, &pprof->t) ? -1 : 0;
+}
+
+
+/**********************************************************************/
+/* Image of current settings of TTY by name
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_get_name(char* tty_name, pPROFILE pprof)
+{
+    int fd;
+    int rtn;
+
+    if (!tty_name) { return -1; }
+    if (0 > (fd = open(tty_name, O_RDONLY | O_NONBLOCK | O_NOCTTY)))
+    {
+        errno = 0;
+        return -1;
+    }
+    rtn = profile_get(fd, pprof);
+    close(fd);
+    errno = 0;
+    return rtn;
+}
+
+
+/**********************************************************************/
+/* Apply raw settings masks to image */
+static void
+profile_make_raw(pPROFILE pprof)
+{
+    pRAWMASKS pm = profile_raw_masks();
+    int i;
+
+    pprof->t.c_iflag = (pprof->t.c_iflag & pm->keep[0]) | pm->set[0];
+    pprof->t.c_oflag = (pprof->t.c_oflag & pm->keep[1]) | pm->set[1];
+    pprof->t.c_cflag = (pprof->t.c_cflag & pm->keep[2]) | pm->set[2];
+    pprof->t.c_lflag = (pprof->t.c_lflag & pm->keep[3]) | pm->set[3];
+    for (i=0; i<NCCS; ++i)
+    {
+        if (pm->disable[i]) { pprof->t.c_cc[i] = _POSIX_VDISABLE; }
+    }
+}
+
+
+/**********************************************************************/
+/* Set speed in image, from a speeds[] name (e.g. 4000000) or any other
+ * numeric rate (e.g. 6.25M, with BOTHER)
+ * Return value:  0 on success; -1 if speed_token is not a speed
+ */
+static int
+profile_set_speed(pPROFILE pprof, char* speed_token)
+{
+    struct speed_map* pspeed = find_name_in_speeds(speed_token);
+    unsigned long value;
+
+    pprof->t.c_cflag &= ~CBAUD;
+    if (pspeed)
+    {
+        pprof->t.c_cflag |= pspeed->speed;
+        pprof->t.c_ispeed = pprof->t.c_ospeed = pspeed->value;
+        return 0;
+    }
+    if (!(value = parse_speed_value(speed_token))) { return -1; }
+    pprof->t.c_cflag |= BOTHER;
+    pprof->t.c_ispeed = pprof->t.c_ospeed = value;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Set framing in image, e.g. 8N1, 7E1, 8O2:  data bits 5-8, parity
+ * N(one), E(ven), O(dd), M(ark) or S(pace), stop bits 1 or 2
+ * Return value:  0 on success; -1 if framing is not understood
+ */
+static int
+profile_set_framing(pPROFILE pprof, const char* framing)
+{
+    static const tcflag_t sizes[4] = { CS5, CS6, CS7, CS8 };
+    tcflag_t c = pprof->t.c_cflag;
+
+    if (!framing || 3 != strlen(framing)
+     || framing[0] < '5' || framing[0] > '8'
+     || !strchr("NEOMS", framing[1])
+     || ('1' != framing[2] && '2' != framing[2])
+       )
+    {
+        return -1;
+    }
+    c &= ~(CSIZE | PARENB | PARODD | CMSPAR | CSTOPB);
+    c |= sizes[framing[0] - '5'];
+    switch (framing[1])
+    {
+    case 'E': c |= PARENB; break;
+    case 'O': c |= PARENB | PARODD; break;
+    case 'M': c |= PARENB | PARODD | CMSPAR; break;
+    case 'S': c |= PARENB | CMSPAR; break;
+    default:  break;
+    }
+    if ('2' == framing[2]) { c |= CSTOPB; }
+    pprof->t.c_cflag = c;
+
+    /* Check parity on input only if the line has parity */
+    if ('N' == framing[1]) { pprof->t.c_iflag &= ~INPCK; }
+    else                   { pprof->t.c_iflag |= INPCK; }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Apply image to TTY fd with one ioctl:  TCSETSF2, which first drains
+ * output and discards input, if flush is non-zero, else TCSETS2
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_apply(int fd, pPROFILE pprof, int flush)
+{
+    return ioctl(fd, flush ? TCSETSF2 : TCSETS2, &pprof->t) ? -1 : 0;
+}
+
+
+/**********************************************************************/
+/* Apply image to TTY by name, with one open and one ioctl
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_apply_name(char* tty_name, pPROFILE pprof, int flush)
+{
+    int fd;
+    int rtn;
+
+    if (!tty_name) { return -1; }
+    if (0 > (fd = open(tty_name, O_RDONLY | O_NONBLOCK | O_NOCTTY)))
+    {
+        return -1;
+    }
+    rtn = profile_apply(fd, pprof, flush);
+    close(fd);
+    return rtn;
+}
+
+
+/**********************************************************************/
+/* Apply a profile to open TTY fd:  loaded image ploaded if not NULL,
+ * else current settings with raw settings if do_raw, speed if
+ * speed_token is not NULL, and framing if not NULL; the image applied
+ * is returned in *pprof if pprof is not NULL; tty_name is for messages
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_configure_fd(int fd, char* tty_name, pPROFILE ploaded, int do_raw
+                    , char* speed_token, char* framing, pPROFILE pprof)
+{
+    PROFILE prof;
+
+    if (ploaded)
+    {
+        prof = *ploaded;
+    }
+    else if (profile_get(fd, &prof))
+    {
+        fprintf(stderr, "ERROR:  getting termios2 attributes; ");
+        perror(tty_name);
+        errno = 0;
+        return -1;
+    }
+    else
+    {
+        if (do_raw) { profile_make_raw(&prof); }
+        if (speed_token && profile_set_speed(&prof, speed_token))
+        {
+            fprintf(stderr, "ERROR:  unknown speed [%s]\n", speed_token);
+            return -1;
+        }
+        if (framing && profile_set_framing(&prof, framing))
+        {
+            fprintf(stderr, "ERROR:  unknown framing [%s]\n", framing);
+            return -1;
+        }
+    }
+    if (profile_apply(fd, &prof, 1))
+    {
+        fprintf(stderr, "ERROR:  setting termios2 attributes; ");
+        perror(tty_name);
+        errno = 0;
+        return -1;
+    }
+    if (pprof) { *pprof = prof; }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Write image to file
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_save(const char* path, pPROFILE pprof)
+{
+    FILE* f = fopen(path, "wb");
+    int rtn;
+
+    if (!f) { perror(path); return -1; }
+    rtn = (1 == fwrite(pprof, sizeof *pprof, 1, f)) ? 0 : -1;
+    if (fclose(f)) { rtn = -1; }
+    if (rtn) { perror(path); }
+    return rtn;
+}
+
+
+/**********************************************************************/
+/* Read image from file, and check its header
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_load(const char* path, pPROFILE pprof)
+{
+    FILE* f = fopen(path, "rb");
+    size_t n;
+
+    if (!f) { perror(path); return -1; }
+    n = fread(pprof, sizeof *pprof, 1, f);
+    fclose(f);
+    if (1 != n || PROFILE_MAGIC != pprof->magic
+     || sizeof pprof->t != pprof->size)
+    {
+        fprintf(stderr, "ERROR:  [%s] is not a profile saved on this"
+                        " kind of host\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* TTY settings saved at start, to restore at the end, one per TTY
+ * (e.g. every port of multiport.h), on a dup of the caller's fd (or,
+ * without one, on the TTY opened again by name)
+ */
+#define PROFILE_KEEP_MAX 128
+static PROFILE profile_original[PROFILE_KEEP_MAX];
+static char* profile_original_name[PROFILE_KEEP_MAX];
+static int profile_original_fd[PROFILE_KEEP_MAX];
+static int profile_original_count = 0;
+static pid_t profile_original_owner = 0;
+
+
+/**********************************************************************/
+/* Restore TTY settings saved at start, once, and only in the process
+ * that saved them (not e.g. in a forked reader); uses only
+ * async-signal-safe calls
+ */
+static void
+profile_restore()
+{
+    int fd;
+    int i;
+    if (getpid() != profile_original_owner) { return; }
+    for (i=0; i<profile_original_count; ++i)
+    {
+        if (0 <= profile_original_fd[i])
+        {
+            profile_apply(profile_original_fd[i], profile_original + i, 0);
+        }
+        else if (0 <= (fd = open(profile_original_name[i]
+                                , O_RDONLY | O_NONBLOCK | O_NOCTTY)))
+        {
+            profile_apply(fd, profile_original + i, 0);
+            close(fd);
+        }
+    }
+    profile_original_count = 0;
+}
+
+
+/**********************************************************************/
+/* SIGINT/SIGTERM:  restore, then die of the same signal */
+static void
+profile_on_signal(int sig)
+{
+    int save_errno = errno;
+    profile_restore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+    errno = save_errno;
+}
+
+
+/**********************************************************************/
+/* atexit(...):  restore */
+static void
+profile_on_exit()
+{
+    profile_restore();
+}
+
+
+/**********************************************************************/
+/* Save TTY settings, from open fd if fd is not negative, else from the
+ * TTY opened by name, to restore on exit, SIGINT or SIGTERM; a TTY
+ * already saved keeps its first settings
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+profile_keep_original(char* tty_name, int fd)
+{
+    int fdget = fd;
+    int n = profile_original_count;
+    int i;
+    struct sigaction sa;
+
+    for (i=0; i<n; ++i)
+    {
+        if (!strcmp(tty_name, profile_original_name[i])) { return 0; }
+    }
+    if (n >= PROFILE_KEEP_MAX) { errno = ENOSPC; return -1; }
+    if (0 > fdget
+     && 0 > (fdget = open(tty_name, O_RDONLY | O_NONBLOCK | O_NOCTTY)))
+    {
+        return -1;
+    }
+    if (profile_get(fdget, profile_original + n))
+    {
+        if (fdget != fd) { close(fdget); }
+        errno = 0;
+        return -1;
+    }
+    if (fdget != fd) { close(fdget); }
+    profile_original_fd[n] = 0 > fd ? -1 : dup(fd);
+    profile_original_name[n] = tty_name;
+
+    /* Handlers once, with the first TTY saved */
+    if (!profile_original_owner)
+    {
+        profile_original_owner = getpid();
+        atexit(profile_on_exit);
+        memset(&sa, 0, sizeof sa);
+        sa.sa_handler = profile_on_signal;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    /* Count it last, so a signal never restores a part-saved TTY */
+    profile_original_count = n + 1;
+    return 0;
+}
+
+#endif/*__PROFILE_H__*/
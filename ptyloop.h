@@ -0,0 +1,499 @@
+#ifndef __PTYLOOP_H__
+#define __PTYLOOP_H__
+
+/**********************************************************************/
+/*** Pseudo-terminal loopback:  a pty whose output is fed back to   ***/
+/*** its input, through an optional line-impairment simulator       ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * pty_open_pair(...)          - Open pty master, configure slave raw
+ * typedef ... *pPTYLOOPSTATS  - Struct with forwarder counts
+ * typedef ... *pPTYLOOP       - Struct with loopback options and state
+ * ptyloop_init(...)           - Set defaults:  no impairment
+ * ptyloop_parse(...)          - Parse pty[,option=value...]
+ * ptyloop_rand(...)           - xorshift64* random numbers
+ * ptyloop_threshold(...)      - Probability as 64-bit threshold
+ * ptyloop_write_all(...)      - Write to master, paced, until stopped
+ * ptyloop_forward(...)        - Forwarder process main loop
+ * ptyloop_start(...)          - Open pty, fork forwarder
+ * ptyloop_stop(...)           - Stop forwarder, report its counts
+ *
+ * Usage
+ * =====
+ * The pty slave (e.g. /dev/pts/3) stands in for a TTY with TX wired
+ * to RX:  a forked forwarder reads what is written to the slave from
+ * the master, and writes it back to the master, so it can be read from
+ * the slave, e.g. by the forked reader (--fork-reader).  The forwarder
+ * keeps the slave open, so the writer and reader may close and reopen
+ * it without hanging up the master.
+ *
+ * Impairment
+ * ==========
+ * Per byte forwarded, each event starts with the given probability:
+ * - drop=P:     drop burst bytes
+ * - corrupt=P:  XOR burst bytes with random non-zero values
+ * - insert=P:   insert burst random bytes before this byte
+ * - delay=P:    stall the line for delay-us before this byte
+ * - burst=N:    bytes per drop, corrupt or insert event (default 1)
+ * - baud=B:     model the line rate:  forward at most B/10 chars/s
+ *               (8N1), e.g. baud=4M for a 4Mbaud THS link; default
+ *               is as fast as the ptys go
+ * - seed=S:     random seed (default 1), so a run can be repeated
+ * The random numbers are drawn only when some probability is set, so
+ * an unimpaired loopback costs one read() and one write() per chunk.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* stty_raw_config(...), parse_speed_value(...) */
+#include "raw_settings.h"
+/* monotonic_ns(), PACER */
+#include "timing.h"
+#include "pacer.h"
+
+#define PTYLOOP_CHUNK 4096
+#define PTYLOOP_MAXBURST 256
+
+
+/**********************************************************************/
+/* Open pty master, with flags (e.g. O_NONBLOCK) added to O_RDWR |
+ * O_NOCTTY, put slave name in name[lname], and configure slave for raw
+ * data
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+pty_open_pair(int* pfdm, char* name, size_t lname, int flags)
+{
+    if (0 > (*pfdm = posix_openpt(O_RDWR | O_NOCTTY | flags))
+     || grantpt(*pfdm) || unlockpt(*pfdm)
+     || ptsname_r(*pfdm, name, lname)
+       )
+    {
+        perror("pty_open_pair=>posix_openpt");
+        if (0 <= *pfdm) { close(*pfdm); *pfdm = -1; }
+        return -1;
+    }
+    stty_raw_config(name, NULL);
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Forwarder counts */
+typedef struct PTYLOOPSTATSstr
+{
+    uint64_t in;             /* Bytes read from master */
+    uint64_t out;            /* Bytes written back to master */
+    uint64_t dropped;        /* Bytes dropped */
+    uint64_t corrupted;      /* Bytes corrupted */
+    uint64_t inserted;       /* Bytes inserted */
+    uint64_t delays;         /* Count of stalls */
+} PTYLOOPSTATS, *pPTYLOOPSTATS;
+
+
+/**********************************************************************/
+/* Loopback options and state */
+typedef struct PTYLOOPstr
+{
+    char name[64];           /* Slave name:  the TTY under test */
+    int fdm;                 /* Master fd, or -1 */
+    int fdctl;               /* Write end of forwarder control pipe */
+    pid_t pid;               /* Forwarder process, or 0 */
+    pid_t owner;             /* Process that started the forwarder */
+    double baud;             /* Line rate model, bit/s; 0 for none */
+    double p_drop;           /* Probabilities per byte of events */
+    double p_corrupt;
+    double p_insert;
+    double p_delay;
+    size_t burst;            /* Bytes per drop, corrupt, insert event */
+    uint64_t delay_ns;       /* Length of each stall */
+    uint64_t seed;           /* Random seed */
+    PTYLOOPSTATS stats;      /* Counts, in forwarder */
+} PTYLOOP, *pPTYLOOP;
+
+
+/**********************************************************************/
+/* Set defaults:  no impairment, no line rate model */
+static void
+ptyloop_init(pPTYLOOP pl)
+{
+    memset(pl, 0, sizeof *pl);
+    pl->fdm = pl->fdctl = -1;
+    pl->burst = 1;
+    pl->delay_ns = 1000000;
+    pl->seed = 1;
+}
+
+
+/**********************************************************************/
+/* Parse spec pty[,option=value...], e.g.
+ *   pty,baud=4M,drop=1e-5,burst=8,delay=1e-6,delay-us=2000
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+ptyloop_parse(pPTYLOOP pl, const char* spec)
+{
+    const char* opt;
+
+    if (strncmp(spec, "pty", 3) || (spec[3] && ',' != spec[3]))
+    {
+        fprintf(stderr,"ERROR:  loopback [%s] is not pty[,...]\n", spec);
+        return -1;
+    }
+    for (opt = strchr(spec, ','); opt; opt = strchr(opt, ','))
+    {
+        char* end = NULL;
+        double* pp = NULL;
+        ++opt;
+
+        if      (!strncmp(opt, "drop=", 5))    { pp = &pl->p_drop; opt += 5; }
+        else if (!strncmp(opt, "corrupt=", 8)) { pp = &pl->p_corrupt; opt += 8; }
+        else if (!strncmp(opt, "insert=", 7))  { pp = &pl->p_insert; opt += 7; }
+        else if (!strncmp(opt, "delay=", 6))   { pp = &pl->p_delay; opt += 6; }
+
+        if (pp)
+        {
+            *pp = strtod(opt, &end);
+            if (end == opt || *pp < 0.0 || *pp > 1.0) { break; }
+        }
+        else if (!strncmp(opt, "burst=", 6))
+        {
+            pl->burst = strtoul(opt + 6, &end, 10);
+            if (end == (opt + 6) || !pl->burst
+             || pl->burst > PTYLOOP_MAXBURST) { break; }
+        }
+        else if (!strncmp(opt, "delay-us=", 9))
+        {
+            pl->delay_ns = strtoull(opt + 9, &end, 10) * 1000;
+            if (end == (opt + 9)) { break; }
+        }
+        else if (!strncmp(opt, "seed=", 5))
+        {
+            pl->seed = strtoull(opt + 5, &end, 10);
+            if (end == (opt + 5)) { break; }
+            if (!pl->seed) { pl->seed = 1; }
+        }
+        else if (!strncmp(opt, "baud=", 5))
+        {
+            char token[32];
+            size_t l = strcspn(opt + 5, ",");
+            if (!l || l >= sizeof token) { break; }
+            memcpy(token, opt + 5, l);
+            token[l] = '\0';
+            if (!(pl->baud = (double) parse_speed_value(token))) { break; }
+            end = (char*) opt + 5 + l;
+        }
+        else
+        {
+            break;
+        }
+        if (*end && ',' != *end) { break; }
+    }
+    if (opt)
+    {
+        fprintf(stderr,"ERROR:  bad loopback option [%s] in [%s]\n"
+                      , opt, spec);
+        return -1;
+    }
+    if ((pl->p_drop + pl->p_corrupt + pl->p_insert + pl->p_delay) > 1.0)
+    {
+        fprintf(stderr,"ERROR:  loopback probabilities exceed 1 [%s]\n"
+                      , spec);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* xorshift64* random numbers */
+static inline uint64_t
+ptyloop_rand(uint64_t* ps)
+{
+    *ps ^= *ps >> 12;
+    *ps ^= *ps << 25;
+    *ps ^= *ps >> 27;
+    return *ps * 0x2545F4914F6CDD1DULL;
+}
+
+
+/**********************************************************************/
+/* Probability as threshold for a random 64-bit value */
+static uint64_t
+ptyloop_threshold(double p)
+{
+    if (p >= 1.0) { return UINT64_MAX; }
+    return (uint64_t) (p * 18446744073709551616.0);
+}
+
+
+/**********************************************************************/
+/* Write n bytes to master, paced, waiting while the slave's input is
+ * full, until all are written or the control pipe closes
+ * Return value:  0 when written; -1 when stopped, or on error
+ */
+static int
+ptyloop_write_all(pPTYLOOP pl, const unsigned char* p, size_t n
+                 , int fdctl, pPACER ppacer)
+{
+    struct pollfd pfds[2];
+    ssize_t iwrite;
+    size_t m;
+
+    while (n > 0)
+    {
+        m = pacer_wait(ppacer, n);
+        iwrite = write(pl->fdm, p, m);
+        if (iwrite > 0)
+        {
+            pacer_spend(ppacer, iwrite);
+            pl->stats.out += iwrite;
+            p += iwrite;
+            n -= iwrite;
+            continue;
+        }
+        if (iwrite < 0 && EAGAIN!=errno && EWOULDBLOCK!=errno
+         && EINTR!=errno && EIO!=errno)
+        {
+            perror("ptyloop_write_all");
+            return -1;
+        }
+        errno = 0;
+        pfds[0].fd = pl->fdm;
+        pfds[0].events = POLLOUT;
+        pfds[1].fd = fdctl;
+        pfds[1].events = POLLIN;
+        pfds[0].revents = pfds[1].revents = 0;
+        poll(pfds, 2, 100);
+        if (pfds[1].revents) { return -1; }
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Forwarder process main loop:  read master, impair, write back to
+ * master, until the control pipe closes; then report counts and exit
+ */
+static void
+ptyloop_forward(pPTYLOOP pl, int fdctl)
+{
+    unsigned char in[PTYLOOP_CHUNK];
+    unsigned char* out = malloc(PTYLOOP_CHUNK * (1 + PTYLOOP_MAXBURST));
+    uint64_t t_drop = ptyloop_threshold(pl->p_drop);
+    uint64_t t_corrupt = t_drop + ptyloop_threshold(pl->p_corrupt);
+    uint64_t t_insert = t_corrupt + ptyloop_threshold(pl->p_insert);
+    uint64_t t_delay = t_insert + ptyloop_threshold(pl->p_delay);
+    int impair = pl->p_drop > 0.0 || pl->p_corrupt > 0.0
+              || pl->p_insert > 0.0 || pl->p_delay > 0.0;
+    uint64_t rnd = pl->seed;
+    size_t drop_left = 0;
+    size_t corrupt_left = 0;
+    struct pollfd pfds[2];
+    PACER pacer;
+    ssize_t iread;
+
+    pacer_init(&pacer, pl->baud / 10.0, 0.0);
+    if (!out) { perror("ptyloop_forward=>malloc"); _exit(1); }
+
+    for (;;)
+    {
+        pfds[0].fd = pl->fdm;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = fdctl;
+        pfds[1].events = POLLIN;
+        pfds[0].revents = pfds[1].revents = 0;
+        if (0 > poll(pfds, 2, 100) && EINTR!=errno)
+        {
+            perror("ptyloop_forward=>poll");
+            break;
+        }
+        if (pfds[1].revents) { break; }
+        if (!pfds[0].revents) { continue; }
+
+        iread = read(pl->fdm, in, sizeof in);
+        if (iread <= 0)
+        {
+            if (iread < 0 && EAGAIN!=errno && EINTR!=errno && EIO!=errno)
+            {
+                perror("ptyloop_forward=>read");
+                break;
+            }
+            errno = 0;
+            continue;
+        }
+        pl->stats.in += iread;
+
+        if (!impair)
+        {
+            if (ptyloop_write_all(pl, in, iread, fdctl, &pacer)) { break; }
+            continue;
+        }
+
+        /* Impair a byte at a time */
+        {
+            size_t lout = 0;
+            ssize_t i;
+            size_t k;
+            uint64_t r;
+
+            for (i=0; i<iread; ++i)
+            {
+                if (drop_left)
+                {
+                    --drop_left;
+                    ++pl->stats.dropped;
+                    continue;
+                }
+                if (corrupt_left)
+                {
+                    --corrupt_left;
+                    ++pl->stats.corrupted;
+                    out[lout++] = in[i] ^ ((ptyloop_rand(&rnd) >> 56) | 1);
+                    continue;
+                }
+                r = ptyloop_rand(&rnd);
+                if (r < t_drop)
+                {
+                    drop_left = pl->burst - 1;
+                    ++pl->stats.dropped;
+                    continue;
+                }
+                if (r < t_corrupt)
+                {
+                    corrupt_left = pl->burst - 1;
+                    ++pl->stats.corrupted;
+                    out[lout++] = in[i] ^ ((ptyloop_rand(&rnd) >> 56) | 1);
+                    continue;
+                }
+                if (r < t_insert)
+                {
+                    for (k=0; k<pl->burst; ++k)
+                    {
+                        out[lout++] = (unsigned char) (ptyloop_rand(&rnd) >> 56);
+                    }
+                    pl->stats.inserted += pl->burst;
+                }
+                else if (r < t_delay)
+                {
+                    /* Stall:  send what came before, then wait */
+                    struct timespec ts;
+                    if (ptyloop_write_all(pl, out, lout, fdctl, &pacer))
+                    {
+                        lout = 0;
+                        break;
+                    }
+                    lout = 0;
+                    ts.tv_sec = pl->delay_ns / 1000000000;
+                    ts.tv_nsec = pl->delay_ns % 1000000000;
+                    while (nanosleep(&ts, &ts) && EINTR==errno) ;
+                    ++pl->stats.delays;
+                }
+                out[lout++] = in[i];
+            }
+            if (i < iread
+             || ptyloop_write_all(pl, out, lout, fdctl, &pacer)) { break; }
+        }
+    }
+
+    fprintf(stderr,"Loopback [%s]:  in=%lu; out=%lu; dropped=%lu"
+                   "; corrupted=%lu; inserted=%lu; delays=%lu\n"
+                  , pl->name
+                  , (unsigned long) pl->stats.in
+                  , (unsigned long) pl->stats.out
+                  , (unsigned long) pl->stats.dropped
+                  , (unsigned long) pl->stats.corrupted
+                  , (unsigned long) pl->stats.inserted
+                  , (unsigned long) pl->stats.delays);
+    fflush(stderr);
+    free(out);
+    _exit(0);
+}
+
+
+/**********************************************************************/
+/* Open pty, configure slave raw, fork forwarder; the slave name is
+ * then pl->name
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+ptyloop_start(pPTYLOOP pl)
+{
+    int fdpipes[2];
+    int fds;
+
+    if (pty_open_pair(&pl->fdm, pl->name, sizeof pl->name, O_NONBLOCK))
+    {
+        return -1;
+    }
+
+    /* Slave stays open in forwarder, so master never hangs up */
+    if (0 > (fds = open(pl->name, O_RDWR | O_NOCTTY)))
+    {
+        perror(pl->name);
+        return -1;
+    }
+    if (0 > pipe(fdpipes))
+    {
+        perror("ptyloop_start=>pipe");
+        close(fds);
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    if (0 > (pl->pid = fork()))
+    {
+        perror("ptyloop_start=>fork");
+        pl->pid = 0;
+        close(fds);
+        close(fdpipes[0]);
+        close(fdpipes[1]);
+        return -1;
+    }
+    if (!pl->pid)
+    {
+        /* SIGINT from the terminal, e.g. to stop a soak, leaves the
+         * forwarder running; it stops when the control pipe closes
+         */
+        signal(SIGINT, SIG_IGN);
+        close(fdpipes[1]);
+        ptyloop_forward(pl, fdpipes[0]);
+    }
+
+    close(fds);
+    close(fdpipes[0]);
+    pl->fdctl = fdpipes[1];
+    pl->owner = getpid();
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Stop forwarder, which reports its counts; only in the process that
+ * started it (not e.g. in a forked reader)
+ */
+static void
+ptyloop_stop(pPTYLOOP pl)
+{
+    if (!pl->pid || getpid() != pl->owner) { return; }
+    close(pl->fdctl);
+    pl->fdctl = -1;
+    waitpid(pl->pid, NULL, 0);
+    pl->pid = 0;
+    close(pl->fdm);
+    pl->fdm = -1;
+}
+
+#endif/*__PTYLOOP_H__*/
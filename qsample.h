@@ -0,0 +1,277 @@
+#ifndef __QSAMPLE_H__
+#define __QSAMPLE_H__
+
+/**********************************************************************/
+/*** Background sampler of TTY kernel queue depths:  TIOCOUTQ (TX,  ***/
+/*** chars not yet sent) and TIOCINQ (RX, chars not yet read), and  ***/
+/*** of UART error counters (TIOCGICOUNT)                           ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * QSAMPLE_RING                - Default count of samples kept
+ * typedef ... *pQSAMPLE       - Struct with one sample
+ * typedef ... *pQSAMPLER      - Struct with sampler state and summary
+ * qsampler_thread(...)        - Sampling loop, in its own thread
+ * qsampler_start(...)         - Open RX fd, allocate ring, start thread
+ * qsampler_stop(...)          - Stop thread, close RX fd
+ * qsampler_print(...)         - Summarize queue depth percentiles
+ * qsampler_dump(...)          - Write kept samples to a file
+ * qsampler_free(...)          - Release ring
+ *
+ * Usage
+ * =====
+ * The sampler runs in the writer process.  TX depth is sampled on the
+ * writer fd; RX depth is sampled on a separate read-only fd opened on
+ * the same TTY, which sees the same input queue as the forked reader's
+ * fd, without reading from it.  Samples are taken at absolute
+ * deadlines, interval_ns apart, into a preallocated ring that keeps
+ * the last lring samples; every sample is also counted in a histogram,
+ * so percentiles cover the whole run.  A sample taken later than one
+ * interval after its deadline is counted as late.
+ *
+ * Where the driver supports TIOCGICOUNT, each sample also records the
+ * growth, since the sampler started, of the overrun, buf_overrun, and
+ * line (frame + parity + brk) error counters; see icount.h.
+ *
+ * Any ioctl may be unsupported (e.g. a plain file, or TIOCGICOUNT on a
+ * pty); that queue or those counters are then reported as unavailable.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "timing.h"
+#include "histogram.h"
+#include "icount.h"
+
+#define QSAMPLE_RING 65536
+
+
+/**********************************************************************/
+/* One sample */
+typedef struct QSAMPLEstr
+{
+    uint64_t t_ns;           /* Time since sampler start */
+    int32_t outq;            /* TIOCOUTQ, or -1 */
+    int32_t inq;             /* TIOCINQ, or -1 */
+    int32_t overrun;         /* TIOCGICOUNT growth since start, or -1 */
+    int32_t buf_overrun;
+    int32_t line_errors;     /* frame + parity + brk */
+} QSAMPLE, *pQSAMPLE;
+
+
+/**********************************************************************/
+/* Sampler state and summary */
+typedef struct QSAMPLERstr
+{
+    int fdw;                 /* Writer fd, not owned */
+    int fdr;                 /* Read-only fd for TIOCINQ, or -1 */
+    uint64_t interval_ns;    /* Time between samples */
+    uint64_t t0_ns;          /* Start time */
+    pthread_t thread;
+    int running;             /* Non-zero while thread exists */
+    volatile int stop;       /* Set to stop thread */
+    pQSAMPLE ring;           /* Last lring samples */
+    size_t lring;
+    size_t count;            /* Count of samples taken */
+    size_t late;             /* Count of samples over an interval late */
+    int outq_ok;             /* Non-zero if TIOCOUTQ works */
+    int inq_ok;              /* Non-zero if TIOCINQ works */
+    int icount_ok;           /* Non-zero if TIOCGICOUNT works */
+    ICOUNT icount0;          /* Counters at start */
+    HISTOGRAM outq;          /* TX queue depths, chars */
+    HISTOGRAM inq;           /* RX queue depths, chars */
+} QSAMPLER, *pQSAMPLER;
+
+
+/**********************************************************************/
+/* Sampling loop, in its own thread */
+static void*
+qsampler_thread(void* arg)
+{
+    pQSAMPLER ps = (pQSAMPLER) arg;
+    uint64_t deadline = ps->t0_ns;
+    struct timespec ts;
+    QSAMPLE s;
+    ICOUNT ic;
+    ICOUNT d;
+    int v;
+
+    while (!ps->stop)
+    {
+        s.t_ns = monotonic_ns() - ps->t0_ns;
+        s.outq = -1;
+        s.inq = -1;
+        s.overrun = s.buf_overrun = s.line_errors = -1;
+        if (ps->outq_ok && !ioctl(ps->fdw, TIOCOUTQ, &v))
+        {
+            s.outq = v;
+            hist_record(&ps->outq, (uint64_t) v);
+        }
+        if (ps->inq_ok && !ioctl(ps->fdr, TIOCINQ, &v))
+        {
+            s.inq = v;
+            hist_record(&ps->inq, (uint64_t) v);
+        }
+        if (ps->icount_ok && !icount_get(ps->fdw, &ic))
+        {
+            icount_delta(&d, &ic, &ps->icount0);
+            s.overrun = d.overrun;
+            s.buf_overrun = d.buf_overrun;
+            s.line_errors = d.frame + d.parity + d.brk;
+        }
+        ps->ring[ps->count % ps->lring] = s;
+        ++ps->count;
+        if ((s.t_ns + ps->t0_ns) > (deadline + ps->interval_ns))
+        {
+            /* Late:  skip missed deadlines rather than catch up */
+            ++ps->late;
+            deadline = s.t_ns + ps->t0_ns;
+        }
+
+        /* Sleep to next absolute deadline */
+        deadline += ps->interval_ns;
+        ts.tv_sec = deadline / 1000000000UL;
+        ts.tv_nsec = deadline % 1000000000UL;
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME
+                                       , &ts, NULL)) ;
+    }
+    return NULL;
+}
+
+
+/**********************************************************************/
+/* Open read-only fd on tty_name for TIOCINQ (or, if tty_name is NULL,
+ * dup fdw, e.g. a session.h read/write fd), allocate ring of lring
+ * samples (0 for QSAMPLE_RING), and start sampling every interval_ns
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+qsampler_start(pQSAMPLER ps, int fdw, char* tty_name
+              , uint64_t interval_ns, size_t lring)
+{
+    int v;
+    int rtn;
+
+    memset(ps, 0, sizeof *ps);
+    ps->fdr = -1;
+    hist_init(&ps->outq);
+    hist_init(&ps->inq);
+    ps->fdw = fdw;
+    ps->interval_ns = interval_ns ? interval_ns : 1000000;
+    ps->lring = lring ? lring : QSAMPLE_RING;
+
+    if (!(ps->ring = calloc(ps->lring, sizeof *ps->ring)))
+    {
+        perror("qsampler_start=>calloc");
+        return -1;
+    }
+
+    /* Probe each ioctl once; plain files and some drivers lack them */
+    ps->outq_ok = isatty(fdw) && !ioctl(fdw, TIOCOUTQ, &v);
+    ps->fdr = tty_name ? open(tty_name, O_RDONLY | O_NONBLOCK | O_NOCTTY)
+                       : dup(fdw);
+    ps->inq_ok = 0 <= ps->fdr && isatty(ps->fdr)
+              && !ioctl(ps->fdr, TIOCINQ, &v);
+    ps->icount_ok = !icount_get(fdw, &ps->icount0);
+    errno = 0;
+
+    ps->t0_ns = monotonic_ns();
+    if ((rtn = pthread_create(&ps->thread, NULL, qsampler_thread, ps)))
+    {
+        errno = rtn;
+        perror("qsampler_start=>pthread_create");
+        errno = 0;
+        if (0 <= ps->fdr) { close(ps->fdr); ps->fdr = -1; }
+        return -1;
+    }
+    ps->running = 1;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Stop sampling thread, close read-only fd */
+static void
+qsampler_stop(pQSAMPLER ps)
+{
+    if (!ps->running) { return; }
+    ps->stop = 1;
+    pthread_join(ps->thread, NULL);
+    ps->running = 0;
+    if (0 <= ps->fdr) { close(ps->fdr); ps->fdr = -1; }
+}
+
+
+/**********************************************************************/
+/* Summarize queue depth percentiles */
+static void
+qsampler_print(FILE* f, pQSAMPLER ps)
+{
+    if (!f) { return; }
+    fprintf(f, "Queue samples=%lu every %.3fms; late=%lu\n"
+             , (unsigned long) ps->count, ps->interval_ns * 1e-6
+             , (unsigned long) ps->late);
+    if (ps->outq_ok) { hist_print(f, "TX queue (TIOCOUTQ)", &ps->outq
+                                 , 1.0, "ch"); }
+    else             { fprintf(f, "TX queue (TIOCOUTQ):  unavailable\n"); }
+    if (ps->inq_ok)  { hist_print(f, "RX queue (TIOCINQ)", &ps->inq
+                                 , 1.0, "ch"); }
+    else             { fprintf(f, "RX queue (TIOCINQ):  unavailable\n"); }
+    if (ps->icount_ok && ps->count)
+    {
+        pQSAMPLE s = ps->ring + ((ps->count - 1) % ps->lring);
+        fprintf(f, "UART errors (TIOCGICOUNT) at last sample:  overrun=%d"
+                   "; buf_overrun=%d; line=%d\n"
+                 , s->overrun, s->buf_overrun, s->line_errors);
+    }
+}
+
+
+/**********************************************************************/
+/* Write kept samples, oldest first, to file at path, one per line:
+ *   time_us tx_queue rx_queue overrun buf_overrun line_errors
+ * with -1 for an unavailable queue or counter
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+qsampler_dump(char* path, pQSAMPLER ps)
+{
+    FILE* f;
+    size_t i = ps->count > ps->lring ? ps->count - ps->lring : 0;
+
+    if (!(f = fopen(path, "w"))) { perror(path); return -1; }
+    fprintf(f, "# time_us tx_queue rx_queue"
+               " overrun buf_overrun line_errors\n");
+    for (; i < ps->count; ++i)
+    {
+        pQSAMPLE s = ps->ring + (i % ps->lring);
+        fprintf(f, "%.1f %d %d %d %d %d\n", s->t_ns * 1e-3
+                 , s->outq, s->inq
+                 , s->overrun, s->buf_overrun, s->line_errors);
+    }
+    fclose(f);
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Release ring */
+static void
+qsampler_free(pQSAMPLER ps)
+{
+    qsampler_stop(ps);
+    free(ps->ring);
+    ps->ring = NULL;
+}
+
+#endif/*__QSAMPLE_H__*/
@@ -14,10 +14,12 @@
  * find_name_in_control(...) - Find entry in control data in stty_info.h
  * find_name_in_mode(...)    - Find entry in mode data in stty_info.h
  * find_name_in_speeds(...)  - Find entry in speed data in stty_info.h
+ * parse_speed_value(...)    - Parse numeric baud rate not in speed data
  * mode_tcflag_pointer(...)  - Return pointer to flag in struct termios
  * stty_process_token(...)   - Process one line of raw_settings[] above
  * stty_raw_config(...)      - Configure serial port for raw data
  * stty_set_speed(...)       - Configure serial port baudrate
+ * stty_get_line_fd(...)     - Get serial port baudrate and bits/char
  */
 
 #include <fcntl.h>
@@ -177,6 +179,28 @@ find_name_in_speeds(char* token)
     return NULL;
 }
 
+/* Parse numeric baud rate, with optional k or M suffix, e.g. 6250000,
+ * 6250k, or 6.25M; return 0 if token is not such a rate
+ */
+static unsigned long
+parse_speed_value(char* token)
+{
+    double value;
+    char suffix = 0;
+    char extra = 0;
+    int n;
+    if (!token) { return 0; }
+    n = sscanf(token, "%lf%c%c", &value, &suffix, &extra);
+    if (n < 1 || n > 2 || value <= 0.0) { return 0; }
+    if (2==n)
+    {
+        if ('k'==suffix || 'K'==suffix) { value *= 1e3; }
+        else if ('M'==suffix)           { value *= 1e6; }
+        else                            { return 0; }
+    }
+    return (unsigned long) (value + 0.5);
+}
+
 /* Return pointer to corresponding flag in struct termios,
  * based on matching .type element of [struct mode_info] instance
  */
@@ -410,13 +434,30 @@ stty_set_speed(char* tty_name, char* speed_token)
 
     struct speed_map* pspeed;
     int not_bother = 1;
+#   ifdef BOTHER
+    struct speed_map other_speed;     /* For rates not in speeds[] */
+#   endif/*BOTHER*/
 
     if (!tty_name) { return -1; }
     if (!*tty_name) { return -1; }
     if (!speed_token) { return -1; }
     if (!*speed_token) { return -1; }
 
-    if (!(pspeed = find_name_in_speeds(speed_token))) { return -1; }
+    if (!(pspeed = find_name_in_speeds(speed_token)))
+    {
+#       ifdef BOTHER
+        /* Any other numeric rate, e.g. 6250000 or 6.25M, uses BOTHER */
+        if (!(other_speed.value = parse_speed_value(speed_token)))
+        {
+            return -1;
+        }
+        other_speed.string = speed_token;
+        other_speed.speed = BOTHER;
+        pspeed = &other_speed;
+#       else
+        return -1;
+#       endif/*BOTHER*/
+    }
 
 #   ifdef BOTHER
     not_bother = (BOTHER != pspeed->speed);
@@ -580,4 +621,34 @@ stty_set_speed(char* tty_name, char* speed_token)
 
     return 0;
 }
+
+/* Get serial port (/dev/tty*) line parameters, from open fd:
+ * - baud rate, from termios2 .c_ospeed
+ * - bits per character on the wire:  start bit, data bits (cs5..cs8),
+ *   parity bit (parenb), stop bits (cstopb); 12 for raw_settings above
+ */
+static int
+stty_get_line_fd(int fd, unsigned long* pbaud, int* pbits)
+{
+    struct termios2 cur_termios2;
+
+    if (ioctl(fd, TCGETS2, &cur_termios2))
+    {
+        errno = 0;
+        return -2;
+    }
+
+    *pbaud = cur_termios2.c_ospeed;
+    switch (cur_termios2.c_cflag & CSIZE)
+    {
+    case CS5: *pbits = 5; break;
+    case CS6: *pbits = 6; break;
+    case CS7: *pbits = 7; break;
+    default:  *pbits = 8; break;
+    }
+    *pbits += 1                                        /* start bit */
+            + ((cur_termios2.c_cflag & PARENB) ? 1 : 0)   /* parity */
+            + ((cur_termios2.c_cflag & CSTOPB) ? 2 : 1);  /* stop */
+    return 0;
+}
 #endif/*__RAW_SETTINGS_H__*/
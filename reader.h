@@ -0,0 +1,575 @@
+#ifndef __READER_H__
+#define __READER_H__
+
+/**********************************************************************/
+/*** Reader engine for the forked reader:  epoll or busy-poll,      ***/
+/*** large read buffer, VMIN/VTIME batching, and wakeup counts      ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * READER_EPOLL, etc.          - Reader engines
+ * READER_BUFFER               - Default read buffer size
+ * recv_engine, etc.           - Reader options, set e.g. by main()
+ * typedef ... *pREADERCOUNTS  - Struct with settings and counts
+ * typedef ... *pREADER        - Struct with engine state and counts
+ * reader_engine_name(...)     - Name of engine, e.g. for --reader=...
+ * reader_open(...)            - Set up engine, buffer, VMIN/VTIME on fd
+ * reader_set_wake(...)        - Also wake when another fd is readable
+ * reader_wake_check(...)      - Consume wake, if wake fd is readable
+ * reader_tail(...)            - Read fewer than VMIN chars, after a wait
+ * reader_uring_submit(...)    - Queue next read (and poll) on io_uring
+ * reader_uring_read(...)      - Wait for the read in flight on io_uring
+ * reader_read(...)            - Wait for data, and read a buffer full
+ * reader_close(...)           - Release engine and buffer
+ * reader_print(...)           - Report wakeups per MB, etc.
+ *
+ * Engines
+ * =======
+ * epoll   - Sleep in epoll_wait(...) until the TTY is readable, then
+ *           read() up to the buffer size; no per-wakeup fd_set setup,
+ *           and no FD_SETSIZE limit.  With VMIN > 1 and VTIME 0, the
+ *           n_tty line discipline only reports the TTY readable once
+ *           VMIN chars are queued, so each wakeup carries a batch;
+ *           with VTIME > 0 as well, read() then waits up to VTIME
+ *           tenths of a second after each char for a batch of VMIN.
+ *           Fewer than VMIN chars, e.g. the end of the stream, never
+ *           wake epoll with VTIME 0, so, with VMIN > 1, the engine also
+ *           wakes every READER_TAIL_MS and takes any such tail with
+ *           VMIN briefly 0.
+ * busy    - Never sleep:  VMIN and VTIME are set to 0, so read() of
+ *           the (blocking or non-blocking) fd returns at once with
+ *           what is queued, possibly nothing; one CPU is spent to
+ *           take data as soon as it arrives.
+ * uring   - io_uring (cf. uring.h):  one read into the buffer,
+ *           registered as a fixed buffer, is in flight at a time (a
+ *           byte stream cannot have several reads in flight without
+ *           losing their order); each io_uring_enter() both submits
+ *           the next read and waits for it, i.e. one syscall per read,
+ *           where epoll needs two.  The read blocks in a kernel worker,
+ *           so VMIN/VTIME batching applies as to a blocking read();
+ *           with VMIN > 1 and VTIME 0, a tail of fewer than VMIN chars
+ *           is released by setting VMIN to 0, which wakes the read.
+ *           On a non-blocking fd, each read is linked after a poll.
+ *           Waits time out only with IORING_FEAT_EXT_ARG (Linux 5.11),
+ *           so on older kernels reader_open(...) uses epoll instead.
+ *
+ * Hangup
+ * ======
+ * After a hangup, the TTY reads as end of file at once.  The engines
+ * then stop waiting on it, and a read waits out its timeout (or a
+ * wake) before it returns 0, as a stall, so a caller that counts
+ * stalls does not count several in no time and leave while the writer
+ * still writes.
+ *
+ * Wake
+ * ====
+ * reader_set_wake(...) adds an fd (e.g. the soak.h pipe the writer
+ * writes when it is done) that ends a wait early:  epoll waits on it
+ * with the TTY, io_uring polls it with the read in flight, and busy-
+ * poll reads it every READER_WAKE_SPINS empty reads.  reader_read(...)
+ * then returns 0, as for a timeout, with .woken set; the fd is only
+ * waited on until it is first readable.
+ *
+ * Wakeups per MB is the cost of a setting; the cheapest setting is
+ * the one with fewest wakeups per MB for which the UART counters show
+ * no buf_overrun (RX flip buffer full) over a run (cf. icount.h).
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+/* profile_get(...), profile_apply(...):  VMIN and VTIME */
+#include "profile.h"
+/* monotonic_ns() */
+#include "timing.h"
+/* io_uring, with raw syscalls */
+#include "uring.h"
+
+#define READER_EPOLL 0
+#define READER_BUSY 1
+#define READER_URING 2
+
+#define READER_BUFFER 65536
+#define READER_TAIL_MS 100
+#define READER_WAKE_SPINS 1024
+
+
+/**********************************************************************/
+/* Reader options, set e.g. by main():  engine (--reader=...), read
+ * buffer size (--read-buffer=...), and VMIN and VTIME (--vmin=...,
+ * --vtime=...), or -1 to leave them as configured
+ */
+static int recv_engine = READER_EPOLL;
+static size_t recv_buffer = READER_BUFFER;
+static int recv_vmin = -1;
+static int recv_vtime = -1;
+
+
+/**********************************************************************/
+/* Settings and counts, e.g. to report from a forked reader */
+typedef struct READERCOUNTSstr
+{
+    int engine;              /* READER_EPOLL, READER_BUSY, etc. */
+    int fixed;               /* Non-zero if io_uring buffer registered */
+    int vmin;                /* VMIN in effect, or -1 if unknown */
+    int vtime;               /* VTIME in effect, or -1 if unknown */
+    size_t lbuf;             /* Size of read buffer */
+    uint64_t wakeups;        /* Returns from epoll_wait(...), or
+                              * io_uring_enter(...), with data */
+    uint64_t reads;          /* read()s that returned data */
+    uint64_t empty;          /* read()s that returned nothing */
+    uint64_t tails;          /* Reads of fewer than VMIN, after a wait */
+    uint64_t bytes;          /* Total read */
+} READERCOUNTS, *pREADERCOUNTS;
+
+
+/**********************************************************************/
+/* Engine state and counts */
+typedef struct READERstr
+{
+    int fd;                  /* TTY */
+    int epfd;                /* epoll instance, or -1 */
+    char* buf;               /* Read buffer, of counts.lbuf chars */
+    URING u;                 /* io_uring, for READER_URING */
+    int inflight;            /* Completions due on io_uring */
+    int poll;                /* Non-zero to poll before each read */
+    int wakefd;              /* Ends a wait when readable, or -1 */
+    int wake_armed;          /* Non-zero if io_uring poll of wakefd due */
+    int woken;               /* Non-zero once wakefd was readable */
+    int hangup;              /* Non-zero once the TTY read end of file */
+    READERCOUNTS counts;
+} READER, *pREADER;
+
+
+/**********************************************************************/
+/* Name of engine */
+static const char*
+reader_engine_name(int engine)
+{
+    return READER_BUSY==engine ? "busy"
+         : READER_URING==engine ? "uring" : "epoll";
+}
+
+
+/**********************************************************************/
+/* Set up engine on fd with recv_... options:  allocate buffer, set
+ * VMIN and VTIME (busy:  both 0), and create epoll instance
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+reader_open(pREADER prd, int fd)
+{
+    PROFILE prof;
+    struct epoll_event ev;
+    int vmin = recv_vmin;
+    int vtime = recv_vtime;
+
+    memset(prd, 0, sizeof *prd);
+    prd->fd = fd;
+    prd->epfd = -1;
+    prd->u.fd = -1;
+    prd->wakefd = -1;
+    prd->counts.engine = recv_engine;
+    prd->counts.lbuf = recv_buffer ? recv_buffer : READER_BUFFER;
+    prd->counts.vmin = prd->counts.vtime = -1;
+    if (!(prd->buf = malloc(prd->counts.lbuf))) { return -1; }
+
+    /* VMIN and VTIME:  as requested, 0 for busy-poll, else as is */
+    if (READER_BUSY==prd->counts.engine) { vmin = vtime = 0; }
+    if (!profile_get(fd, &prof))
+    {
+        if (0 <= vmin)  { prof.t.c_cc[VMIN] = vmin; }
+        if (0 <= vtime) { prof.t.c_cc[VTIME] = vtime; }
+        if ((0 <= vmin || 0 <= vtime) && profile_apply(fd, &prof, 0))
+        {
+            return -1;
+        }
+        prd->counts.vmin = prof.t.c_cc[VMIN];
+        prd->counts.vtime = prof.t.c_cc[VTIME];
+    }
+    errno = 0;
+
+    /* io_uring waits time out only with IORING_FEAT_EXT_ARG (Linux
+     * 5.11); without it, a wait with no data would never end
+     */
+    if (READER_URING==prd->counts.engine)
+    {
+        if (uring_init(&prd->u, 4)) { return -1; }
+        if (!(prd->u.features & IORING_FEAT_EXT_ARG))
+        {
+            fprintf(stderr, "WARNING:  --reader=uring:  kernel io_uring has"
+                            " no timed waits; using epoll\n");
+            uring_free(&prd->u);
+            prd->counts.engine = READER_EPOLL;
+        }
+        else
+        {
+            prd->counts.fixed = !uring_register_buffer(&prd->u, prd->buf
+                                                      , prd->counts.lbuf);
+            prd->poll = 0 < (O_NONBLOCK & fcntl(fd, F_GETFL));
+        }
+        errno = 0;
+    }
+    if (READER_EPOLL==prd->counts.engine)
+    {
+        if (0 > (prd->epfd = epoll_create1(EPOLL_CLOEXEC))) { return -1; }
+        memset(&ev, 0, sizeof ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(prd->epfd, EPOLL_CTL_ADD, fd, &ev)) { return -1; }
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Also end waits when fd is readable (cf. Wake above); fd is made
+ * non-blocking
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+reader_set_wake(pREADER prd, int fd)
+{
+    struct epoll_event ev;
+
+    if (fcntl(fd, F_SETFL, O_NONBLOCK | fcntl(fd, F_GETFL))) { return -1; }
+    if (0 <= prd->epfd)
+    {
+        memset(&ev, 0, sizeof ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(prd->epfd, EPOLL_CTL_ADD, fd, &ev)) { return -1; }
+    }
+    prd->wakefd = fd;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* If wake fd is readable (data, or end of file), consume it, set
+ * .woken, and stop waiting on it
+ * Return value:  non-zero if woken now
+ */
+static int
+reader_wake_check(pREADER prd)
+{
+    char c;
+
+    if (0 > prd->wakefd) { return 0; }
+    if (0 > read(prd->wakefd, &c, 1))
+    {
+        errno = 0;
+        return 0;
+    }
+    if (0 <= prd->epfd)
+    {
+        epoll_ctl(prd->epfd, EPOLL_CTL_DEL, prd->wakefd, NULL);
+    }
+    prd->wakefd = -1;
+    prd->woken = 1;
+    return 1;
+}
+
+
+/**********************************************************************/
+/* Read fewer than VMIN chars that are queued:  with VMIN 0, read()
+ * returns at once, even from a blocking fd; then restore VMIN
+ * Return value:  count of chars read; 0 if none are queued; -1 on error
+ */
+static ssize_t
+reader_tail(pREADER prd)
+{
+    PROFILE prof;
+    int avail = 0;
+    ssize_t iread;
+    unsigned char vmin;
+
+    if (ioctl(prd->fd, FIONREAD, &avail) || avail < 1
+     || profile_get(prd->fd, &prof))
+    {
+        errno = 0;
+        return 0;
+    }
+    vmin = prof.t.c_cc[VMIN];
+    prof.t.c_cc[VMIN] = 0;
+    if (profile_apply(prd->fd, &prof, 0)) { return -1; }
+    iread = read(prd->fd, prd->buf, prd->counts.lbuf);
+    prof.t.c_cc[VMIN] = vmin;
+    profile_apply(prd->fd, &prof, 0);
+    if (iread < 0 && (EAGAIN==errno || EWOULDBLOCK==errno))
+    {
+        errno = 0;
+        return 0;
+    }
+    if (iread > 0) { ++prd->counts.tails; }
+    return iread;
+}
+
+
+/**********************************************************************/
+/* Queue next read into the buffer on io_uring, after a poll for a
+ * non-blocking fd, unless the TTY hung up, and a poll of the wake fd,
+ * if not yet queued; they are submitted by the next uring_enter(...)
+ */
+static void
+reader_uring_submit(pREADER prd)
+{
+    struct io_uring_sqe* sqe;
+
+    if (0 <= prd->wakefd && !prd->wake_armed)
+    {
+        sqe = uring_sqe(&prd->u);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = prd->wakefd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = 2;
+        prd->wake_armed = 1;
+    }
+    if (prd->hangup) { return; }
+    if (prd->poll)
+    {
+        sqe = uring_sqe(&prd->u);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = prd->fd;
+        sqe->poll32_events = POLLIN;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = 1;
+        ++prd->inflight;
+    }
+    sqe = uring_sqe(&prd->u);
+    sqe->opcode = prd->counts.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = prd->fd;
+    sqe->addr = (uint64_t) (uintptr_t) prd->buf;
+    sqe->len = prd->counts.lbuf;
+    sqe->off = (uint64_t) -1;             /* Current position */
+    sqe->user_data = 0;
+    ++prd->inflight;
+}
+
+
+/**********************************************************************/
+/* Submit the next read, if none is in flight, and wait up to
+ * timeout_ms for it; a wake leaves the read in flight
+ * Return value:  count of chars read; 0 on timeout or wake; -1 on error
+ */
+static ssize_t
+reader_uring_read(pREADER prd, int timeout_ms)
+{
+    struct io_uring_cqe cqe;
+    int batch = prd->counts.vmin > 1 && !prd->counts.vtime;
+    int slice = batch && timeout_ms > READER_TAIL_MS
+              ? READER_TAIL_MS : timeout_ms;
+    int waited = 0;
+    int avail;
+    PROFILE prof;
+    unsigned char vmin = 0;
+    int lowered = 0;
+    int woke = 0;
+    int res;
+    int got;
+
+    for (;;)
+    {
+        if (!prd->inflight) { reader_uring_submit(prd); }
+        res = 0;
+        got = 0;
+        while (!got)
+        {
+            if (uring_enter(&prd->u, 1, (uint64_t) slice * 1000000))
+            {
+                if (ETIME!=errno) { return -1; }
+                errno = 0;
+
+                /* Fewer than VMIN chars queued:  VMIN 0 wakes the read */
+                if (batch && !lowered
+                 && !ioctl(prd->fd, FIONREAD, &avail) && avail > 0
+                 && !profile_get(prd->fd, &prof))
+                {
+                    vmin = prof.t.c_cc[VMIN];
+                    prof.t.c_cc[VMIN] = 0;
+                    lowered = !profile_apply(prd->fd, &prof, 0);
+                    continue;
+                }
+                errno = 0;
+                if ((waited += slice) >= timeout_ms) { return 0; }
+                continue;
+            }
+            while (uring_cqe(&prd->u, &cqe))
+            {
+                if (2 == cqe.user_data)
+                {
+                    prd->wake_armed = 0;
+                    if (reader_wake_check(prd)) { woke = 1; }
+                    continue;
+                }
+                --prd->inflight;
+                if (0 == cqe.user_data) { res = cqe.res; got = 1; }
+            }
+            if (woke && !got) { return 0; }
+        }
+        ++prd->counts.wakeups;
+        if (lowered)
+        {
+            prof.t.c_cc[VMIN] = vmin;
+            profile_apply(prd->fd, &prof, 0);
+            lowered = 0;
+            if (res > 0) { ++prd->counts.tails; }
+        }
+        if (res > 0) { return res; }
+
+        /* Nothing read:  retry, unless an error; after a hangup, wait
+         * out the timeout without a read in flight (cf. Hangup above)
+         */
+        ++prd->counts.empty;
+        if (!res) { prd->hangup = 1; }
+        else if (-EAGAIN!=res && -EINTR!=res && -ECANCELED!=res)
+        {
+            errno = -res;
+            return -1;
+        }
+    }
+}
+
+
+/**********************************************************************/
+/* Wait up to timeout_ms for data, and read up to a buffer full into
+ * prd->buf; a wake (cf. reader_set_wake(...)) ends the wait early
+ * Return value:  count of chars read; 0 on timeout or wake; -1 on error
+ */
+static ssize_t
+reader_read(pREADER prd, int timeout_ms)
+{
+    struct epoll_event ev;
+    ssize_t iread;
+    int retval;
+
+    if (READER_URING==prd->counts.engine)
+    {
+        if (0 >= (iread = reader_uring_read(prd, timeout_ms)))
+        {
+            return iread;
+        }
+    }
+    else if (READER_BUSY==prd->counts.engine)
+    {
+        uint64_t t_end = monotonic_ns() + (uint64_t) timeout_ms * 1000000;
+        for (;;)
+        {
+            iread = read(prd->fd, prd->buf, prd->counts.lbuf);
+            if (iread > 0) { break; }
+            if (iread < 0 && EAGAIN!=errno && EWOULDBLOCK!=errno
+             && EINTR!=errno)
+            {
+                return -1;
+            }
+            errno = 0;
+            ++prd->counts.empty;
+            if (0 <= prd->wakefd && !(prd->counts.empty % READER_WAKE_SPINS)
+             && reader_wake_check(prd))
+            {
+                return 0;
+            }
+            if (monotonic_ns() > t_end) { return 0; }
+        }
+    }
+    else
+    {
+        /* With VMIN > 1, wake every READER_TAIL_MS, for tails */
+        int batch = prd->counts.vmin > 1 && !prd->counts.vtime;
+        int slice = batch && timeout_ms > READER_TAIL_MS
+                  ? READER_TAIL_MS : timeout_ms;
+        int waited = 0;
+        for (;;)
+        {
+            do { retval = epoll_wait(prd->epfd, &ev, 1, slice); }
+            while (0 > retval && EINTR==errno);
+            if (0 > retval) { return -1; }
+            if (retval && 0 <= prd->wakefd && ev.data.fd == prd->wakefd)
+            {
+                if (reader_wake_check(prd)) { return 0; }
+                continue;
+            }
+            if (!retval)
+            {
+                if (batch && (iread = reader_tail(prd)))
+                {
+                    if (iread < 0) { return -1; }
+                    break;
+                }
+                if ((waited += slice) >= timeout_ms) { return 0; }
+                continue;
+            }
+            ++prd->counts.wakeups;
+            iread = read(prd->fd, prd->buf, prd->counts.lbuf);
+            if (iread > 0) { break; }
+            if (iread < 0 && EAGAIN!=errno && EWOULDBLOCK!=errno
+             && EINTR!=errno)
+            {
+                return -1;
+            }
+            errno = 0;
+            ++prd->counts.empty;
+
+            /* Nothing to read after a hangup:  stop waiting on the TTY,
+             * and wait out the timeout (cf. Hangup above)
+             */
+            if (ev.events & (EPOLLHUP | EPOLLERR))
+            {
+                epoll_ctl(prd->epfd, EPOLL_CTL_DEL, prd->fd, NULL);
+                prd->hangup = 1;
+            }
+        }
+    }
+    ++prd->counts.reads;
+    prd->counts.bytes += iread;
+    return iread;
+}
+
+
+/**********************************************************************/
+/* Release engine and buffer */
+static void
+reader_close(pREADER prd)
+{
+    if (0 <= prd->epfd) { close(prd->epfd); }
+    prd->epfd = -1;
+    if (0 <= prd->u.fd) { uring_free(&prd->u); }
+    free(prd->buf);
+    prd->buf = NULL;
+}
+
+
+/**********************************************************************/
+/* Report engine, settings, wakeups (busy-poll:  reads) per MB, and
+ * mean chars per read
+ */
+static void
+reader_print(FILE* f, pREADERCOUNTS prd)
+{
+    double mb = prd->bytes / 1e6;
+    size_t wakeups = READER_BUSY==prd->engine ? prd->reads : prd->wakeups;
+    char vmin[16] = { "-" };
+    char vtime[16] = { "-" };
+
+    if (0 <= prd->vmin)  { snprintf(vmin, sizeof vmin, "%d", prd->vmin); }
+    if (0 <= prd->vtime) { snprintf(vtime, sizeof vtime, "%d", prd->vtime); }
+    fprintf(f, "Reader [%s]:  buffer=%lu; vmin=%s; vtime=%s; wakeups=%lu"
+               "; reads=%lu; empty-reads=%lu; tail-reads=%lu"
+               "; wakeups/MB=%.1f; chars/read=%.1f\n"
+             , reader_engine_name(prd->engine), (unsigned long) prd->lbuf
+             , vmin, vtime, (unsigned long) wakeups
+             , (unsigned long) prd->reads, (unsigned long) prd->empty
+             , (unsigned long) prd->tails
+             , mb > 0.0 ? wakeups / mb : 0.0
+             , prd->reads ? (double) prd->bytes / prd->reads : 0.0);
+}
+
+#endif/*__READER_H__*/
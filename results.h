@@ -0,0 +1,331 @@
+#ifndef __RESULTS_H__
+#define __RESULTS_H__
+
+/**********************************************************************/
+/*** Machine-readable run results:  one record per run, appended to ***/
+/*** a file as a JSON line or a CSV row                             ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * RESULTS_MAX                 - Most fields in a record
+ * RESULT_NULL, etc.           - Kinds of field
+ * results_json, etc.          - Options, set e.g. by main()
+ * typedef ... *pRESULTFIELD   - Struct with one named value
+ * typedef ... *pRESULTS       - Struct with one record
+ * results_init(...)           - Empty record
+ * results_field(...)          - Next free field, named
+ * results_null(...)           - Add field with no value
+ * results_u64(...)            - Add unsigned integer field
+ * results_f64(...)            - Add real field
+ * results_str(...)            - Add string field
+ * results_hex(...)            - Add integer field, as "0x..." string
+ * results_time(...)           - Add current time, ISO 8601 UTC
+ * results_put_value(...)      - Write one value, JSON or CSV
+ * results_append_json(...)    - Append record to file, as one JSON line
+ * results_append_csv(...)     - Append record to file, as one CSV row
+ * results_append(...)         - Append record to each file requested
+ *
+ * Usage
+ * =====
+ * A run (cf. run_results(...) in run.h) adds every field, in the same
+ * order, on every run, with RESULT_NULL for anything not measured
+ * (e.g. UART counters of a pty), so CSV rows from any runs line up
+ * under one header.  CSV header is written when the file is empty.
+ *
+ * JSON is one object per line (JSON Lines), appended, so a sweep of
+ * thousands of runs is one file, and each line parses alone; a null
+ * field is JSON null.  Strings are escaped as needed for both formats.
+ * A string field points at the caller's string, never truncated (e.g.
+ * a /dev/serial/by-id/... path), which must last until the record is
+ * appended.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define RESULTS_MAX 96
+
+#define RESULT_NULL 0
+#define RESULT_U64 1
+#define RESULT_F64 2
+#define RESULT_STR 3
+
+
+/**********************************************************************/
+/* Options, set e.g. by main():  files to append records to, as JSON
+ * lines (--results-json=...) or CSV rows (--results-csv=...), or NULL
+ */
+static char* results_json = NULL;
+static char* results_csv = NULL;
+
+
+/**********************************************************************/
+/* One named value */
+typedef struct RESULTFIELDstr
+{
+    const char* name;
+    int kind;                /* RESULT_NULL, etc. */
+    uint64_t u;
+    double d;
+    const char* str;         /* String:  caller's, or s below */
+    char s[32];              /* Formatted string (hex, time) */
+} RESULTFIELD, *pRESULTFIELD;
+
+
+/**********************************************************************/
+/* One record */
+typedef struct RESULTSstr
+{
+    size_t n;                /* Count of fields */
+    RESULTFIELD f[RESULTS_MAX];
+} RESULTS, *pRESULTS;
+
+
+/**********************************************************************/
+/* Empty record */
+static void
+results_init(pRESULTS pr)
+{
+    pr->n = 0;
+}
+
+
+/**********************************************************************/
+/* Next free field, named, with no value; a record that is full keeps
+ * overwriting its last field (cf. RESULTS_MAX)
+ */
+static pRESULTFIELD
+results_field(pRESULTS pr, const char* name)
+{
+    pRESULTFIELD pf = pr->f + (pr->n < RESULTS_MAX ? pr->n++ : pr->n - 1);
+    pf->name = name;
+    pf->kind = RESULT_NULL;
+    return pf;
+}
+
+
+/**********************************************************************/
+/* Add field with no value */
+static void
+results_null(pRESULTS pr, const char* name)
+{
+    results_field(pr, name);
+}
+
+
+/**********************************************************************/
+/* Add unsigned integer field */
+static void
+results_u64(pRESULTS pr, const char* name, uint64_t v)
+{
+    pRESULTFIELD pf = results_field(pr, name);
+    pf->kind = RESULT_U64;
+    pf->u = v;
+}
+
+
+/**********************************************************************/
+/* Add real field */
+static void
+results_f64(pRESULTS pr, const char* name, double v)
+{
+    pRESULTFIELD pf = results_field(pr, name);
+    pf->kind = RESULT_F64;
+    pf->d = v;
+}
+
+
+/**********************************************************************/
+/* Add string field, as a pointer to v, which must last until the
+ * record is appended; NULL is added as no value
+ */
+static void
+results_str(pRESULTS pr, const char* name, const char* v)
+{
+    pRESULTFIELD pf = results_field(pr, name);
+    if (!v) { return; }
+    pf->kind = RESULT_STR;
+    pf->str = v;
+}
+
+
+/**********************************************************************/
+/* Add integer field, as "0x..." string, e.g. termios flags */
+static void
+results_hex(pRESULTS pr, const char* name, uint64_t v)
+{
+    pRESULTFIELD pf = results_field(pr, name);
+    pf->kind = RESULT_STR;
+    pf->str = pf->s;
+    snprintf(pf->s, sizeof pf->s, "0x%llx", (unsigned long long) v);
+}
+
+
+/**********************************************************************/
+/* Add current time, ISO 8601 UTC, to the second */
+static void
+results_time(pRESULTS pr, const char* name)
+{
+    pRESULTFIELD pf = results_field(pr, name);
+    time_t now = time(NULL);
+    struct tm tm;
+    if (!gmtime_r(&now, &tm)) { return; }
+    pf->kind = RESULT_STR;
+    pf->str = pf->s;
+    strftime(pf->s, sizeof pf->s, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+
+/**********************************************************************/
+/* Write one value:  for JSON (json non-zero), a null is null and a
+ * string is quoted, with '"', '\' and control chars escaped; for CSV, a
+ * null is empty, and a string is quoted, with '"' doubled, only if it
+ * holds ',', '"' or a line end
+ */
+static void
+results_put_value(FILE* f, pRESULTFIELD pf, int json)
+{
+    const char* p;
+
+    switch (pf->kind)
+    {
+    case RESULT_U64:
+        fprintf(f, "%llu", (unsigned long long) pf->u);
+        return;
+    case RESULT_F64:
+        /* Neither format has NaN or infinity */
+        if (pf->d != pf->d || pf->d - pf->d != 0.0)
+        {
+            if (json) { fputs("null", f); }
+            return;
+        }
+        fprintf(f, "%.9g", pf->d);
+        return;
+    case RESULT_STR:
+        break;
+    default:
+        if (json) { fputs("null", f); }
+        return;
+    }
+
+    if (json)
+    {
+        fputc('"', f);
+        for (p=pf->str; *p; ++p)
+        {
+            if ('"'==*p || '\\'==*p) { fprintf(f, "\\%c", *p); }
+            else if ((unsigned char) *p < 0x20)
+            {
+                fprintf(f, "\\u%04x", (unsigned char) *p);
+            }
+            else { fputc(*p, f); }
+        }
+        fputc('"', f);
+        return;
+    }
+    if (!strpbrk(pf->str, ",\"\r\n"))
+    {
+        fputs(pf->str, f);
+        return;
+    }
+    fputc('"', f);
+    for (p=pf->str; *p; ++p)
+    {
+        if ('"'==*p) { fputc('"', f); }
+        fputc(*p, f);
+    }
+    fputc('"', f);
+}
+
+
+/**********************************************************************/
+/* Append record to file, as one JSON line
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+results_append_json(const char* path, pRESULTS pr)
+{
+    FILE* f = fopen(path, "a");
+    size_t i;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    fputc('{', f);
+    for (i=0; i<pr->n; ++i)
+    {
+        fprintf(f, "%s\"%s\":", i ? "," : "", pr->f[i].name);
+        results_put_value(f, pr->f + i, 1);
+    }
+    fputs("}\n", f);
+    if (fclose(f))
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Append record to file, as one CSV row; first write a header row of
+ * field names, if the file is empty
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+results_append_csv(const char* path, pRESULTS pr)
+{
+    FILE* f = fopen(path, "a");
+    size_t i;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    if (0 == ftell(f))
+    {
+        for (i=0; i<pr->n; ++i)
+        {
+            fprintf(f, "%s%s", i ? "," : "", pr->f[i].name);
+        }
+        fputc('\n', f);
+    }
+    for (i=0; i<pr->n; ++i)
+    {
+        if (i) { fputc(',', f); }
+        results_put_value(f, pr->f + i, 0);
+    }
+    fputc('\n', f);
+    if (fclose(f))
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Append record to each file requested (--results-json=...,
+ * --results-csv=...)
+ * Return value:  0 on success; -1 if any append failed
+ */
+static int
+results_append(pRESULTS pr)
+{
+    int rtn = 0;
+    if (results_json && results_append_json(results_json, pr)) { rtn = -1; }
+    if (results_csv && results_append_csv(results_csv, pr))    { rtn = -1; }
+    errno = 0;
+    return rtn;
+}
+
+#endif/*__RESULTS_H__*/
@@ -0,0 +1,237 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+/**********************************************************************/
+/*** Routines to present a repeating pattern as a ring, so that any ***/
+/*** window of it, starting at any offset, is one contiguous write  ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pRING          - Struct describing ring of pattern data
+ * ring_gcd(...)               - Greatest common divisor
+ * ring_period(...)            - Size of memfd ring for pattern and window
+ * ring_create(...)            - memfd ring, mapped twice back-to-back
+ * ring_repeat(...)            - Heap copy of pattern, repeated
+ * ring_make(...)              - memfd ring if small enough, else copy
+ * ring_free(...)              - Release either kind of ring
+ *
+ * Usage
+ * =====
+ * For either kind of ring, the bytes at
+ *
+ *   base[pos] ... base[pos+n-1]
+ *
+ * are the pattern stream starting at pattern offset (pos % lpattern),
+ * for any pos < size and any n up to the window length, so a writer
+ * advances with
+ *
+ *   pos = (pos + n) % size;
+ *
+ * - ring_create(...):  size is the smallest multiple of both the page
+ *   size and the pattern length that is at least the window length; a
+ *   memfd of that size is mapped twice, back-to-back, so any window up
+ *   to size bytes is contiguous with no copying beyond the initial
+ *   fill; it fails for a size over RING_MAXSIZE (e.g. the 19303-char
+ *   sst.h cycle would need 19303 4KiB pages, ~79MB, of memfd, while
+ *   the 256-byte fixed patterns and 127-byte prbs7 of pattern.h need
+ *   one and 127 pages)
+ * - ring_repeat(...):  size is the pattern length; the pattern is
+ *   copied into heap memory enough times to cover a window of up to
+ *   the requested length
+ * - ring_make(...):  ring_create(...) where the size is at most
+ *   RING_MAXSIZE, else ring_repeat(...); .mapped tells which
+ *
+ * Only the first size + window bytes of either kind are ever written
+ * from, e.g. for registering them as an io_uring fixed buffer.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#define RING_MAXSIZE (4UL << 20)   /* Largest memfd ring, bytes */
+
+
+/**********************************************************************/
+/* Ring of pattern data */
+typedef struct RINGstr
+{
+    char* base;         /* Start of ring */
+    size_t size;        /* Ring period, a multiple of pattern length */
+    size_t lwindow;     /* Longest contiguous window from any pos */
+    int mapped;         /* Non-zero for ring_create(...) double mapping */
+} RING, *pRING;
+
+
+/**********************************************************************/
+/* Greatest common divisor */
+static size_t
+ring_gcd(size_t a, size_t b)
+{
+    while (b) { size_t t = a % b; a = b; b = t; }
+    return a;
+}
+
+
+/**********************************************************************/
+/* Size of memfd ring for a pattern of lpattern bytes and windows of up
+ * to lwindow bytes:  the smallest multiple of both page size and
+ * lpattern that is at least lwindow
+ */
+static size_t
+ring_period(size_t lpattern, size_t lwindow)
+{
+    size_t lpage = (size_t) sysconf(_SC_PAGESIZE);
+    size_t period = (lpage / ring_gcd(lpage, lpattern)) * lpattern;
+    return lwindow > period
+         ? period * ((lwindow + period - 1) / period)
+         : period;
+}
+
+
+/**********************************************************************/
+/* Fill len bytes at dst with repeats of pattern */
+static void
+ring_fill(char* dst, size_t len, const char* pattern, size_t lpattern)
+{
+    size_t n;
+    while (len > 0)
+    {
+        n = len < lpattern ? len : lpattern;
+        memcpy(dst, pattern, n);
+        dst += n;
+        len -= n;
+    }
+}
+
+
+/**********************************************************************/
+/* Create ring from a memfd mapped twice, back-to-back, for windows of
+ * up to lwindow bytes
+ * Return value:  0 on success; -1 on failure, or if the ring would be
+ *                larger than RING_MAXSIZE
+ */
+static int
+ring_create(pRING pr, const char* pattern, size_t lpattern, size_t lwindow)
+{
+    char* base;
+    int fd;
+
+    memset(pr, 0, sizeof *pr);
+    if (!pattern || !lpattern) { return -1; }
+
+    /* Smallest multiple of both page size and pattern length, that
+     * holds a window
+     */
+    pr->size = ring_period(lpattern, lwindow);
+    pr->lwindow = pr->size;
+    if (pr->size > RING_MAXSIZE)
+    {
+        fprintf(stderr, "ring_create:  %lu-byte pattern needs a %lu-byte"
+                        " ring, over %lu\n"
+                      , (unsigned long) lpattern, (unsigned long) pr->size
+                      , RING_MAXSIZE);
+        return -1;
+    }
+
+    if (0 > (fd = memfd_create("sst-ring", MFD_CLOEXEC)))
+    {
+        perror("ring_create=>memfd_create");
+        return -1;
+    }
+    if (0 > ftruncate(fd, pr->size))
+    {
+        perror("ring_create=>ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    /* Reserve twice the size of address space, then map memfd into
+     * each half; the mappings persist after the memfd is closed
+     */
+    base = mmap(NULL, 2 * pr->size, PROT_NONE
+               , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == base)
+    {
+        perror("ring_create=>mmap(reserve)");
+        close(fd);
+        return -1;
+    }
+    if (MAP_FAILED == mmap(base, pr->size, PROT_READ | PROT_WRITE
+                          , MAP_SHARED | MAP_FIXED, fd, 0)
+     || MAP_FAILED == mmap(base + pr->size, pr->size, PROT_READ | PROT_WRITE
+                          , MAP_SHARED | MAP_FIXED, fd, 0)
+       )
+    {
+        perror("ring_create=>mmap(fixed)");
+        munmap(base, 2 * pr->size);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    /* Fill first mapping; second mapping shows the same pages */
+    ring_fill(base, pr->size, pattern, lpattern);
+    pr->base = base;
+    pr->mapped = 1;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Create ring as heap copy of pattern, repeated to cover windows of up
+ * to lwindow bytes
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+ring_repeat(pRING pr, const char* pattern, size_t lpattern, size_t lwindow)
+{
+    memset(pr, 0, sizeof *pr);
+    if (!pattern || !lpattern) { return -1; }
+    if (!(pr->base = malloc(lpattern + lwindow)))
+    {
+        perror("ring_repeat=>malloc");
+        return -1;
+    }
+    ring_fill(pr->base, lpattern + lwindow, pattern, lpattern);
+    pr->size = lpattern;
+    pr->lwindow = lwindow;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Create memfd ring, if use_ring and it is at most RING_MAXSIZE bytes,
+ * else a heap copy of pattern for windows of up to lwindow bytes
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+ring_make(pRING pr, const char* pattern, size_t lpattern, size_t lwindow
+         , int use_ring)
+{
+    if (use_ring && lpattern
+     && ring_period(lpattern, lwindow) <= RING_MAXSIZE)
+    {
+        return ring_create(pr, pattern, lpattern, lwindow);
+    }
+    return ring_repeat(pr, pattern, lpattern, lwindow);
+}
+
+
+/**********************************************************************/
+/* Release either kind of ring */
+static void
+ring_free(pRING pr)
+{
+    if (!pr->base) { return; }
+    if (pr->mapped) { munmap(pr->base, 2 * pr->size); }
+    else            { free(pr->base); }
+    pr->base = NULL;
+}
+
+#endif/*__RING_H__*/
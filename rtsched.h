@@ -0,0 +1,361 @@
+#ifndef __RTSCHED_H__
+#define __RTSCHED_H__
+
+/**********************************************************************/
+/*** Real-time scheduling, CPU pinning, and locked memory for the   ***/
+/*** writer and the forked reader, and what was actually applied    ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * RT_PRIO                     - Default SCHED_FIFO/SCHED_RR priority
+ * RT_STACK                    - Stack prefaulted with locked memory
+ * typedef ... *pRTSPEC        - Struct with policy, priority, CPU wanted
+ * rt_writer, etc.             - Options, set e.g. by main()
+ * typedef ... *pRTSTATE       - Struct with what was actually applied
+ * rt_parse(...)               - Parse POLICY[,prio=N][,cpu=N]
+ * rt_policy_name(...)         - Name of policy, e.g. "fifo"
+ * rt_prefault_stack()         - Touch stack, so it is faulted in
+ * rt_locked_kb()              - Locked memory, kB (VmLck)
+ * rt_faults(...)              - Page faults so far, minor and major
+ * rt_get(...)                 - Read back policy, priority, CPUs
+ * rt_apply(...)               - Apply spec and locking to this process
+ * rt_sample(...)              - Page faults since rt_apply(...)
+ * rt_restore(...)             - Back to policy and CPUs before apply
+ * rt_print(...)               - Report what was applied
+ *
+ * Usage
+ * =====
+ * The writer and the forked reader are each one process; each applies
+ * its own spec (--rt-writer=..., --rt-reader=...) to itself:
+ *
+ * - the reader, in the forked reader, before its buffers are allocated;
+ * - the writer, in run_test(...), after the reader and queue sampler
+ *   are started (so they do not inherit it), from just before the
+ *   first write until the last write returns.
+ *
+ * With --mlock, each calls mlockall(MCL_CURRENT | MCL_FUTURE), which
+ * faults in and locks every page mapped so far (the data arrays, ring
+ * and buffers) and every page mapped later (e.g. the reader buffer),
+ * and touches RT_STACK of stack; memory locks are not inherited over
+ * fork(), hence once in each process.
+ *
+ * Anything may fail without privilege (EPERM:  no CAP_SYS_NICE, or
+ * RLIMIT_RTPRIO; ENOMEM:  RLIMIT_MEMLOCK); a failure is reported, and
+ * the run goes on.  What is reported, for each side, is read back from
+ * the kernel after applying, not what was asked for, with the page
+ * faults during the run:  non-zero major faults mean the process was
+ * paged, whatever the spec.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#define RT_PRIO 50
+#define RT_STACK (256 * 1024)
+
+#define RT_FAIL_SCHED 1
+#define RT_FAIL_CPU 2
+#define RT_FAIL_MLOCK 4
+
+
+/**********************************************************************/
+/* Policy, priority, and CPU wanted */
+typedef struct RTSPECstr
+{
+    int set;                 /* Non-zero if given on command line */
+    int policy;              /* SCHED_FIFO, SCHED_RR, or SCHED_OTHER */
+    int prio;                /* Priority, for SCHED_FIFO and SCHED_RR */
+    int cpu;                 /* CPU to pin to, or -1 */
+} RTSPEC, *pRTSPEC;
+
+
+/**********************************************************************/
+/* Options, set e.g. by main():  writer and reader specs (--rt-writer=
+ * ..., --rt-reader=...), and non-zero to lock memory (--mlock)
+ */
+static RTSPEC rt_writer = { 0, SCHED_OTHER, 0, -1 };
+static RTSPEC rt_reader = { 0, SCHED_OTHER, 0, -1 };
+static int rt_mlock = 0;
+
+
+/**********************************************************************/
+/* What was actually applied, read back; fixed size, so the forked
+ * reader can return it through its status pipe
+ */
+typedef struct RTSTATEstr
+{
+    int applied;             /* Non-zero if rt_apply(...) ran */
+    int failed;              /* RT_FAIL_... bits */
+    int policy;              /* In effect */
+    int prio;
+    int ncpus;               /* CPUs allowed */
+    char cpus[64];           /* CPUs allowed, e.g. "2" or "0-7" */
+    int locked;              /* Non-zero if mlockall(...) succeeded */
+    long locked_kb;          /* VmLck, or -1 if unknown */
+    long minflt;             /* Minor page faults, since apply */
+    long majflt;             /* Major page faults, since apply */
+    long minflt0;            /* Page faults at apply */
+    long majflt0;
+    int old_policy;          /* Before apply, for rt_restore(...) */
+    int old_prio;
+    cpu_set_t old_cpus;
+} RTSTATE, *pRTSTATE;
+
+
+/**********************************************************************/
+/* Parse POLICY[,prio=N][,cpu=N] into *pspec; POLICY is fifo, rr or
+ * other; priority defaults to RT_PRIO for fifo and rr
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+rt_parse(char* arg, pRTSPEC pspec)
+{
+    RTSPEC spec = { 1, SCHED_OTHER, 0, -1 };
+    char* p = arg;
+    int n = 0;
+
+    if (!strncmp(p, "fifo", 4))       { spec.policy = SCHED_FIFO;  p += 4; }
+    else if (!strncmp(p, "rr", 2))    { spec.policy = SCHED_RR;    p += 2; }
+    else if (!strncmp(p, "other", 5)) { spec.policy = SCHED_OTHER; p += 5; }
+    else { return -1; }
+    if (SCHED_OTHER != spec.policy) { spec.prio = RT_PRIO; }
+
+    while (*p)
+    {
+        if (1==sscanf(p, ",prio=%d%n", &spec.prio, &n)
+         && SCHED_OTHER != spec.policy
+         && spec.prio >= sched_get_priority_min(spec.policy)
+         && spec.prio <= sched_get_priority_max(spec.policy))
+        {
+            p += n;
+        }
+        else if (1==sscanf(p, ",cpu=%d%n", &spec.cpu, &n)
+              && spec.cpu >= 0 && spec.cpu < CPU_SETSIZE)
+        {
+            p += n;
+        }
+        else { return -1; }
+    }
+    *pspec = spec;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Name of policy, e.g. "fifo" */
+static const char*
+rt_policy_name(int policy)
+{
+    switch (policy)
+    {
+    case SCHED_FIFO:  return "fifo";
+    case SCHED_RR:    return "rr";
+    case SCHED_OTHER: return "other";
+#ifdef SCHED_BATCH
+    case SCHED_BATCH: return "batch";
+#endif
+#ifdef SCHED_IDLE
+    case SCHED_IDLE:  return "idle";
+#endif
+    default:          return "unknown";
+    }
+}
+
+
+/**********************************************************************/
+/* Touch RT_STACK of stack, so it is faulted in (and, after mlockall,
+ * locked) before the run, not during it
+ */
+static void
+rt_prefault_stack()
+{
+    volatile char stack[RT_STACK];
+    size_t i;
+    for (i = 0; i < sizeof stack; i += 4096) { stack[i] = 0; }
+}
+
+
+/**********************************************************************/
+/* Locked memory of this process, kB (VmLck in /proc/self/status)
+ * Return value:  kB; -1 if unknown
+ */
+static long
+rt_locked_kb()
+{
+    FILE* f = fopen("/proc/self/status", "r");
+    char line[128];
+    long kb = -1;
+
+    if (!f) { return -1; }
+    while (fgets(line, sizeof line, f))
+    {
+        if (1==sscanf(line, "VmLck: %ld", &kb)) { break; }
+    }
+    fclose(f);
+    return kb;
+}
+
+
+/**********************************************************************/
+/* Page faults of this process so far, minor and major */
+static void
+rt_faults(long* pminflt, long* pmajflt)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru)) { *pminflt = *pmajflt = 0; return; }
+    *pminflt = ru.ru_minflt;
+    *pmajflt = ru.ru_majflt;
+}
+
+
+/**********************************************************************/
+/* Read back policy, priority, and CPUs allowed into *pst */
+static void
+rt_get(pRTSTATE pst)
+{
+    struct sched_param sp;
+    cpu_set_t cpus;
+    char* p = pst->cpus;
+    char* end = pst->cpus + sizeof pst->cpus;
+    int i;
+    int first = -1;
+
+    pst->policy = sched_getscheduler(0);
+    pst->prio = sched_getparam(0, &sp) ? 0 : sp.sched_priority;
+
+    /* CPUs allowed, as a list of ranges, e.g. "0-3,6" */
+    *p = '\0';
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof cpus, &cpus)) { return; }
+    pst->ncpus = CPU_COUNT(&cpus);
+    for (i = 0; i <= CPU_SETSIZE; ++i)
+    {
+        int on = i < CPU_SETSIZE && CPU_ISSET(i, &cpus);
+        if (on && first < 0) { first = i; }
+        if (!on && first >= 0)
+        {
+            int n = snprintf(p, end - p, first < i - 1 ? "%s%d-%d" : "%s%d"
+                            , p==pst->cpus ? "" : ",", first, i - 1);
+            if (n < 0 || n >= end - p) { break; }
+            p += n;
+            first = -1;
+        }
+    }
+}
+
+
+/**********************************************************************/
+/* Apply spec to this process, and lock memory if lock is non-zero;
+ * read back what is in effect into *pst; report failures, but go on
+ * Return value:  0 if all was applied; -1 if anything failed
+ */
+static int
+rt_apply(pRTSPEC pspec, int lock, pRTSTATE pst)
+{
+    struct sched_param sp;
+
+    memset(pst, 0, sizeof *pst);
+    pst->old_policy = sched_getscheduler(0);
+    pst->old_prio = sched_getparam(0, &sp) ? 0 : sp.sched_priority;
+    sched_getaffinity(0, sizeof pst->old_cpus, &pst->old_cpus);
+
+    if (pspec->set)
+    {
+        memset(&sp, 0, sizeof sp);
+        sp.sched_priority = pspec->prio;
+        if (sched_setscheduler(0, pspec->policy, &sp))
+        {
+            perror("rt_apply=>sched_setscheduler");
+            pst->failed |= RT_FAIL_SCHED;
+        }
+        if (pspec->cpu >= 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(pspec->cpu, &cpus);
+            if (sched_setaffinity(0, sizeof cpus, &cpus))
+            {
+                perror("rt_apply=>sched_setaffinity");
+                pst->failed |= RT_FAIL_CPU;
+            }
+        }
+    }
+    if (lock)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE))
+        {
+            perror("rt_apply=>mlockall");
+            pst->failed |= RT_FAIL_MLOCK;
+        }
+        else
+        {
+            pst->locked = 1;
+        }
+        rt_prefault_stack();
+    }
+    errno = 0;
+
+    pst->applied = 1;
+    rt_get(pst);
+    pst->locked_kb = rt_locked_kb();
+    rt_faults(&pst->minflt0, &pst->majflt0);
+    return pst->failed ? -1 : 0;
+}
+
+
+/**********************************************************************/
+/* Page faults since rt_apply(...), into *pst */
+static void
+rt_sample(pRTSTATE pst)
+{
+    if (!pst->applied) { return; }
+    rt_faults(&pst->minflt, &pst->majflt);
+    pst->minflt -= pst->minflt0;
+    pst->majflt -= pst->majflt0;
+}
+
+
+/**********************************************************************/
+/* Back to policy, priority, and CPUs before rt_apply(...), and unlock
+ * memory
+ */
+static void
+rt_restore(pRTSTATE pst)
+{
+    struct sched_param sp;
+
+    if (!pst->applied) { return; }
+    memset(&sp, 0, sizeof sp);
+    sp.sched_priority = pst->old_prio;
+    sched_setscheduler(0, pst->old_policy, &sp);
+    sched_setaffinity(0, sizeof pst->old_cpus, &pst->old_cpus);
+    if (pst->locked) { munlockall(); }
+    errno = 0;
+}
+
+
+/**********************************************************************/
+/* Report what was applied to one side, e.g. "writer" */
+static void
+rt_print(FILE* f, char* side, pRTSTATE pst)
+{
+    if (!pst->applied) { return; }
+    fprintf(f, "Scheduling [%s]:  policy=%s; priority=%d; cpus=%s"
+               "; mlock=%s; locked=%ldkB; faults=%ld minor, %ld major"
+             , side, rt_policy_name(pst->policy), pst->prio, pst->cpus
+             , pst->locked ? "yes" : "no", pst->locked_kb
+             , pst->minflt, pst->majflt);
+    if (pst->failed & RT_FAIL_SCHED) { fprintf(f, "; policy-failed"); }
+    if (pst->failed & RT_FAIL_CPU)   { fprintf(f, "; cpu-failed"); }
+    if (pst->failed & RT_FAIL_MLOCK) { fprintf(f, "; mlock-failed"); }
+    fprintf(f, "\n");
+}
+
+#endif/*__RTSCHED_H__*/
@@ -0,0 +1,727 @@
+#ifndef __RUN_H__
+#define __RUN_H__
+
+/**********************************************************************/
+/*** Routine to run one test:  write test array data to a TTY (or   ***/
+/*** file) and, optionally, read and verify it in a forked reader   ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pRUNCONFIG     - Struct with options for one run
+ * typedef ... *pRUNRESULT     - Struct with results of one run
+ * run_errors(...)             - Count of bytes in error in a result
+ * run_results(...)            - Append result record (JSON or CSV)
+ * run_test(...)               - Run one test, report results
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* send_chars(...), recv_chars(...), etc. */
+#include "raw_settings.h"
+#include "sst.h"
+#include "qsample.h"
+/* One open fd for the whole run, and startup phase times */
+#include "session.h"
+/* Duration-based soak, and interval reports */
+#include "soak.h"
+/* Result records, as JSON lines or CSV rows */
+#include "results.h"
+/* Wire time to end of tcdrain(), and line model */
+#include "wiretime.h"
+
+
+/**********************************************************************/
+/* Options for one run, mostly from the command line */
+typedef struct RUNCONFIGstr
+{
+    char* tty_name;          /* TTY (or file) to write */
+    pSESSION session;        /* TTY open for the run, or NULL to open */
+    size_t send_count;       /* How many characters to send */
+    int o_nonblock;          /* O_NONBLOCK, or 0 */
+    int fork_reader;         /* Non-zero to read and verify data */
+    size_t write_chunk;      /* Non-zero to write precomputed chunks */
+    int write_ring;          /* Non-zero to write from memfd ring */
+    int write_latency;       /* Non-zero to report write histograms */
+    double rate;             /* Pacing rate, chars/s, or 0 */
+    double rate_pct;         /* Pacing rate, % of baud rate, or 0 */
+    double rate_burst;       /* Pacing bucket depth, or 0 for default */
+    uint64_t queue_ns;       /* TX/RX queue sample interval, or 0 */
+    char* queue_dump;        /* File for queue samples, or NULL */
+    unsigned long nominal_baud; /* Baud asked for (--speed=...), or 0 */
+    int debug;               /* Non-zero to log steps */
+} RUNCONFIG, *pRUNCONFIG;
+
+
+/**********************************************************************/
+/* Results of one run */
+typedef struct RUNRESULTstr
+{
+    ssize_t sent;            /* Characters written, or -1 */
+    uint64_t write_ns;       /* Elapsed time of writes */
+    double write_cpu;        /* Writer CPU time */
+    SENDSTATS send;          /* Writer statistics */
+    int have_recv;           /* Non-zero if recv below is valid */
+    RECVSTATUS recv;         /* Forked reader statistics */
+    QSAMPLER queues;         /* TX/RX queue depths, if sampled */
+    int have_icount;         /* Non-zero if icount below is valid */
+    ICOUNT icount;           /* UART counters, end of run minus start */
+    uint64_t t_run;          /* Start of run */
+    uint64_t t_reader;       /* Reader ready, or 0 */
+    RTSTATE rt;              /* Writer scheduling applied, if any */
+    WIRETIME wire;           /* Wire time and line model */
+} RUNRESULT, *pRUNRESULT;
+
+
+/**********************************************************************/
+/* Count of bytes in error in a result:  dropped, inserted, corrupted;
+ * or, for frames, of frames missing, duplicated, or with bad CRCs;
+ * or, for a pattern, of bit errors, bytes hunted, and bytes not received
+ */
+static size_t
+run_errors(pRUNRESULT pres)
+{
+    if (!pres->have_recv) { return 0; }
+    if (send_frame_payload)
+    {
+        return pres->recv.frames.missing.total
+             + pres->recv.frames.duplicated.total
+             + pres->recv.frames.bad_crc;
+    }
+    if (send_pattern)
+    {
+        return pres->recv.ber.bit_errors + pres->recv.ber.hunt_bytes
+             + (pres->recv.ber.bytes < (uint64_t) pres->sent
+                ? pres->sent - pres->recv.ber.bytes : 0);
+    }
+    return pres->recv.verify.dropped
+         + pres->recv.verify.inserted
+         + pres->recv.verify.corrupted;
+}
+
+
+/**********************************************************************/
+/* Append result record of one run (--results-json=..., --results-csv=
+ * ...):  configuration, termios as applied (read back from fd), writer
+ * and reader counts, throughput, errors, UART counters, and startup;
+ * the same fields, in the same order, every run (see results.h)
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+run_results(pRUNCONFIG pcfg, pRUNRESULT pres, pSESSION ps)
+{
+    static RESULTS r;
+    PROFILE prof;
+    unsigned long baud = 0;
+    int bits = 0;
+    int have_prof = !profile_get(ps->fd, &prof);
+    int have_line = !stty_get_line_fd(ps->fd, &baud, &bits);
+    pRECVSTATUS pr = &pres->recv;
+    double write_s = pres->write_ns * 1e-9;
+    char framing[4];
+
+    errno = 0;
+    results_init(&r);
+
+    /* Run and configuration */
+    results_time(&r, "time");
+    results_str(&r, "tty", pcfg->tty_name);
+    results_str(&r, "data", send_frame_payload ? "frames"
+                          : pat_info[send_pattern].name);
+    results_str(&r, "writer", send_frame_payload ? "chunks"
+                            : send_pattern
+                            ? (pcfg->write_ring && send_ring.mapped
+                               ? "ring" : "chunks")
+                            : send_uring_depth ? "uring"
+                            : pcfg->write_ring && send_ring.mapped ? "ring"
+                            : pcfg->write_chunk ? "chunks" : "lines");
+    if (SIZE_MAX == pcfg->send_count) { results_null(&r, "send_count"); }
+    else { results_u64(&r, "send_count", pcfg->send_count); }
+    results_f64(&r, "duration_s", soak_duration_ns * 1e-9);
+    results_u64(&r, "write_chunk", pres->send.chunk);
+    results_u64(&r, "nonblock", pcfg->o_nonblock ? 1 : 0);
+    results_f64(&r, "rate_cps", send_pacer.rate);
+    results_str(&r, "reader", pcfg->fork_reader
+                              ? reader_engine_name(recv_engine) : "none");
+
+    /* Termios as applied */
+    if (have_line)
+    {
+        results_u64(&r, "baud", baud);
+        results_u64(&r, "bits_per_char", bits);
+    }
+    else
+    {
+        results_null(&r, "baud");
+        results_null(&r, "bits_per_char");
+    }
+    if (have_prof)
+    {
+        tcflag_t c = prof.t.c_cflag;
+        snprintf(framing, sizeof framing, "%c%c%c"
+                , CS5==(c & CSIZE) ? '5' : CS6==(c & CSIZE) ? '6'
+                : CS7==(c & CSIZE) ? '7' : '8'
+                , !(c & PARENB) ? 'N' : (c & PARODD) ? 'O' : 'E'
+                , (c & CSTOPB) ? '2' : '1');
+        results_str(&r, "framing", framing);
+        results_hex(&r, "c_iflag", prof.t.c_iflag);
+        results_hex(&r, "c_oflag", prof.t.c_oflag);
+        results_hex(&r, "c_cflag", prof.t.c_cflag);
+        results_hex(&r, "c_lflag", prof.t.c_lflag);
+        results_u64(&r, "vmin", prof.t.c_cc[VMIN]);
+        results_u64(&r, "vtime", prof.t.c_cc[VTIME]);
+    }
+    else
+    {
+        results_null(&r, "framing");
+        results_null(&r, "c_iflag");
+        results_null(&r, "c_oflag");
+        results_null(&r, "c_cflag");
+        results_null(&r, "c_lflag");
+        results_null(&r, "vmin");
+        results_null(&r, "vtime");
+    }
+
+    /* Writer */
+    results_u64(&r, "sent", pres->sent > 0 ? (uint64_t) pres->sent : 0);
+    results_f64(&r, "write_s", write_s);
+    results_f64(&r, "write_cpu_s", pres->write_cpu);
+    results_f64(&r, "write_cps", write_s > 0.0 ? pres->sent / write_s : 0.0);
+    results_u64(&r, "writes", pres->send.tries);
+    results_u64(&r, "eagains", pres->send.eagains);
+    results_u64(&r, "polls", pres->send.polls);
+    results_f64(&r, "write_p50_us"
+               , hist_percentile(&pres->send.write_ns, 50.0) * 1e-3);
+    results_f64(&r, "write_p99_us"
+               , hist_percentile(&pres->send.write_ns, 99.0) * 1e-3);
+    results_f64(&r, "write_max_us", pres->send.write_ns.max * 1e-3);
+
+    /* Wire:  first write() to end of tcdrain(), and line model */
+    if (pres->wire.drained && pres->wire.wire_s > 0.0)
+    {
+        results_f64(&r, "wire_s", pres->wire.wire_s);
+        results_f64(&r, "wire_cps", pres->wire.wire_cps);
+        results_f64(&r, "drain_us", pres->wire.drain_ns * 1e-3);
+    }
+    else
+    {
+        results_null(&r, "wire_s");
+        results_null(&r, "wire_cps");
+        results_null(&r, "drain_us");
+    }
+    if (pres->wire.modeled)
+    {
+        results_f64(&r, "model_cps", pres->wire.model_cps);
+        results_f64(&r, "efficiency", pres->wire.efficiency);
+        results_f64(&r, "effective_baud", pres->wire.effective_baud);
+    }
+    else
+    {
+        results_null(&r, "model_cps");
+        results_null(&r, "efficiency");
+        results_null(&r, "effective_baud");
+    }
+    if (pcfg->nominal_baud)
+    {
+        results_u64(&r, "nominal_baud", pcfg->nominal_baud);
+    }
+    else { results_null(&r, "nominal_baud"); }
+
+    /* Reader:  end-to-end rate is from first write to last data read */
+    if (pres->have_recv)
+    {
+        double rx_s = pr->last_ns > pres->send.first_ns
+                    ? (pr->last_ns - pres->send.first_ns) * 1e-9 : 0.0;
+        results_u64(&r, "received", pr->count);
+        results_f64(&r, "receive_cps", rx_s > 0.0 ? pr->count / rx_s : 0.0);
+        results_u64(&r, "reads", pr->reads);
+        results_u64(&r, "wakeups", pr->reader.wakeups);
+        results_u64(&r, "errors", run_errors(pres));
+        results_u64(&r, "stalls", pr->timeouts);
+    }
+    else
+    {
+        results_null(&r, "received");
+        results_null(&r, "receive_cps");
+        results_null(&r, "reads");
+        results_null(&r, "wakeups");
+        results_null(&r, "errors");
+        results_null(&r, "stalls");
+    }
+
+    /* Checker's counts:  of bytes by the byte verifier (sawtooth); of
+     * frames (--framed=...); of bits (--pattern=...); null for the
+     * checkers not used
+     */
+    if (pres->have_recv && !send_frame_payload && !send_pattern)
+    {
+        results_u64(&r, "dropped", pr->verify.dropped);
+        results_u64(&r, "inserted", pr->verify.inserted);
+        results_u64(&r, "corrupted", pr->verify.corrupted);
+    }
+    else
+    {
+        results_null(&r, "dropped");
+        results_null(&r, "inserted");
+        results_null(&r, "corrupted");
+    }
+    if (pres->have_recv && send_frame_payload)
+    {
+        results_u64(&r, "missing_frames", pr->frames.missing.total);
+        results_u64(&r, "duplicated_frames", pr->frames.duplicated.total);
+        results_u64(&r, "bad_crc_frames", pr->frames.bad_crc);
+    }
+    else
+    {
+        results_null(&r, "missing_frames");
+        results_null(&r, "duplicated_frames");
+        results_null(&r, "bad_crc_frames");
+    }
+    if (pres->have_recv && send_pattern)
+    {
+        results_u64(&r, "bit_errors", pr->ber.bit_errors);
+        results_u64(&r, "hunt_bytes", pr->ber.hunt_bytes);
+        results_u64(&r, "missing_bytes"
+                   , pr->ber.bytes < (uint64_t) pres->sent
+                     ? pres->sent - pr->ber.bytes : 0);
+    }
+    else
+    {
+        results_null(&r, "bit_errors");
+        results_null(&r, "hunt_bytes");
+        results_null(&r, "missing_bytes");
+    }
+
+    /* UART counters (TIOCGICOUNT), where the driver has them */
+    if (pres->have_icount)
+    {
+        results_u64(&r, "overrun", pres->icount.overrun);
+        results_u64(&r, "buf_overrun", pres->icount.buf_overrun);
+        results_u64(&r, "frame_errors", pres->icount.frame);
+        results_u64(&r, "parity_errors", pres->icount.parity);
+    }
+    else
+    {
+        results_null(&r, "overrun");
+        results_null(&r, "buf_overrun");
+        results_null(&r, "frame_errors");
+        results_null(&r, "parity_errors");
+    }
+
+    /* Scheduling applied (see rtsched.h), and startup */
+    results_str(&r, "writer_policy", pres->rt.applied
+                                     ? rt_policy_name(pres->rt.policy) : NULL);
+    results_str(&r, "reader_policy", pres->have_recv && pr->rt.applied
+                                     ? rt_policy_name(pr->rt.policy) : NULL);
+    results_f64(&r, "open_us", ps->open_ns * 1e-3);
+    results_f64(&r, "config_us", ps->config_ns * 1e-3);
+
+    /* Passed:  all written, and, if read, all received without error */
+    results_u64(&r, "pass", pres->sent >= 0
+                            && (!pres->have_recv || (!run_errors(pres)
+                                && pr->count >= (uint64_t) pres->sent)));
+    return results_append(&r);
+}
+
+
+/**********************************************************************/
+/* Run one test:  write test array data (see sst.h) to TTY or file,
+ * and read and verify those data if requested; report results
+ *
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+run_test(pRUNCONFIG pcfg, pRUNRESULT pres)
+{
+    char* tty_name = pcfg->tty_name;
+    SEQUENCE8BIT s8;   /* used by send_chars below (cf. stty.h) */
+    int fdrdr = 0;
+    int fd;
+    SESSION local;
+    pSESSION ps = pcfg->session;
+    uint64_t t0_ns;
+    double t0_cpu;
+    ICOUNT icount0;
+    ICOUNT icount1;
+    double rate = pcfg->rate;
+    SOAKREPORT soak;
+
+    memset(pres, 0, sizeof *pres);
+    pres->sent = -1;
+    pres->t_run = monotonic_ns();
+
+    /* Open TTY once for this run, unless the caller has it open */
+    if (!ps)
+    {
+        ps = &local;
+        session_init(ps);
+        if (session_open(ps, tty_name, pcfg->o_nonblock)) { return -1; }
+    }
+    fd = ps->fd;
+    if (pcfg->debug) { fprintf(stderr,"Opened [%s]; fd=%d\n", tty_name, fd); }
+
+    /* Set up rate pacing, if requested (--rate=...) */
+    if (pcfg->rate_pct > 0.0)
+    {
+        unsigned long baud;
+        int bits;
+        if (stty_get_line_fd(fd, &baud, &bits) || !baud)
+        {
+            fprintf(stderr, "ERROR:  cannot get baud rate of [%s]"
+                            " for --rate=%g%%\n", tty_name, pcfg->rate_pct);
+            if (ps == &local) { session_close(ps); }
+            return -1;
+        }
+        rate = (pcfg->rate_pct / 100.0) * baud / bits;
+        if (pcfg->debug)
+        {
+            fprintf(stderr, "Rate %g%% of %lubaud at %d bits/char"
+                            " = %.1f chars/s\n"
+                          , pcfg->rate_pct, baud, bits, rate);
+        }
+    }
+    pacer_init(&send_pacer, rate, pcfg->rate_burst);
+
+    /* Cycle of lines as a ring of data to send (--write-chunk=N,
+     * --write-ring, --io=uring), or a pattern (--pattern=...) as a ring
+     * (--write-ring), built before the writes are timed
+     */
+    if (!send_frame_payload
+     && (send_pattern ? pcfg->write_ring
+                      : (send_uring_depth || pcfg->write_chunk))
+     && send_ring_prepare(pcfg->write_chunk ? pcfg->write_chunk : 65536
+                         , pcfg->write_ring))
+    {
+        if (ps == &local) { session_close(ps); }
+        return -1;
+    }
+
+    /* Counts shared with the reader, and its wake pipe, for a soak
+     * (--duration=...) or any forked reader:  the writer tells the
+     * reader when it is done (see soak.h)
+     */
+    memset(&soak, 0, sizeof soak);
+    if ((soak_active() || pcfg->fork_reader) && soak_live_create())
+    {
+        if (ps == &local) { session_close(ps); }
+        return -1;
+    }
+
+    /* Fork reader of these data, if requested (--fork-reader); it
+     * inherits the open fd
+     */
+    fdrdr = pcfg->fork_reader ? recv_chars(tty_name, fd, pcfg->send_count)
+                              : 0;
+    if (0 > fdrdr)
+    {
+        soak_live_free();
+        if (ps == &local) { session_close(ps); }
+        return -1;
+    }
+    if (pcfg->fork_reader)
+    {
+        pres->t_reader = monotonic_ns();
+        if (pcfg->debug)
+        {
+            fprintf(stderr,"Forked reader; pipe-fd=%d\n", fdrdr);
+        }
+    }
+
+    /* Snapshot UART counters, if the driver has them (TIOCGICOUNT) */
+    pres->have_icount = !icount_get(fd, &icount0);
+
+    /* Start sampling TX/RX queue depths, if requested (--queue-sample) */
+    send_outq_on_eagain = pcfg->queue_ns > 0;
+    if (pcfg->queue_ns
+     && qsampler_start(&pres->queues, fd, NULL, pcfg->queue_ns, 0))
+    {
+        soak_writer_done(0);
+        soak_live_free();
+        if (ps == &local) { session_close(ps); }
+        if (pcfg->fork_reader) { close(fdrdr); }
+        return -1;
+    }
+
+    /* Write test data, or frames */
+    if (send_frame_payload && pcfg->debug)
+    {
+        fprintf(stderr,"CRC32C implementation=%s; %.0fMB/s\n"
+                      , crc32c_impl_name, crc32c_rate(1 << 20));
+    }
+    if (send_pattern && pcfg->debug)
+    {
+        fprintf(stderr,"Pattern %s generator; %.0fMB/s\n"
+                      , pat_info[send_pattern].name
+                      , pat_rate(send_pattern, 1 << 20));
+    }
+
+    /* Soak deadline (--duration=...), and interval reports
+     * (--interval=...); see soak.h
+     */
+    soak_start(monotonic_ns());
+    send_publish(&pres->send);
+    if (soak_interval_ns)
+    {
+        soak_report_start(&soak, stderr, &send_live_sent
+                         , &send_live_eagains, monotonic_ns()
+                         , soak_interval_ns);
+    }
+
+    /* Writer scheduling, CPU, and locked memory, for the writes only
+     * (--rt-writer=..., --mlock); see rtsched.h
+     */
+    if (rt_writer.set || rt_mlock)
+    {
+        rt_apply(&rt_writer, rt_mlock, &pres->rt);
+    }
+    t0_cpu = cpu_seconds();
+    t0_ns = monotonic_ns();
+    pres->sent = send_frame_payload
+               ? send_frames(fd, pcfg->send_count
+                            , pcfg->write_chunk ? pcfg->write_chunk : 65536
+                            , &pres->send)
+               : send_pattern && pcfg->write_ring && send_ring.mapped
+               ? send_chunks(fd, pcfg->send_count, pcfg->write_chunk
+                            , &send_ring, &pres->send)
+               : send_pattern
+               ? send_pattern_chunks(fd, pcfg->send_count
+                            , pcfg->write_chunk ? pcfg->write_chunk : 65536
+                            , &pres->send)
+               : send_uring_depth
+               ? send_uring(fd, pcfg->send_count
+                           , pcfg->write_chunk ? pcfg->write_chunk : 65536
+                           , &send_ring, &pres->send)
+               : pcfg->write_chunk
+               ? send_chunks(fd, pcfg->send_count, pcfg->write_chunk
+                            , &send_ring, &pres->send)
+               : send_chars(fd, pcfg->send_count, &s8, &pres->send);
+    pres->write_ns = monotonic_ns() - t0_ns;
+    pres->write_cpu = cpu_seconds() - t0_cpu;
+
+    /* Wait for the last char to leave the UART, and model the line */
+    wire_drain(fd, &pres->wire);
+    wire_model(fd, &pres->wire, pres->send.sent, pres->send.start_ns
+              , pcfg->nominal_baud);
+    soak_writer_done(pres->send.sent);
+    if (!pcfg->fork_reader) { soak_report_stop(&soak); }
+    rt_sample(&pres->rt);
+    rt_restore(&pres->rt);
+    rt_print(stderr, "writer", &pres->rt);
+
+    /* Write statistics, always reported for --write-chunk=N */
+    if (pcfg->debug || pcfg->write_chunk) {
+        fprintf(stderr,"Wrote %ld chars to [%s]; fd=%d"
+                       "; tries=%lu; EAGAINs=%lu"
+                       "; syscalls/char=%.6f\n"
+                      , (long)pres->sent, tty_name, fd
+                      , pres->send.tries, pres->send.eagains
+                      , pres->sent > 0
+                        ? (double)pres->send.tries / pres->sent : 0.0
+                      );
+    }
+
+    /* Wire time, throughput and line model, always reported */
+    wire_print(stderr, tty_name, &pres->wire);
+
+    /* io_uring batches, always reported for --io=uring */
+    if (send_uring_depth && !send_frame_payload && !send_pattern)
+    {
+        fprintf(stderr,"io_uring writer:  depth=%u; writes=%lu"
+                       "; io_uring_enter()s=%lu; writes/enter=%.2f"
+                       "; fixed-buffer=%s\n"
+                      , send_uring_depth, pres->send.tries
+                      , pres->send.enters
+                      , pres->send.enters
+                        ? (double)pres->send.tries / pres->send.enters : 0.0
+                      , pres->send.fixed ? "yes" : "no"
+                      );
+    }
+
+    /* Writer waits and CPU use, always reported for --poll-writer */
+    if (pcfg->debug || send_poll_out) {
+        fprintf(stderr,"Writer waited for POLLOUT %lu times"
+                       "; %.6fs total; %.1fus mean"
+                       "; writer CPU=%.6fs of %.6fs elapsed\n"
+                      , pres->send.polls, pres->send.poll_ns * 1e-9
+                      , pres->send.polls
+                        ? pres->send.poll_ns * 1e-3 / pres->send.polls
+                        : 0.0
+                      , pres->write_cpu, pres->write_ns * 1e-9
+                      );
+    }
+
+    /* Pacing target, achieved rate, and pacer sleeps */
+    if (send_pacer.rate > 0.0) {
+        fprintf(stderr,"Paced writes at %.1f chars/s (burst %.0f)"
+                       "; achieved %.1f chars/s"
+                       "; sleeps=%lu; slept=%.6fs\n"
+                      , send_pacer.rate, send_pacer.burst
+                      , pres->write_ns
+                        ? pres->sent / (pres->write_ns * 1e-9) : 0.0
+                      , send_pacer.sleeps, send_pacer.sleep_ns * 1e-9
+                      );
+    }
+
+    /* Write latency, gaps between writes, and total time in write(),
+     * always reported for --write-latency
+     */
+    if (pcfg->debug || pcfg->write_latency) {
+        hist_print(stderr, "Write latency", &pres->send.write_ns
+                  , 1e3, "us");
+        hist_print(stderr, "Write gap", &pres->send.gap_ns
+                  , 1e3, "us");
+        fprintf(stderr,"Time in write()=%.6fs of %.6fs elapsed\n"
+                      , pres->send.write_total_ns * 1e-9
+                      , pres->write_ns * 1e-9
+                      );
+    }
+
+    /* Wait for reader to report how many characters were read */
+    if (pcfg->fork_reader)
+    {
+        pRECVSTATUS pbuf = &pres->recv;
+        fprintf(stderr,"Waiting for forked reader to"
+                       " finish and send data to pipe ...\n"
+               );
+        if (recv_status_read(fdrdr, pbuf))
+        {
+            perror("Error retrieving reader result from pipe");
+            soak_report_stop(&soak);
+            soak_live_free();
+            close(fdrdr);
+            qsampler_free(&pres->queues);
+            if (ps == &local) { session_close(ps); }
+            return -1;
+        }
+        close(fdrdr);
+        pres->have_recv = 1;
+        soak_report_stop(&soak);
+
+        /* Discard anything the reader did not take, so restoring
+         * settings (TCSETSF2) or closing the TTY does not wait for it
+         */
+        ioctl(fd, TCFLSH, TCIOFLUSH);
+        errno = 0;
+
+        if (pcfg->debug) {
+            fprintf(stderr,"Read %lu chars from [%s]; fd=%d"
+                           "; read-count=%lu; timeouts=%lu"
+                           "; status=%d; errno=%d\n"
+                          , pbuf->count, tty_name, fdrdr
+                          , pbuf->reads, pbuf->timeouts
+                          , (int)pbuf->status, pbuf->m_errno
+                          );
+        }
+
+        /* Reader engine and wakeups per MB, always reported */
+        reader_print(stderr, &pbuf->reader);
+        rt_print(stderr, "reader", &pbuf->rt);
+
+        /* Frames received, always reported for --framed=...; frames
+         * sent are whole, so their count follows from chars sent
+         */
+        if (send_frame_payload)
+        {
+            frame_print(stderr, &pbuf->frames
+                       , send_frame_count(pres->send.sent));
+        }
+        else if (send_pattern)
+        {
+            /* Bit errors and BER, always reported for --pattern=... */
+            ber_print(stderr, send_pattern, &pbuf->ber, pres->sent);
+        }
+        else
+        {
+            /* Byte-exact verification result, always reported */
+            fprintf(stderr,"Verified %lu chars from [%s]"
+                           "; matched=%lu; dropped=%lu; inserted=%lu"
+                           "; corrupted=%lu; resyncs=%lu"
+                          , pbuf->count, tty_name
+                          , pbuf->verify.matched, pbuf->verify.dropped
+                          , pbuf->verify.inserted, pbuf->verify.corrupted
+                          , pbuf->verify.resyncs
+                          );
+            if (VERIFY_NONE == pbuf->verify.first_mismatch)
+            {
+                fprintf(stderr,"; first-mismatch=none\n");
+            }
+            else
+            {
+                fprintf(stderr,"; first-mismatch=%lu\n"
+                              , pbuf->verify.first_mismatch);
+            }
+        }
+
+        /* Latency probes, if any were sent (--probe=...) */
+        if (pres->send.probes_idle || pres->send.probes_load)
+        {
+            probe_print(stderr, &pbuf->probes
+                       , pres->send.probes_idle, pres->send.probes_load);
+        }
+    }
+
+    /* Soak totals, and why writes ended */
+    if (soak_active())
+    {
+        soak_print_total(stderr, pres->write_ns, pres->send.sent
+                        , pres->have_recv ? pres->recv.count : 0
+                        , run_errors(pres), pres->send.eagains
+                        , pres->have_recv ? pres->recv.timeouts : 0);
+    }
+    soak_live_free();
+
+    /* UART counters, from before writes until reader finished */
+    if (pres->have_icount && !icount_get(fd, &icount1))
+    {
+        icount_delta(&pres->icount, &icount1, &icount0);
+        icount_print(stderr, "UART counters (TIOCGICOUNT) during run"
+                    , &pres->icount);
+    }
+    else
+    {
+        pres->have_icount = 0;
+        if (pcfg->debug)
+        {
+            fprintf(stderr,"UART counters (TIOCGICOUNT):  unavailable"
+                           " for [%s]\n", tty_name);
+        }
+    }
+
+    /* TX/RX queue depths, sampled until reader finished */
+    if (pcfg->queue_ns)
+    {
+        qsampler_stop(&pres->queues);
+        qsampler_print(stderr, &pres->queues);
+        if (pres->send.outq_max < 0)
+        {
+            fprintf(stderr,"TX queue at EAGAIN:  none seen\n");
+        }
+        else
+        {
+            fprintf(stderr,"TX queue at EAGAIN:  max=%dch\n"
+                          , pres->send.outq_max);
+        }
+        if (pcfg->queue_dump)
+        {
+            qsampler_dump(pcfg->queue_dump, &pres->queues);
+        }
+        qsampler_free(&pres->queues);
+    }
+
+    /* Startup, phase by phase:  open, config, reader, first bytes */
+    session_print(stderr, ps, pres->t_run, pres->t_reader
+                 , pres->send.first_ns
+                 , pres->have_recv ? pres->recv.first_ns : 0);
+
+    /* Result record, if requested (--results-json=..., etc.) */
+    if (results_json || results_csv) { run_results(pcfg, pres, ps); }
+
+    if (ps == &local) { session_close(ps); }
+    return pres->sent < 0 ? -1 : 0;
+} /* run_test(...) */
+
+#endif/*__RUN_H__*/
@@ -0,0 +1,191 @@
+#ifndef __SESSION_H__
+#define __SESSION_H__
+
+/**********************************************************************/
+/*** Device session:  open a TTY once, for the whole run, configure ***/
+/*** it on that fd, and time each phase of startup                  ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pSESSION       - Struct with the open fd and phase times
+ * session_init(...)           - No device open yet
+ * session_open(...)           - Open TTY (or file) once, read/write
+ * session_configure(...)      - Apply profile to the open fd
+ * session_get(...)            - Image of settings, from the open fd
+ * session_apply(...)          - Apply image to the open fd, timed
+ * session_close(...)          - Close the fd
+ * session_print(...)          - Report startup, phase by phase
+ *
+ * Why
+ * ===
+ * Raw config, speed, creating a file, writing, and the forked reader
+ * each used to open the TTY themselves:  four or five opens and closes
+ * before the first byte.  On USB serial adapters each open and close
+ * can toggle modem lines and re-initialize the adapter.  A session
+ * opens the TTY once, O_RDWR; profile.h configures it on that fd, the
+ * forked reader inherits it, and the writer writes it.
+ *
+ * Startup phases
+ * ==============
+ * open          - open() of the TTY
+ * config        - get settings, build and apply image (one TCSETSF2;
+ *                 raw config, speed and framing together, see profile.h)
+ * reader-ready  - fork of reader, until it reports it is reading
+ * first-out     - until the first write() returns
+ * first-in      - until the reader reads the first bytes
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* profile_configure_fd(...), profile_get(...), profile_apply(...) */
+#include "profile.h"
+/* monotonic_ns() */
+#include "timing.h"
+
+
+/**********************************************************************/
+/* The open fd, and the times of the session's phases */
+typedef struct SESSIONstr
+{
+    char* tty_name;          /* TTY (or file) */
+    int fd;                  /* Open read/write fd, or -1 */
+    uint64_t open_ns;        /* Time in open() */
+    uint64_t config_ns;      /* Time of last configuration */
+} SESSION, *pSESSION;
+
+
+/**********************************************************************/
+/* No device open yet */
+static void
+session_init(pSESSION ps)
+{
+    memset(ps, 0, sizeof *ps);
+    ps->fd = -1;
+}
+
+
+/**********************************************************************/
+/* Open TTY (or file) once, read/write, blocking unless o_nonblock is
+ * O_NONBLOCK; create a file that does not exist
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+session_open(pSESSION ps, char* tty_name, int o_nonblock)
+{
+    uint64_t t0 = monotonic_ns();
+
+    ps->tty_name = tty_name;
+    ps->fd = open(tty_name, O_RDWR | O_NOCTTY | o_nonblock);
+
+    /* Try again if file not in filesystem i.e. create new file */
+    if (0 > ps->fd && ENOENT==errno)
+    {
+        errno = 0;
+        ps->fd = open(tty_name, O_RDWR | O_NOCTTY | o_nonblock | O_CREAT
+                     , 0644);
+    }
+    ps->open_ns = monotonic_ns() - t0;
+    if (0 > ps->fd)
+    {
+        perror(tty_name);
+        errno = 0;
+        return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Apply profile to the open fd, as profile_configure_fd(...), timed
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+session_configure(pSESSION ps, pPROFILE ploaded, int do_raw
+                 , char* speed_token, char* framing, pPROFILE pprof)
+{
+    uint64_t t0 = monotonic_ns();
+    int rtn = profile_configure_fd(ps->fd, ps->tty_name, ploaded, do_raw
+                                  , speed_token, framing, pprof);
+    ps->config_ns = monotonic_ns() - t0;
+    return rtn;
+}
+
+
+/**********************************************************************/
+/* Image of settings, from the open fd
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+session_get(pSESSION ps, pPROFILE pprof)
+{
+    int rtn = profile_get(ps->fd, pprof);
+    errno = 0;
+    return rtn;
+}
+
+
+/**********************************************************************/
+/* Apply image to the open fd, flushing queues, timed
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+session_apply(pSESSION ps, pPROFILE pprof)
+{
+    uint64_t t0 = monotonic_ns();
+    int rtn = profile_apply(ps->fd, pprof, 1);
+    ps->config_ns = monotonic_ns() - t0;
+    return rtn;
+}
+
+
+/**********************************************************************/
+/* Close the fd */
+static void
+session_close(pSESSION ps)
+{
+    if (0 <= ps->fd) { close(ps->fd); }
+    ps->fd = -1;
+}
+
+
+/**********************************************************************/
+/* Report startup, phase by phase, in microseconds:  open and config of
+ * the session, then from t_run (start of a run), reader ready at
+ * t_reader (0 if no reader), first write() returned at t_out, and
+ * first bytes read at t_in (0 if none)
+ */
+static void
+session_print(FILE* f, pSESSION ps, uint64_t t_run, uint64_t t_reader
+             , uint64_t t_out, uint64_t t_in)
+{
+    uint64_t t_ready = t_reader ? t_reader : t_run;
+    uint64_t total = ps->open_ns + ps->config_ns;
+
+    fprintf(f, "Startup [%s]:  open=%.1fus; config=%.1fus"
+             , ps->tty_name, ps->open_ns * 1e-3, ps->config_ns * 1e-3);
+    if (t_reader)
+    {
+        fprintf(f, "; reader-ready=%.1fus", (t_reader - t_run) * 1e-3);
+    }
+    if (t_out > t_ready)
+    {
+        fprintf(f, "; first-out=%.1fus", (t_out - t_ready) * 1e-3);
+        total += t_out - t_run;
+    }
+    if (t_in && t_out > t_ready)
+    {
+        /* N.B. the reader may see the first bytes before write() returns */
+        fprintf(f, "; first-in=%.1fus"
+                 , (double) (int64_t) (t_in - t_out) * 1e-3);
+        if (t_in > t_out) { total += t_in - t_out; }
+    }
+    fprintf(f, "; total=%.1fus\n", total * 1e-3);
+}
+
+#endif/*__SESSION_H__*/
@@ -0,0 +1,466 @@
+#ifndef __SOAK_H__
+#define __SOAK_H__
+
+/**********************************************************************/
+/*** Duration-based soak:  run until a time limit or a signal, with ***/
+/*** interval reports of throughput, errors, EAGAINs and reader lag ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * SOAK_INTERVAL_NS            - Default interval, with --duration=...
+ * SOAK_SLICE_NS               - Longest sleep of reporter, between checks
+ * soak_duration_ns, etc.      - Options and state, set e.g. by main()
+ * typedef ... *pSOAKLIVE      - Struct with counts shared with reader
+ * typedef ... *pSOAKSAMPLE    - Struct with totals at one time
+ * typedef ... *pSOAKREPORT    - Struct with interval reporter state
+ * soak_parse_time(...)        - Parse e.g. 90, 90s, 30m, 8h, 1.5d
+ * soak_active()               - Non-zero for soak (duration or interval)
+ * soak_on_signal(...)         - SIGINT/SIGTERM:  stop writes; twice, die
+ * soak_catch_signals()        - Catch SIGINT/SIGTERM with the above
+ * soak_wake[]                 - Pipe:  wakes reader when writer is done
+ * soak_live_create()          - Map counts shared with forked reader
+ * soak_live_free()            - Unmap them, close wake pipe
+ * soak_live_reader()          - Reader's end of wake pipe
+ * soak_start(...)             - Start clock of run, and deadline
+ * soak_over()                 - Non-zero when writes should stop
+ * soak_writer_done(...)       - Why writes ended; final count to reader
+ * soak_rx_publish(...)        - Publish reader counts to writer
+ * soak_sample(...)            - Totals now, from writer and reader
+ * soak_print_interval(...)    - Report one interval
+ * soak_report_thread(...)     - Reporter loop, in its own thread
+ * soak_report_start(...)      - Start reporter
+ * soak_report_stop(...)       - Stop reporter, report last interval
+ * soak_print_total(...)       - Report totals of whole soak
+ *
+ * Usage
+ * =====
+ * With --duration=..., writes are not limited by a count (unless
+ * --send-count=... is also given):  the writer stops at the deadline,
+ * or at the first SIGINT or SIGTERM; a second signal restores TTY
+ * settings and dies as before (cf. profile_on_signal(...)).  The
+ * forked reader, and the pty loopback forwarder, keep reading after
+ * the first signal, so the tail of the stream is still verified and
+ * the final totals are still reported.
+ *
+ * The writer and the forked reader share one page of counts
+ * (MAP_SHARED | MAP_ANONYMOUS, mapped before the fork), in every run
+ * with a forked reader, not only a soak:  the reader stores its chars
+ * received, errors and stalls after each read, and the writer stores
+ * its final count sent, then sets done, and writes one byte to a pipe
+ * the reader waits on with the TTY, so the reader wakes at once.
+ * Until done, the reader does not know how much will be sent, so it
+ * counts stalls but does not give up on them; after done, it reads
+ * until every char sent is accounted for, or until no more can arrive
+ * (cf. recv_tail_ms(...) in sst.h).  If the writer dies, the pipe's
+ * end of file wakes the reader as well.
+ *
+ * Every --interval=... (default SOAK_INTERVAL_NS with --duration), a
+ * thread in the writer process reports, for that interval, chars sent
+ * and received, and their rates; errors (as counted by the verifier,
+ * frame or pattern checker); EAGAINs; stalls; and reader lag:  chars
+ * written but not yet read, i.e. in kernel or UART buffers or on the
+ * wire, also as time at the interval's receive rate.  A slow decline
+ * of rate, or rise of lag, over hours is the point of a soak.
+ *
+ * All soak counts are 64 bits wide.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* monotonic_ns() */
+#include "timing.h"
+/* profile_on_signal(...) */
+#include "profile.h"
+
+#define SOAK_INTERVAL_NS 10000000000ULL
+#define SOAK_SLICE_NS 100000000ULL
+
+
+/**********************************************************************/
+/* Options and state, set e.g. by main():  duration (--duration=...),
+ * interval between reports (--interval=...), both 0 for no soak; set
+ * by soak_on_signal(...) to stop writes; deadline of current run, and
+ * why its writes ended
+ */
+static uint64_t soak_duration_ns = 0;
+static uint64_t soak_interval_ns = 0;
+static volatile sig_atomic_t soak_stop = 0;
+static uint64_t soak_deadline_ns = 0;
+static const char* soak_ended_by = NULL;
+
+
+/**********************************************************************/
+/* Counts shared by the writer and the forked reader */
+typedef struct SOAKLIVEstr
+{
+    uint64_t sent;           /* Writer:  final count sent, once done */
+    int done;                /* Writer:  non-zero when writes ended */
+    uint64_t received;       /* Reader:  chars received so far */
+    uint64_t errors;         /* Reader:  errors so far */
+    uint64_t stalls;         /* Reader:  waits with no data so far */
+} SOAKLIVE, *pSOAKLIVE;
+
+/* Shared counts, while a run with a forked reader runs, else NULL */
+static pSOAKLIVE soak_live = NULL;
+
+/* Pipe:  the writer writes one byte to [1] when done; the reader
+ * waits on [0]; -1 when closed
+ */
+static int soak_wake[2] = { -1, -1 };
+
+
+/**********************************************************************/
+/* Totals at one time */
+typedef struct SOAKSAMPLEstr
+{
+    uint64_t t_ns;           /* Time since start of run */
+    uint64_t sent;
+    uint64_t received;
+    uint64_t errors;
+    uint64_t eagains;
+    uint64_t stalls;
+} SOAKSAMPLE, *pSOAKSAMPLE;
+
+
+/**********************************************************************/
+/* Interval reporter state */
+typedef struct SOAKREPORTstr
+{
+    FILE* f;
+    uint64_t* psent;         /* Writer's count sent so far (atomic) */
+    uint64_t* peagains;      /* Writer's count of EAGAINs (atomic) */
+    uint64_t t0_ns;          /* Start of run */
+    uint64_t interval_ns;
+    SOAKSAMPLE last;         /* Totals at end of last interval */
+    uint64_t intervals;      /* Count of intervals reported */
+    pthread_t thread;
+    int running;             /* Non-zero while thread exists */
+    volatile int stop;       /* Set to stop thread */
+} SOAKREPORT, *pSOAKREPORT;
+
+
+/**********************************************************************/
+/* Parse time, e.g. 90 or 90s (seconds), 30m, 8h, 1.5d, into ns
+ * Return value:  ns; 0 on failure
+ */
+static uint64_t
+soak_parse_time(char* arg)
+{
+    double v;
+    char unit = 's';
+    char extra;
+    int n = sscanf(arg, "%lf%c%c", &v, &unit, &extra);
+
+    if (n < 1 || n > 2 || !(v > 0.0)) { return 0; }
+    switch (unit)
+    {
+    case 's': break;
+    case 'm': v *= 60.0; break;
+    case 'h': v *= 3600.0; break;
+    case 'd': v *= 86400.0; break;
+    default:  return 0;
+    }
+    return (uint64_t) (v * 1e9);
+}
+
+
+/**********************************************************************/
+/* Non-zero for a soak:  --duration=... or --interval=... */
+static int
+soak_active()
+{
+    return soak_duration_ns || soak_interval_ns;
+}
+
+
+/**********************************************************************/
+/* SIGINT/SIGTERM:  the first stops writes (cf. soak_over()), the
+ * second restores TTY settings and dies (cf. profile_on_signal(...))
+ */
+static void
+soak_on_signal(int sig)
+{
+    if (soak_stop) { profile_on_signal(sig); }
+    soak_stop = 1;
+}
+
+
+/**********************************************************************/
+/* Catch SIGINT/SIGTERM with soak_on_signal(...); restart interrupted
+ * syscalls, so a write() is not cut short by a stop.  Call after
+ * profile_keep_original(...), which installs its own handler, and
+ * before forking, so the forked reader keeps reading after a stop
+ */
+static void
+soak_catch_signals()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = soak_on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+
+/**********************************************************************/
+/* Map counts shared with forked reader, as soak_live, and open wake
+ * pipe; call before the reader is forked
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+soak_live_create()
+{
+    void* p = mmap(NULL, sizeof(SOAKLIVE), PROT_READ | PROT_WRITE
+                  , MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == p)
+    {
+        perror("soak_live_create=>mmap");
+        return -1;
+    }
+    if (pipe(soak_wake))
+    {
+        perror("soak_live_create=>pipe");
+        munmap(p, sizeof(SOAKLIVE));
+        soak_wake[0] = soak_wake[1] = -1;
+        return -1;
+    }
+    soak_live = (pSOAKLIVE) p;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Unmap counts shared with forked reader, and close wake pipe */
+static void
+soak_live_free()
+{
+    if (soak_live) { munmap(soak_live, sizeof(SOAKLIVE)); }
+    soak_live = NULL;
+    if (0 <= soak_wake[0]) { close(soak_wake[0]); }
+    if (0 <= soak_wake[1]) { close(soak_wake[1]); }
+    soak_wake[0] = soak_wake[1] = -1;
+}
+
+
+/**********************************************************************/
+/* In the forked reader:  close writer's end of wake pipe, so the
+ * writer's exit is end of file
+ * Return value:  reader's end, or -1 if none
+ */
+static int
+soak_live_reader()
+{
+    if (0 <= soak_wake[1]) { close(soak_wake[1]); }
+    soak_wake[1] = -1;
+    return soak_wake[0];
+}
+
+
+/**********************************************************************/
+/* Start clock of run at t0, and deadline if --duration=... */
+static void
+soak_start(uint64_t t0)
+{
+    soak_deadline_ns = soak_duration_ns ? t0 + soak_duration_ns : 0;
+    soak_ended_by = NULL;
+}
+
+
+/**********************************************************************/
+/* Non-zero when writes should stop:  deadline passed, or signal */
+static inline int
+soak_over()
+{
+    if (soak_stop) { return 1; }
+    return soak_deadline_ns && monotonic_ns() >= soak_deadline_ns;
+}
+
+
+/**********************************************************************/
+/* Note why writes ended; publish final count sent to forked reader,
+ * then done, and wake it
+ */
+static void
+soak_writer_done(uint64_t sent)
+{
+    soak_ended_by = soak_stop ? "stopped by signal"
+                  : (soak_deadline_ns && monotonic_ns() >= soak_deadline_ns)
+                  ? "duration reached" : "count reached";
+    if (!soak_live) { return; }
+    __atomic_store_n(&soak_live->sent, sent, __ATOMIC_RELAXED);
+    __atomic_store_n(&soak_live->done, 1, __ATOMIC_RELEASE);
+    if (0 <= soak_wake[1])
+    {
+        char done = 1;
+        if (1 != write(soak_wake[1], &done, 1)) { errno = 0; }
+    }
+}
+
+
+/**********************************************************************/
+/* Publish reader counts to writer, after each read */
+static inline void
+soak_rx_publish(uint64_t received, uint64_t errors, uint64_t stalls)
+{
+    if (!soak_live) { return; }
+    __atomic_store_n(&soak_live->received, received, __ATOMIC_RELAXED);
+    __atomic_store_n(&soak_live->errors, errors, __ATOMIC_RELAXED);
+    __atomic_store_n(&soak_live->stalls, stalls, __ATOMIC_RELAXED);
+}
+
+
+/**********************************************************************/
+/* Totals now, from writer and reader, into *ps */
+static void
+soak_sample(pSOAKREPORT pr, pSOAKSAMPLE ps)
+{
+    ps->t_ns = monotonic_ns() - pr->t0_ns;
+    ps->sent = __atomic_load_n(pr->psent, __ATOMIC_RELAXED);
+    ps->eagains = __atomic_load_n(pr->peagains, __ATOMIC_RELAXED);
+    ps->received = ps->errors = ps->stalls = 0;
+    if (!soak_live) { return; }
+    ps->received = __atomic_load_n(&soak_live->received, __ATOMIC_RELAXED);
+    ps->errors = __atomic_load_n(&soak_live->errors, __ATOMIC_RELAXED);
+    ps->stalls = __atomic_load_n(&soak_live->stalls, __ATOMIC_RELAXED);
+}
+
+
+/**********************************************************************/
+/* Report one interval, from totals at its start (pa) to its end (pb) */
+static void
+soak_print_interval(FILE* f, pSOAKSAMPLE pa, pSOAKSAMPLE pb)
+{
+    double dt = (pb->t_ns - pa->t_ns) * 1e-9;
+    double rx_rate = dt > 0.0 ? (pb->received - pa->received) / dt : 0.0;
+    uint64_t lag = pb->sent > pb->received ? pb->sent - pb->received : 0;
+
+    fprintf(f, "Interval [%8.1f-%8.1fs]:  sent=%llu (%.1f chars/s)"
+               "; received=%llu (%.1f chars/s); errors=%llu; eagains=%llu"
+               "; stalls=%llu; lag=%llu chars"
+             , pa->t_ns * 1e-9, pb->t_ns * 1e-9
+             , (unsigned long long) (pb->sent - pa->sent)
+             , dt > 0.0 ? (pb->sent - pa->sent) / dt : 0.0
+             , (unsigned long long) (pb->received - pa->received), rx_rate
+             , (unsigned long long) (pb->errors - pa->errors)
+             , (unsigned long long) (pb->eagains - pa->eagains)
+             , (unsigned long long) (pb->stalls - pa->stalls)
+             , (unsigned long long) lag);
+    if (rx_rate > 0.0) { fprintf(f, " (%.1fms)", 1e3 * lag / rx_rate); }
+    fprintf(f, "\n");
+    fflush(f);
+}
+
+
+/**********************************************************************/
+/* Reporter loop, in its own thread:  sleep to each absolute deadline,
+ * in slices so a stop is seen promptly, then report the interval
+ */
+static void*
+soak_report_thread(void* arg)
+{
+    pSOAKREPORT pr = (pSOAKREPORT) arg;
+    uint64_t deadline = pr->t0_ns + pr->interval_ns;
+    struct timespec ts;
+    SOAKSAMPLE now;
+
+    while (!pr->stop)
+    {
+        uint64_t t = monotonic_ns();
+        uint64_t wake;
+
+        if (t >= deadline)
+        {
+            soak_sample(pr, &now);
+            soak_print_interval(pr->f, &pr->last, &now);
+            pr->last = now;
+            ++pr->intervals;
+            while (deadline <= t) { deadline += pr->interval_ns; }
+            continue;
+        }
+        wake = deadline - t > SOAK_SLICE_NS ? t + SOAK_SLICE_NS : deadline;
+        ts.tv_sec = wake / 1000000000ULL;
+        ts.tv_nsec = wake % 1000000000ULL;
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME
+                                       , &ts, 0)) ;
+    }
+    return NULL;
+}
+
+
+/**********************************************************************/
+/* Start reporter of writer's counts psent and peagains, and of the
+ * reader's via soak_live, every interval_ns from t0
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+soak_report_start(pSOAKREPORT pr, FILE* f, uint64_t* psent
+                 , uint64_t* peagains, uint64_t t0, uint64_t interval_ns)
+{
+    int rtn;
+
+    memset(pr, 0, sizeof *pr);
+    pr->f = f;
+    pr->psent = psent;
+    pr->peagains = peagains;
+    pr->t0_ns = t0;
+    pr->interval_ns = interval_ns;
+    if ((rtn = pthread_create(&pr->thread, NULL, soak_report_thread, pr)))
+    {
+        errno = rtn;
+        perror("soak_report_start=>pthread_create");
+        return -1;
+    }
+    pr->running = 1;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Stop reporter; report the last, partial, interval, if any */
+static void
+soak_report_stop(pSOAKREPORT pr)
+{
+    SOAKSAMPLE now;
+
+    if (!pr->running) { return; }
+    pr->stop = 1;
+    pthread_join(pr->thread, NULL);
+    pr->running = 0;
+    soak_sample(pr, &now);
+    if (now.t_ns > pr->last.t_ns + SOAK_SLICE_NS)
+    {
+        soak_print_interval(pr->f, &pr->last, &now);
+        ++pr->intervals;
+    }
+}
+
+
+/**********************************************************************/
+/* Report totals of whole soak:  time of writes, and why they ended */
+static void
+soak_print_total(FILE* f, uint64_t write_ns, uint64_t sent
+                , uint64_t received, uint64_t errors, uint64_t eagains
+                , uint64_t stalls)
+{
+    double dt = write_ns * 1e-9;
+    fprintf(f, "Soak total [%.1fs, %s]:  sent=%llu (%.1f chars/s)"
+               "; received=%llu; errors=%llu; eagains=%llu; stalls=%llu\n"
+             , dt, soak_ended_by ? soak_ended_by : "writes failed"
+             , (unsigned long long) sent, dt > 0.0 ? sent / dt : 0.0
+             , (unsigned long long) received, (unsigned long long) errors
+             , (unsigned long long) eagains, (unsigned long long) stalls);
+}
+
+#endif/*__SOAK_H__*/
@@ -4,16 +4,32 @@
  *
  * This program comprises four steps:
  * - Parse command-line arguments;
- * - Configure TTY for raw data;
- * - Configure TTY speed;
- * - Write test array data.
+ * - Open TTY once for the whole run (see session.h), and configure it
+ *   for raw data, speed and framing, with one ioctl (see profile.h),
+ *   restoring its settings on exit;
+ * - Write test array data, and optionally read and verify those data
+ *   in a forked reader;
+ *   - or, instead of the last two steps, sweep TTY speeds and repeat
+ *     the last step at each speed;
+ *   - or, for several TTYs, configure and test all of them at once;
+ *   - or, for two cross-connected TTYs, test both directions at once.
  */
+/* For memfd_create(...) in ring.h, ptsname_r(...) in ptyloop.h */
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <stdlib.h>
 
 /* Most logic is in one of these header files as static routines */
 #include "raw_settings.h"
 #include "sst.h"
+#include "run.h"
+#include "sweep.h"
+#include "multiport.h"
+#include "duplex.h"
+#include "ptyloop.h"
+#include "profile.h"
+#include "session.h"
 
 int
 main(int argc, char** argv)
@@ -25,10 +41,36 @@ main(int argc, char** argv)
     size_t send_count = 0;
     int debug = 0;
     int o_nonblock = 0;
-    size_t tries;
-    size_t eagains;
     int fork_reader = 0;
     char* pbaudrate = NULL;
+    size_t write_chunk = 0;
+    int write_ring = 0;
+    int write_latency = 0;
+    double rate = 0.0;
+    double rate_pct = 0.0;
+    double rate_burst = 0.0;
+    uint64_t queue_ns = 0;
+    char* queue_dump = NULL;
+    int do_sweep = 0;
+    SWEEP sweep;
+    RUNCONFIG run_cfg;
+    char* tty_specs[MPORT_MAX];
+    size_t ntty_specs = 0;
+    int multi = 0;
+    static MPORTSET mports;
+    char* duplex_spec = NULL;
+    int duplex_baseline = 0;
+    char* loopback_spec = NULL;
+    PTYLOOP loopback;
+    char* framing = NULL;
+    char* profile_in = NULL;
+    char* profile_out = NULL;
+    int keep_tty_settings = 0;
+    PROFILE prof;
+    SESSION session;
+    int rtn = 0;
+
+    sweep_init(&sweep);
 
     /******************************************************************/
     /* Parse command-line arguments */
@@ -64,6 +106,34 @@ main(int argc, char** argv)
             fclose(f);
         }
 
+        /* Decode last events of a flight recorder file to STDOUT, e.g.
+         * after a crash or reboot; see flightrec.h
+         * --flight-dump=sst.flight           -> last 50 events
+         * --flight-dump=sst.flight,last=500  -> last 500 events
+         */
+        else if (!strncmp(arg,"--flight-dump=", 14) && arg[14])
+        {
+            if (flightrec_dump(stdout, arg + 14))
+            {
+                fprintf(stderr,"ERROR:  bad flight dump [%s]\n", arg);
+            }
+        }
+
+        /* Record TOHERE(I) events of writer and reader, into a file
+         * that survives a crash or reboot; see flightrec.h
+         * --flight-recorder=sst.flight
+         * --flight-recorder=sst.flight,records=1048576,sync-ms=20
+         * N.B. default is 65536 records, synced every 100ms
+         */
+        else if (!strncmp(arg,"--flight-recorder=", 18))
+        {
+            if (flightrec_parse(arg + 18))
+            {
+                fprintf(stderr,"ERROR:  bad flight recorder [%s]\n", arg);
+                continue;
+            }
+        }
+
         /* Name of typical TTY device in filesystem to which to write
          * --tty=/dev/tty*
          * E.g. --tty=/dev/ttyTHS0 or --tty=/dev/ttyUSB0
@@ -73,6 +143,8 @@ main(int argc, char** argv)
         else if (!strncmp(arg,"--tty=/dev/tty", 14))
         {
             tty_name = arg + 6;
+            if (ntty_specs < MPORT_MAX) { tty_specs[ntty_specs] = tty_name; }
+            ++ntty_specs;
         }
 
         /* Name of non-typical TTY device (or file) to which to write
@@ -81,6 +153,55 @@ main(int argc, char** argv)
         else if (!strncmp(arg,"--non-standard-tty=", 19))
         {
             tty_name = arg + 19;
+            if (ntty_specs < MPORT_MAX) { tty_specs[ntty_specs] = tty_name; }
+            ++ntty_specs;
+        }
+
+        /* Test several TTYs at once, in this process, each given by a
+         * --tty=... or --non-standard-tty=... option of the form
+         *   PATH[,speed=S][,count=N]
+         * with speed and count defaulting to --speed=... and
+         * --send-count=...; each port is written and read, and
+         * verified, with a thread per port, or in one event loop
+         * --multi=threads  (default when more than one TTY is given)
+         * --multi=poll
+         */
+        else if (!strcmp(arg,"--multi=threads"))
+        {
+            multi = 1;
+        }
+        else if (!strcmp(arg,"--multi=poll"))
+        {
+            multi = 2;
+        }
+
+        /* Test two TTYs wired to each other (TX to RX each way), or a
+         * pty pair, in both directions at once, each direction with its
+         * own writer and verifier; with --duplex-baseline, first run
+         * each direction alone, and report the reverse stream's cost
+         * --duplex=PATH_A,PATH_B
+         * --duplex=pty
+         * --duplex-baseline
+         */
+        else if (!strncmp(arg,"--duplex=", 9))
+        {
+            duplex_spec = arg + 9;
+        }
+        else if (!strcmp(arg,"--duplex-baseline"))
+        {
+            duplex_baseline = 1;
+        }
+
+        /* Test a built-in pty loopback instead of a TTY:  the forked
+         * forwarder writes back what is written, dropping, corrupting,
+         * inserting, or delaying bytes at the given rates (cf. ptyloop.h)
+         * --loopback=pty
+         * --loopback=pty,baud=4M,drop=1e-5,corrupt=1e-5,insert=1e-5
+         * --loopback=pty,delay=1e-6,delay-us=2000,burst=8,seed=7
+         */
+        else if (!strncmp(arg,"--loopback=", 11))
+        {
+            loopback_spec = arg + 11;
         }
 
         /* How many characters to send
@@ -97,6 +218,67 @@ main(int argc, char** argv)
             send_count = ct;
         }
 
+        /* Append a result record of each run (each sweep step) to a
+         * file, as one JSON line, or as one CSV row (with a header row
+         * if the file is empty); see results.h
+         * --results-json=runs.jsonl
+         * --results-csv=runs.csv
+         */
+        else if (!strncmp(arg,"--results-json=", 15) && arg[15])
+        {
+            results_json = arg + 15;
+        }
+        else if (!strncmp(arg,"--results-csv=", 14) && arg[14])
+        {
+            results_csv = arg + 14;
+        }
+
+        /* Soak:  write until a time limit, or SIGINT/SIGTERM, with a
+         * report every interval; see soak.h
+         * --duration=8h        (s, m, h or d; default seconds)
+         * --interval=60        (default 10s with --duration)
+         * N.B. --send-count=N, if also given, still limits the writes;
+         *      the first SIGINT/SIGTERM stops writes, the second exits
+         */
+        else if (!strncmp(arg,"--duration=", 11)
+                || !strncmp(arg,"--interval=", 11)
+                )
+        {
+            uint64_t ns = soak_parse_time(arg+11);
+            if (!ns)
+            {
+                fprintf(stderr,"ERROR:  bad time [%s]\n", arg);
+                continue;
+            }
+            if ('d'==arg[2]) { soak_duration_ns = ns; }
+            else             { soak_interval_ns = ns; }
+        }
+
+        /* Write precomputed cycle of lines in chunks of up to N chars
+         * --write-chunk=65536
+         * N.B. Default is to write one line per write()
+         */
+        else if (!strncmp(arg,"--write-chunk=", 14))
+        {
+            unsigned long ct;
+            if (1 != sscanf(arg+14,"%lu",&ct) || !ct)
+            {
+                fprintf(stderr,"ERROR:  bad write chunk [%s]\n", arg);
+                continue;
+            }
+            write_chunk = ct;
+        }
+
+        /* Write chunks from a memfd ring mapped twice, back-to-back,
+         * so any chunk is one contiguous write with no wrap or copy
+         * --write-ring
+         * N.B. Implies --write-chunk=65536 if --write-chunk is absent
+         */
+        else if (!strcmp(arg,"--write-ring"))
+        {
+            write_ring = 1;
+        }
+
         /* Set TTY speed (baudrate)
          * --speed=12.5M
          * --baud=12500000
@@ -141,6 +323,47 @@ main(int argc, char** argv)
             do_raw_config = 1;
         }
 
+        /* Set TTY framing:  data bits, parity (N/E/O/M/S), stop bits
+         * --framing=8N1
+         * N.B. Default is to leave framing as is, or as --do-raw-config
+         */
+        else if (!strncmp(arg,"--framing=", 10))
+        {
+            PROFILE test;
+            memset(&test, 0, sizeof test);
+            if (profile_set_framing(&test, arg+10))
+            {
+                fprintf(stderr,"ERROR:  bad framing [%s]\n", arg);
+                continue;
+            }
+            framing = arg + 10;
+        }
+
+        /* Apply a saved termios2 profile (see profile.h) to the TTY, in
+         * place of raw config, speed and framing; or save the profile
+         * applied, after raw config, speed and framing
+         * --profile-load=ttyS0-4M.sstp
+         * --profile-save=ttyS0-4M.sstp
+         */
+        else if (!strncmp(arg,"--profile-load=", 15))
+        {
+            profile_in = arg + 15;
+        }
+        else if (!strncmp(arg,"--profile-save=", 15))
+        {
+            profile_out = arg + 15;
+        }
+
+        /* Leave TTY settings as sst set them at exit
+         * --keep-tty-settings
+         * N.B. Default is to restore the settings the TTY had at start,
+         *      on exit or on SIGINT/SIGTERM, if sst changed them
+         */
+        else if (!strcmp(arg,"--keep-tty-settings"))
+        {
+            keep_tty_settings = 1;
+        }
+
         /* Open the tty non-blocking
          * --open-non-blocking
          * N.B. Default is to open for blocking
@@ -150,6 +373,149 @@ main(int argc, char** argv)
             o_nonblock = O_NONBLOCK;
         }
 
+        /* Wait for POLLOUT after EAGAIN, instead of busy-spinning
+         * --poll-writer
+         * N.B. Only affects writes with --open-non-blocking
+         */
+        else if (!strcmp(arg,"--poll-writer"))
+        {
+            send_poll_out = 1;
+        }
+
+        /* Report write() latency and gap histograms
+         * --write-latency
+         */
+        else if (!strcmp(arg,"--write-latency"))
+        {
+            write_latency = 1;
+        }
+
+        /* Pace writes with a token bucket, at a rate in chars/s, or in
+         * percent of configured baud rate (from TTY bits/char)
+         * --rate=250000
+         * --rate=90%
+         * --rate-burst=4096    (bucket depth, chars; default 10ms)
+         * N.B. Default is to write as fast as the TTY accepts
+         */
+        else if (!strncmp(arg,"--rate=", 7))
+        {
+            double r;
+            char pct = 0;
+            if (1 > sscanf(arg+7,"%lf%c",&r,&pct) || r <= 0.0
+             || (pct && '%'!=pct))
+            {
+                fprintf(stderr,"ERROR:  bad rate [%s]\n", arg);
+                continue;
+            }
+            if (pct) { rate_pct = r; rate = 0.0; }
+            else     { rate = r; rate_pct = 0.0; }
+        }
+        else if (!strncmp(arg,"--rate-burst=", 13))
+        {
+            if (1 != sscanf(arg+13,"%lf",&rate_burst) || rate_burst < 1.0)
+            {
+                fprintf(stderr,"ERROR:  bad rate burst [%s]\n", arg);
+                rate_burst = 0.0;
+                continue;
+            }
+        }
+
+        /* Sample TX (TIOCOUTQ) and RX (TIOCINQ) kernel queue depths in
+         * a background thread, every USEC microseconds (default 1000),
+         * and report percentiles, and the largest TX queue at EAGAIN
+         * --queue-sample
+         * --queue-sample=250
+         * --queue-sample-dump=queues.txt  (last 65536 samples)
+         */
+        else if (!strcmp(arg,"--queue-sample")
+                || !strncmp(arg,"--queue-sample=", 15)
+                )
+        {
+            unsigned long us = 1000;
+            if (arg[14] && (1 != sscanf(arg+15,"%lu",&us) || !us))
+            {
+                fprintf(stderr,"ERROR:  bad queue sample interval [%s]\n"
+                              , arg);
+                continue;
+            }
+            queue_ns = us * 1000;
+        }
+        else if (!strncmp(arg,"--queue-sample-dump=", 20))
+        {
+            queue_dump = arg + 20;
+            if (!queue_ns) { queue_ns = 1000000; }
+        }
+
+        /* Insert timestamped latency probe frames between writes, one
+         * every USEC microseconds (default 1000); the forked reader
+         * removes them before verifying, and reports latencies
+         * --probe
+         * --probe=10000
+         * --probe-idle=100   (probes on idle line, before the stream)
+         */
+        else if (!strcmp(arg,"--probe")
+                || !strncmp(arg,"--probe=", 8)
+                )
+        {
+            unsigned long us = 1000;
+            if (arg[7] && (1 != sscanf(arg+8,"%lu",&us) || !us))
+            {
+                fprintf(stderr,"ERROR:  bad probe interval [%s]\n", arg);
+                continue;
+            }
+            send_probe_ns = us * 1000;
+        }
+        else if (!strncmp(arg,"--probe-idle=", 13))
+        {
+            unsigned long ct;
+            if (1 != sscanf(arg+13,"%lu",&ct))
+            {
+                fprintf(stderr,"ERROR:  bad idle probe count [%s]\n", arg);
+                continue;
+            }
+            send_probe_idle = ct;
+        }
+
+        /* Write sequence-numbered frames with CRC32C, with PAYLOAD
+         * chars of payload each (default 240), instead of the sawtooth
+         * stream; the forked reader reports missing, duplicated and
+         * corrupted frame ranges
+         * --framed
+         * --framed=1000
+         * N.B. --send-count=N is rounded up to whole frames
+         */
+        else if (!strcmp(arg,"--framed")
+                || !strncmp(arg,"--framed=", 9)
+                )
+        {
+            unsigned long ct = 240;
+            if (arg[8] && (1 != sscanf(arg+9,"%lu",&ct)
+                          || !ct || ct > FRAME_MAXPAYLOAD))
+            {
+                fprintf(stderr,"ERROR:  bad frame payload [%s]\n", arg);
+                continue;
+            }
+            send_frame_payload = ct;
+        }
+
+        /* Write a PRBS (ITU-T O.150 polynomials) or fixed stress pattern
+         * instead of the sawtooth stream; the forked reader locks onto
+         * it by itself, and reports bit errors and BER
+         * --pattern=prbs7|prbs15|prbs23|prbs31
+         * --pattern=alt|runs|bytes
+         * --pattern=sawtooth  (default)
+         */
+        else if (!strncmp(arg,"--pattern=", 10))
+        {
+            int kind = pat_lookup(arg+10);
+            if (kind < 0)
+            {
+                fprintf(stderr,"ERROR:  unknown pattern [%s]\n", arg);
+                continue;
+            }
+            send_pattern = kind;
+        }
+
         /* Fork a reader of the data
          * --fork-reader
          * N.B. Default is to not fork a reader
@@ -159,6 +525,169 @@ main(int argc, char** argv)
             fork_reader = 1;
         }
 
+        /* Forked reader engine (see reader.h):  sleep in epoll, or
+         * busy-poll read() with VMIN=0 and VTIME=0
+         * --reader=epoll
+         * --reader=busy
+         * --reader=uring       (one read in flight on io_uring)
+         * N.B. Default is epoll
+         */
+        else if (!strncmp(arg,"--reader=", 9))
+        {
+            if (!strcmp(arg+9, "epoll"))      { recv_engine = READER_EPOLL; }
+            else if (!strcmp(arg+9, "busy"))  { recv_engine = READER_BUSY; }
+            else if (!strcmp(arg+9, "uring")) { recv_engine = READER_URING; }
+            else
+            {
+                fprintf(stderr,"ERROR:  bad reader engine [%s]\n", arg);
+                continue;
+            }
+        }
+
+        /* io_uring backend (see uring.h):  the writer keeps up to DEPTH
+         * linked writes in flight, and the reader uses --reader=uring
+         * --io=uring
+         * --io=uring,depth=8   (default URING_DEPTH)
+         * N.B. Default is one write() or read() syscall per chunk; the
+         *      writer of --framed=... or --pattern=... keeps write()
+         */
+        else if (!strncmp(arg,"--io=uring", 10)
+                && (!arg[10] || !strncmp(arg+10, ",depth=", 7))
+                )
+        {
+            unsigned depth = URING_DEPTH;
+            if (arg[10] && (1 != sscanf(arg+17,"%u",&depth)
+                           || !depth || depth > URING_MAX))
+            {
+                fprintf(stderr,"ERROR:  bad io_uring depth [%s]\n", arg);
+                continue;
+            }
+            send_uring_depth = depth;
+            recv_engine = READER_URING;
+        }
+
+        /* Forked reader buffer size, chars per read()
+         * --read-buffer=65536
+         * N.B. Default is READER_BUFFER (see reader.h)
+         */
+        else if (!strncmp(arg,"--read-buffer=", 14))
+        {
+            unsigned long ct;
+            if (1 != sscanf(arg+14,"%lu",&ct) || !ct)
+            {
+                fprintf(stderr,"ERROR:  bad read buffer [%s]\n", arg);
+                continue;
+            }
+            recv_buffer = ct;
+        }
+
+        /* VMIN and VTIME (tenths of a second) for the forked reader,
+         * to batch chars per wakeup (see reader.h)
+         * --vmin=64
+         * --vtime=1
+         * N.B. Default is to leave them as configured (raw config:
+         *      VMIN=1, VTIME=0)
+         */
+        else if (!strncmp(arg,"--vmin=", 7)
+                || !strncmp(arg,"--vtime=", 8)
+                )
+        {
+            char* pval = arg + ('m'==arg[3] ? 7 : 8);
+            int val;
+            if (1 != sscanf(pval,"%d",&val) || val < 0 || val > 255)
+            {
+                fprintf(stderr,"ERROR:  bad VMIN or VTIME [%s]\n", arg);
+                continue;
+            }
+            if ('m'==arg[3]) { recv_vmin = val; }
+            else             { recv_vtime = val; }
+        }
+
+        /* Scheduling policy and priority, and CPU to pin to, for the
+         * writer (during its writes) or the forked reader; see rtsched.h
+         * --rt-writer=fifo,prio=80,cpu=2
+         * --rt-reader=rr,cpu=3
+         * --rt-reader=other,cpu=3    (pin only)
+         * N.B. Default is to leave both as started; priority defaults
+         *      to RT_PRIO
+         */
+        else if (!strncmp(arg,"--rt-writer=", 12)
+                || !strncmp(arg,"--rt-reader=", 12)
+                )
+        {
+            if (rt_parse(arg+12, 'w'==arg[5] ? &rt_writer : &rt_reader))
+            {
+                fprintf(stderr,"ERROR:  bad scheduling spec [%s]\n", arg);
+                continue;
+            }
+        }
+
+        /* Lock all memory of writer and forked reader, mlockall(), and
+         * prefault stack
+         * --mlock
+         */
+        else if (!strcmp(arg,"--mlock"))
+        {
+            rt_mlock = 1;
+        }
+
+        /* Sweep TTY speeds, upward, from the speeds[] table in
+         * stty_info.h, and report the highest speed with no errors;
+         * stop at the first errors, reader stall, or short write
+         * --sweep
+         * --sweep-min=115200   (lowest speed to try; default lowest)
+         * --sweep-max=4M       (highest speed to try; default 4M)
+         * N.B. Implies --fork-reader; --send-count=N is chars per step
+         */
+        else if (!strcmp(arg,"--sweep"))
+        {
+            do_sweep = 1;
+        }
+        else if (!strncmp(arg,"--sweep-min=", 12)
+                || !strncmp(arg,"--sweep-max=", 12)
+                )
+        {
+            unsigned long baud = parse_speed_value(arg+12);
+            if (!baud)
+            {
+                fprintf(stderr,"ERROR:  bad sweep speed [%s]\n", arg);
+                continue;
+            }
+            if ('i'==arg[9]) { sweep.min = baud; }
+            else             { sweep.max = baud; }
+        }
+
+        /* Search any speeds (BOTHER) from a known-clean LO up to HI:
+         * ramp up by doubling until the first warning, then bisect
+         * between the highest clean and lowest warning speeds
+         * --sweep-search=115200:3M
+         * --sweep-resolution=10000  (bisection step; default 1%)
+         * N.B. Implies --sweep; HI is also limited by --sweep-max
+         */
+        else if (!strncmp(arg,"--sweep-search=", 15))
+        {
+            char* colon = strchr(arg+15, ':');
+            if (colon) { *colon = '\0'; }
+            sweep.lo = parse_speed_value(arg+15);
+            sweep.hi = colon ? parse_speed_value(colon+1) : 0;
+            if (colon) { *colon = ':'; }
+            if (!sweep.lo || !sweep.hi)
+            {
+                fprintf(stderr,"ERROR:  bad sweep search [%s]\n", arg);
+                sweep.lo = sweep.hi = 0;
+                continue;
+            }
+            do_sweep = 1;
+        }
+        else if (!strncmp(arg,"--sweep-resolution=", 19))
+        {
+            if (!(sweep.resolution = parse_speed_value(arg+19)))
+            {
+                fprintf(stderr,"ERROR:  bad sweep resolution [%s]\n", arg);
+                continue;
+            }
+        }
+
         else
         {
            fprintf(stderr, "FAILED, Unknown option:  [%s]\n", arg);
@@ -167,108 +696,246 @@ main(int argc, char** argv)
     } /* for (iarg=1; iarg<argc; ++iarg) - Parse command-line */
 
 
+    /* Frames and patterns replace the same stream */
+    if (send_frame_payload && send_pattern)
+    {
+        fprintf(stderr,"ERROR:  --pattern=... ignored with --framed\n");
+        send_pattern = PAT_SAWTOOTH;
+    }
+
+    /* Probe bytes may occur in frames and patterns, so they exclude
+     * probes
+     */
+    if ((send_frame_payload || send_pattern)
+     && (send_probe_ns || send_probe_idle))
+    {
+        fprintf(stderr,"ERROR:  --probe... ignored with --%s\n"
+                      , send_frame_payload ? "framed" : "pattern=...");
+        send_probe_ns = 0;
+        send_probe_idle = 0;
+    }
+
+    /* Frames are numbered, so do not repeat, and have no ring */
+    if (send_frame_payload && write_ring)
+    {
+        fprintf(stderr,"ERROR:  --write-ring ignored with --framed\n");
+        write_ring = 0;
+    }
+
+    /* A soak has no count, unless one is given, and reports every
+     * SOAK_INTERVAL_NS, unless another interval is given
+     */
+    if (soak_duration_ns)
+    {
+        if (!send_count) { send_count = SIZE_MAX; }
+        if (!soak_interval_ns) { soak_interval_ns = SOAK_INTERVAL_NS; }
+    }
+
+    /* Default chunk size for --write-ring */
+    if (write_ring && !write_chunk) { write_chunk = 65536; }
+
+    /* Options for each test run */
+    memset(&run_cfg, 0, sizeof run_cfg);
+    run_cfg.tty_name = tty_name;
+    run_cfg.send_count = send_count;
+    run_cfg.o_nonblock = o_nonblock;
+    run_cfg.fork_reader = fork_reader;
+    run_cfg.write_chunk = write_chunk;
+    run_cfg.write_ring = write_ring;
+    run_cfg.write_latency = write_latency;
+    run_cfg.rate = rate;
+    run_cfg.rate_pct = rate_pct;
+    run_cfg.rate_burst = rate_burst;
+    run_cfg.queue_ns = queue_ns;
+    run_cfg.queue_dump = queue_dump;
+    run_cfg.debug = debug;
+    run_cfg.nominal_baud = do_sweep ? 0 : parse_speed_value(pbaudrate);
+
+
     /******************************************************************/
-    /* Configure TTY for raw data, if requested (--do-raw-config) */
-    if (tty_name && do_raw_config)
+    /* Test two cross-connected TTYs, or a pty pair, in both directions
+     * at once, if requested (--duplex=...)
+     */
+    if (duplex_spec)
     {
-        if (!stty_raw_config(tty_name, (char*)NULL) && debug)
+        DUPLEX dx;
+        char* comma = strchr(duplex_spec, ',');
+
+        memset(&dx, 0, sizeof dx);
+        dx.fd_a = dx.fd_b = -1;
+        dx.speed = pbaudrate;
+        dx.count = send_count;
+        dx.threads = (2 != multi);
+        dx.chunk = write_chunk;
+        dx.do_raw_config = do_raw_config;
+        dx.keep_tty_settings = keep_tty_settings;
+        dx.baseline = duplex_baseline;
+        dx.debug = debug;
+        if (!strcmp(duplex_spec, "pty"))
         {
-            fprintf(stderr, "SUCCESS:  raw config of [%s]\n", tty_name);
+            if (duplex_open_pty(&dx)) { return 1; }
+            dx.speed = NULL;
         }
-    };
+        else if (comma && comma[1])
+        {
+            *comma = '\0';
+            dx.name_a = duplex_spec;
+            dx.name_b = comma + 1;
+        }
+        else
+        {
+            fprintf(stderr,"ERROR:  --duplex=%s is not PATH_A,PATH_B or pty\n"
+                          , duplex_spec);
+            return 3;
+        }
+        return run_duplex(&dx) ? 1 : 0;
+    }
 
 
     /******************************************************************/
-    /* Configure TTY speed, if requested (--speed=... or --baud=...)
+    /* Test several TTYs at once, if requested (--multi=... or more
+     * than one --tty=...); each TTY is configured by run_multiport(...)
      */
-    if (tty_name && pbaudrate)
+    if (multi || ntty_specs > 1)
     {
-        if (!stty_set_speed(tty_name, pbaudrate) && debug)
+        size_t i;
+        if (ntty_specs > MPORT_MAX)
         {
-            fprintf(stderr, "SUCCESS:  speed config of [%s]\n", tty_name);
+            fprintf(stderr,"ERROR:  more than %d ports\n", MPORT_MAX);
+            return 3;
         }
-    };
+        mports.threads = (2 != multi);
+        mports.chunk = write_chunk;
+        mports.do_raw_config = do_raw_config;
+        mports.keep_tty_settings = keep_tty_settings;
+        mports.debug = debug;
+        for (i=0; i<ntty_specs; ++i)
+        {
+            if (mport_add(&mports, tty_specs[i], pbaudrate, send_count))
+            {
+                return 3;
+            }
+        }
+        return run_multiport(&mports) ? 1 : 0;
+    }
 
 
     /******************************************************************/
-    /* Write test array data (see sst.h) to TTY or file, if requested */
-    if (tty_name && send_count > 0)
+    /* Start pty loopback, if requested (--loopback=pty...); its slave
+     * is the TTY for the rest of the run
+     */
+    ptyloop_init(&loopback);
+    if (loopback_spec)
     {
-    SEQUENCE8BIT s8;   /* used by send_chars below (cf. stty.h) */
-    int fdrdr = 0;
-
-        ssize_t sc;
-
-        /* Open for write and non-block if that option was supplied */
-        int fd = open(tty_name, O_WRONLY | o_nonblock);
-
-        /* Try again if file not in filesystem i.e. create new file */
-        if (0>fd && ENOENT==errno)
+        if (ptyloop_parse(&loopback, loopback_spec)) { return 3; }
+        if (ptyloop_start(&loopback)) { return 1; }
+        tty_name = run_cfg.tty_name = loopback.name;
+        if (debug)
         {
-            errno = 0;
-            fd = open(tty_name, O_WRONLY  | o_nonblock | O_CREAT);
+            fprintf(stderr, "Loopback pty [%s]\n", tty_name);
         }
-        if (debug) { fprintf(stderr,"Opened [%s]; fd=%d\n", tty_name, fd); }
-        if (0>fd) { perror(tty_name); return -1; }
+    }
 
-        /* Close tty fd so it is not inherited by forked processes */
-        if (0>close(fd)) { perror(tty_name); return -1; }
 
-        /* Fork reader of these data, if requested (--fork-reader) */
-        fdrdr = fork_reader ? recv_chars(tty_name, send_count) : 0;
-        if (0 > fdrdr) { return -1; }
-
-        if (fork_reader && debug) {
-            fprintf(stderr,"Forked reader; pipe-fd=%d\n", fdrdr);
-        }
-
-        /* Re-open tty for write */
-        if (0 > (fd=open(tty_name, O_WRONLY | o_nonblock)))
+    /******************************************************************/
+    /* Open TTY once, for configuration, reader and writer (see
+     * session.h)
+     */
+    session_init(&session);
+    if (tty_name
+     && (send_count > 0 || do_sweep || do_raw_config || pbaudrate
+        || framing || profile_in || profile_out))
+    {
+        if (session_open(&session, tty_name, o_nonblock))
         {
-            perror(tty_name);
+            ptyloop_stop(&loopback);
             return -1;
         }
-        if (debug) { fprintf(stderr,"Re-opened [%s]; fd=%d\n", tty_name, fd); }
+        run_cfg.session = &session;
+        if (debug)
+        {
+            fprintf(stderr, "Session [%s]; fd=%d; open=%.1fus\n"
+                          , tty_name, session.fd, session.open_ns * 1e-3);
+        }
+    }
 
-        /* Write test data */
-        sc = send_chars(fd, send_count, &s8, &tries, &eagains);
 
-        if (debug) {
-            fprintf(stderr,"Wrote %ld chars to [%s]; fd=%d"
-                           "; tries=%lu; EAGAINs=%lu\n"
-                          , (long)sc, tty_name, fd, tries, eagains
-                          );
+    /******************************************************************/
+    /* Save TTY settings, to restore them on exit or SIGINT/SIGTERM, if
+     * sst changes them (unless --keep-tty-settings)
+     */
+    if (0 <= session.fd && !keep_tty_settings
+     && (do_raw_config || pbaudrate || framing || profile_in || do_sweep))
+    {
+        if (profile_keep_original(tty_name, session.fd) && debug)
+        {
+            fprintf(stderr, "WARNING:  cannot save settings of [%s]\n"
+                          , tty_name);
         }
+    }
+
+    /* Soak:  first SIGINT/SIGTERM stops writes, and the run finishes
+     * and reports (see soak.h)
+     */
+    if (soak_active()) { soak_catch_signals(); }
+
+    /* Flight recorder, if requested (--flight-recorder=...); the
+     * forked reader inherits its mapping
+     */
+    if (flightrec.path && flightrec_start()) { rtn = 1; }
 
-        /* Wait for reader to report how many characters were read */
-        if (fork_reader)
+
+    /******************************************************************/
+    /* Configure TTY for raw data (--do-raw-config), speed (--speed=...
+     * or --baud=..., except for a sweep) and framing (--framing=...), or
+     * from a saved profile (--profile-load=...), with one ioctl
+     */
+    if (0 <= session.fd
+     && (do_raw_config || (pbaudrate && !do_sweep) || framing
+        || profile_in || profile_out))
+    {
+        PROFILE loaded;
+        if (profile_in && profile_load(profile_in, &loaded)) { return 3; }
+        if (!session_configure(&session, profile_in ? &loaded : NULL
+                              , do_raw_config, do_sweep ? NULL : pbaudrate
+                              , framing, &prof))
         {
-            RECVSTATUS buf;
-            fprintf(stderr,"Waiting for forked reader to"
-                           " finish and send data to pipe ...\n"
-                   );
-            if ((sizeof buf) != read(fdrdr,&buf,sizeof buf))
+            if (debug)
             {
-                perror("Error retrieving reader result from pipe");
-                close(fdrdr);
-                close(fd);
-                return -1;
-            }
-            close(fdrdr);
-
-            if (debug) {
-                fprintf(stderr,"Read %lu chars from [%s]; fd=%d"
-                               "; read-count=%lu"
-                               "; status=%d; errno=%d\n"
-                              , buf.count, tty_name, fdrdr
-                              , buf.reads
-                              , (int)buf.status, buf.m_errno
-                              );
+                fprintf(stderr, "SUCCESS:  profile config of [%s] in %.1fus\n"
+                              , tty_name, session.config_ns * 1e-3);
             }
+            if (profile_out && profile_save(profile_out, &prof)) { rtn = 1; }
         }
+    };
+
+
+    /******************************************************************/
+    /* Sweep TTY speeds, if requested (--sweep or --sweep-search=...);
+     * the reader is always forked, and --speed=... is ignored
+     */
+    if (do_sweep)
+    {
+        run_cfg.fork_reader = 1;
+        rtn = run_sweep(&sweep, &run_cfg) ? 1 : 0;
+    }
+
 
-        close(fd);
-    } /* if (tty_name && send_count > 0) - Write test array data */
+    /******************************************************************/
+    /* Write test array data (see sst.h) to TTY or file, if requested */
+    else if (tty_name && send_count > 0)
+    {
+        RUNRESULT run_result;
+        if (run_test(&run_cfg, &run_result)) { rtn = -1; }
+    }
 
-    return 0;
+    /* Restore TTY settings, if saved, before the session closes; stop
+     * pty loopback, if any, which reports its counts
+     */
+    profile_restore();
+    session_close(&session);
+    ptyloop_stop(&loopback);
+    ring_free(&send_ring);
+    flightrec_stop(stderr);
+    return rtn;
 }
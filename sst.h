@@ -10,24 +10,80 @@
  * ========
  * fill_to_send()              - fill source data array, return pointer
  * dump_to_send(...)           - Dump source data array to output stream
+ * fill_cycle()                - fill one full cycle of lines sent
  * typedef ... *pSEQUENCE8BIT  - Struct to use source data array
+ * typedef ... *pSENDSTATS     - Struct with writer statistics
+ * send_stats_init(...)        - Clear writer statistics
+ * send_publish(...)           - Publish counts for soak.h reporter
+ * send_timed(...)             - Record write() latency and gap
+ * send_blocked(...)           - Count EAGAIN, optionally wait for POLLOUT
+ * send_probe(...)             - Write one latency probe frame
+ * send_probe_due(...)         - Write idle or in-stream probes when due
  * send_chars(...)             - Automate large writy of source data
+ * send_ring_prepare(...)      - Build data ring once, before writes
+ * send_chunks(...)            - Same data, precomputed, large writes
+ * send_uring(...)             - Same data, linked writes with io_uring
+ * send_frame_count(...)       - Count of frames sent for a char count
+ * send_frames(...)            - Sequence-numbered frames, large writes
+ * send_pattern_chunks(...)    - PRBS or stress pattern, large writes
  * typedef ... *pRECVSTATUS    - Struct with forked reader status
+ * recv_status_read(...)       - Read forked reader status from pipe
+ * recv_errors(...)            - Errors found so far by reader's checker
+ * recv_tail_ms(...)           - Reader's wait for data, once writer is done
  * recv_chars(...)             - Read data from TTY
- * tohere(...)                 - High-frequency debug logging
- * - #ifdef DOTOHERE           - Control compile-time usage of tohere()
- * - #define TOHEREI(I)        - Control compile-time usage of tohere()
- * - #define TOHERE(I)         - Control compile-time usage of tohere()
+ * - #define TOHEREI(I)        - Record event in flight recorder
+ * - #define TOHERE(I)         - Control usage of TOHEREI(I) by region
  */
 
 #include <errno.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/types.h>
 
+/* Byte-exact verification of received data */
+#include "verify.h"
+
+/* Repeating data as contiguous windows, for large writes */
+#include "ring.h"
+
+/* Clocks, latency histograms, and rate pacing */
+#include "timing.h"
+#include "histogram.h"
+#include "pacer.h"
+
+/* Latency probe frames, PROBE_LEN, etc. */
+#include "probe.h"
+
+/* Crash-surviving event ring, for TOHERE(I) below */
+#include "flightrec.h"
+
+/* Sequence-numbered frames with CRC32C */
+#include "frame.h"
+
+/* PRBS and stress patterns, and bit-error-rate checker */
+#include "pattern.h"
+
+/* Reader engine:  epoll or busy-poll, VMIN/VTIME, wakeup counts */
+#include "reader.h"
+
+/* Minimal io_uring, with raw syscalls */
+#include "uring.h"
+
+/* Real-time scheduling, CPU pinning, locked memory */
+#include "rtsched.h"
+
+/* Duration-based soak, interval reports, stop on signal */
+#include "soak.h"
+
+/* wire_tcdrain(...), for idle latency probes */
+#include "wiretime.h"
+
 /***********************************************************************
  * Stream of 8-bit characters, alternating high bit 8, finish with CRLF:
  *   255, 127, 254, 126, ..., 160, 32, 128, 0, CR, NL
@@ -79,6 +135,28 @@ dump_to_send(FILE* fout)
 }
 
 
+/**********************************************************************/
+/* One full cycle of the sequence of array subsets (lines), i.e. every
+ * line from the shortest (3 chars) to the longest (196 chars), exactly
+ * as send_chars(...) below writes them; used to verify received data
+ */
+#define LCYCLE (((LSEND*(LSEND+1))/2) - 3)   /* 3 + 4 + ... + 196 */
+static char cycle[LCYCLE];
+
+static void
+fill_cycle()
+{
+    char* p = cycle;
+    size_t lline;
+    fill_to_send();
+    for (lline=3; lline<=LSEND; ++lline)
+    {
+        memcpy(p, p_to_send_end - lline, lline);
+        p += lline;
+    }
+}
+
+
 /**********************************************************************/
 /* Structure to keep track of sequence of array subsets */
 typedef struct sequence8bitstr
@@ -91,39 +169,26 @@ typedef struct sequence8bitstr
 
 
 /**********************************************************************/
-#ifdef DOTOHERE
-/* High-frequency debug logging (e.g. gcc -DDOTOHERE)
+/* High-frequency debug logging, to find the last step before a crash
  * - These routines cause system crashes and reboots in NVIDIA Jetson
- *   platforms, so this tohere(...) routine is a compile-time-enabled
- *   way to know, approximately, what is the last line of code that
- *   executes before a crash occurs
- */
-void tohere(const char* fyle, const char* func, const int lyne, const int val)
-{
-    fprintf(stderr,"TOHERE:  file=[%s]; function=[%s]; line=%d; val=%d\n"
-                  , fyle, func, lyne, val
-           );
-    fflush(stderr);
-}
-
-/* The macro TOHEREI(I) is a standard way to control the calling of
- * tohere(...)
+ *   platforms, so each TOHEREI(I) records, approximately, the line of
+ *   code that executes, into the flight recorder (see flightrec.h);
+ *   with --flight-recorder=PATH, the file holds the last events after
+ *   a crash or reboot, and sst --flight-dump=PATH decodes them
  * - There will be another macro, TOHERE(I) that will be used where
  *   this high-freequency debug logging is desired.
  *   - Macro TOHERE(I) will
  *     - either be #defined empty to disable the logging,
  *     - or be #defined equivalent to TOHEREI(I) to enable the logging
  * - The parameter I is an integer that is used when there is a need to
- *   log more information than the file, function, and line number
+ *   log more information than the file and line number
  *   - The parameter I will normally be 0
+ * - Without --flight-recorder=..., each enabled TOHERE(I) costs one
+ *   branch; gcc -DNOTOHERE compiles them out entirely
  */
-#define TOHEREI(I) tohere(__FILE__,__FUNCTION__,__LINE__,(int)(I));
-
+#ifndef NOTOHERE
+#define TOHEREI(I) flightrec_event(FLIGHTREC_SITE(FLIGHTREC_SST_H),(I));
 #else
-/* If the macro DOTOHERE is not #defined, then the TOHEREI(I) macro is
- * empty, which disables any calls to the non-existent tohere(...)
- * routine, regardless how TOHERE(I) is #defined elsewhere
- */
 #define TOHEREI(I)
 #endif
 
@@ -131,6 +196,246 @@ void tohere(const char* fyle, const char* func, const int lyne, const int val)
 #define TOHERE(I)
 
 
+/**********************************************************************/
+/* Writer statistics, for send_chars(...) and send_chunks(...) below */
+typedef struct SENDSTATSstr
+{
+    uint64_t sent;           /* Count of chars written so far */
+    uint64_t tries;          /* Count of write()'s */
+    uint64_t eagains;        /* Count of EAGAIN/EWOULDBLOCK write errors */
+    uint64_t polls;          /* Count of waits for POLLOUT after EAGAIN */
+    uint64_t poll_ns;        /* Total time waiting for POLLOUT */
+    uint64_t write_total_ns; /* Total time inside write() */
+    uint64_t last_ns;        /* Start time of previous write() */
+    uint64_t first_ns;       /* Time first write() returned */
+    uint64_t start_ns;       /* Time first write() started */
+    uint64_t enters;         /* io_uring_enter()s (send_uring(...)) */
+    int fixed;               /* Non-zero if io_uring buffer registered */
+    size_t chunk;            /* Most chars per write(), as used; 0 for
+                              * send_chars(...) */
+    int outq_max;            /* Largest TIOCOUTQ at EAGAIN, or -1 */
+    size_t probes_idle;      /* Count of probes sent on idle line */
+    size_t probes_load;      /* Count of probes sent within stream */
+    uint64_t probe_next;     /* Time next in-stream probe is due */
+    HISTOGRAM write_ns;      /* Time inside each write() */
+    HISTOGRAM gap_ns;        /* Time between starts of write()'s */
+} SENDSTATS, *pSENDSTATS;
+
+/* Non-zero to wait for POLLOUT after EAGAIN, instead of retrying the
+ * write() immediately (busy-spin); set e.g. by --poll-writer
+ */
+static int send_poll_out = 0;
+
+/* Non-zero to sample TIOCOUTQ after each EAGAIN, to find how many chars
+ * the driver buffers before refusing writes; set e.g. by --queue-sample
+ */
+static int send_outq_on_eagain = 0;
+
+/* Latency probes (cf. probe.h):  interval between in-stream probes,
+ * and count of probes to send on an idle line before the stream; both
+ * 0 i.e. no probes, unless set e.g. by --probe=... or --probe-idle=...
+ */
+static uint64_t send_probe_ns = 0;
+static size_t send_probe_idle = 0;
+
+/* Payload length of sequence-numbered frames (cf. frame.h) written
+ * instead of the sawtooth stream above; 0 i.e. no frames, unless set
+ * e.g. by --framed=...
+ */
+static size_t send_frame_payload = 0;
+
+/* PRBS or stress pattern (cf. pattern.h) written instead of the
+ * sawtooth stream above; PAT_SAWTOOTH i.e. no pattern, unless set e.g.
+ * by --pattern=...
+ */
+static int send_pattern = PAT_SAWTOOTH;
+
+/* Writes in flight with io_uring (cf. send_uring(...) below), or 0 for
+ * one write() at a time; set e.g. by --io=uring
+ */
+static unsigned send_uring_depth = 0;
+
+/* Rate pacer for writes; rate is 0 i.e. disabled, unless set e.g. by
+ * --rate=...
+ */
+static PACER send_pacer;
+
+/* Writer's counts of chars sent and of EAGAINs so far, as published by
+ * send_publish(...) for the soak.h reporter thread, which reads them
+ * while the writer writes; SENDSTATS itself has plain stores
+ */
+static uint64_t send_live_sent;
+static uint64_t send_live_eagains;
+
+
+/**********************************************************************/
+/* Publish writer's counts sent and EAGAINs (relaxed atomic stores) */
+static inline void
+send_publish(pSENDSTATS psend)
+{
+    __atomic_store_n(&send_live_sent, psend->sent, __ATOMIC_RELAXED);
+    __atomic_store_n(&send_live_eagains, psend->eagains, __ATOMIC_RELAXED);
+}
+
+
+/**********************************************************************/
+/* Clear writer statistics */
+static void
+send_stats_init(pSENDSTATS psend)
+{
+    memset(psend, 0, sizeof *psend);
+    psend->outq_max = -1;
+    hist_init(&psend->write_ns);
+    hist_init(&psend->gap_ns);
+    send_publish(psend);
+}
+
+
+/**********************************************************************/
+/* Record latency of a write() that started at t0, and the gap since
+ * the start of the previous write()
+ */
+static inline void
+send_timed(pSENDSTATS psend, uint64_t t0)
+{
+    uint64_t dt = monotonic_ns() - t0;
+    if (!psend->first_ns)
+    {
+        psend->start_ns = t0;
+        psend->first_ns = t0 + dt;
+    }
+    hist_record(&psend->write_ns, dt);
+    psend->write_total_ns += dt;
+    if (psend->last_ns) { hist_record(&psend->gap_ns, t0 - psend->last_ns); }
+    psend->last_ns = t0;
+}
+
+
+/**********************************************************************/
+/* Handle EAGAIN/EWOULDBLOCK from write() to non-blocking fd:
+ * count it, note TX queue depth if send_outq_on_eagain is set, then,
+ * if send_poll_out is set, wait until fd is writable
+ */
+static void
+send_blocked(int fd, pSENDSTATS psend)
+{
+    struct pollfd pfd;
+    uint64_t t0;
+
+    ++psend->eagains;
+    send_publish(psend);
+    errno = 0;
+    if (send_outq_on_eagain)
+    {
+        int outq;
+        if (!ioctl(fd, TIOCOUTQ, &outq) && outq > psend->outq_max)
+        {
+            psend->outq_max = outq;
+        }
+        errno = 0;
+    }
+    if (!send_poll_out) { return; }
+
+    /* Wait; errors and hangups are left for the next write() to report */
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    t0 = monotonic_ns();
+    while (0 > poll(&pfd, 1, 1000) && EINTR==errno) { errno = 0; }
+    ++psend->polls;
+    psend->poll_ns += monotonic_ns() - t0;
+    errno = 0;
+}
+
+
+/**********************************************************************/
+/* Write one latency probe frame (cf. probe.h), timestamped just before
+ * its first write(); retry after EAGAIN until the whole frame is sent
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+send_probe(int fd, int idle, pSENDSTATS psend)
+{
+    char frame[PROBE_LEN];
+    size_t off = 0;
+    ssize_t iwrite;
+    uint64_t t0;
+
+    while (off < PROBE_LEN)
+    {
+        ++psend->tries;
+        t0 = monotonic_ns();
+        if (!off) { probe_encode(frame, idle, t0); }
+        iwrite = write(fd, frame + off, PROBE_LEN - off);
+        send_timed(psend, t0);
+        if (iwrite < 0)
+        {
+            if (EAGAIN==errno || EWOULDBLOCK==errno)
+            {
+                send_blocked(fd, psend);
+                continue;
+            }
+            perror("send_probe");
+            return -1;
+        }
+        off += iwrite;
+    }
+    pacer_spend(&send_pacer, PROBE_LEN);
+    if (idle) { ++psend->probes_idle; }
+    else      { ++psend->probes_load; }
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Write latency probes when due:
+ * - before the first write of the stream, send_probe_idle probes, each
+ *   after the TX queue drains (wire_tcdrain(...), cf. wiretime.h) and
+ *   one interval (default 10ms) has passed; a TX queue that cannot be
+ *   drained fails, unless fd is not a TTY (e.g. --non-standard-tty=
+ *   ...), with no queue to wait for;
+ * - then, if send_probe_ns is set, one in-stream probe every
+ *   send_probe_ns between writes
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+send_probe_due(int fd, pSENDSTATS psend)
+{
+    uint64_t now;
+
+    if (psend->probes_idle < send_probe_idle)
+    {
+        uint64_t wait_ns = send_probe_ns ? send_probe_ns : 10000000;
+        struct timespec ts;
+        while (psend->probes_idle < send_probe_idle)
+        {
+            if (wire_tcdrain(fd) && ENOTTY!=errno)
+            {
+                perror("send_probe_due=>tcdrain");
+                return -1;
+            }
+            ts.tv_sec = wait_ns / 1000000000UL;
+            ts.tv_nsec = wait_ns % 1000000000UL;
+            while (nanosleep(&ts, &ts) && EINTR==errno) ;
+            if (send_probe(fd, 1, psend)) { return -1; }
+        }
+        if (wire_tcdrain(fd) && ENOTTY!=errno)
+        {
+            perror("send_probe_due=>tcdrain");
+            return -1;
+        }
+        errno = 0;
+    }
+
+    if (!send_probe_ns) { return 0; }
+    now = monotonic_ns();
+    if (now < psend->probe_next) { return 0; }
+    if (send_probe(fd, 0, psend)) { return -1; }
+    psend->probe_next = now + send_probe_ns;
+    return 0;
+}
+
+
 /**********************************************************************/
 /* Routine to send sequence of array subsets to open file descriptor
  *
@@ -141,18 +446,17 @@ void tohere(const char* fyle, const char* func, const int lyne, const int val)
  *     remaining - How many total characters to send
  *         pseq8 - pSEQUENCE8BIT struct (see above)
  *
- * Output arguments (pointers):
- *        ptries - Count of how many writes
- *       pagains - Count of EAGAIN/EWOULDBLOCK write errors
+ * Output argument (pointer):
+ *         psend - pSENDSTATS struct (see above) with write counts
  */
 static ssize_t
 send_chars(int fd, size_t remaining, pSEQUENCE8BIT pseq8
-          , size_t* ptries, size_t* peagains)
+          , pSENDSTATS psend)
 {
     /* Initialize counters */
     size_t lsent = 0;
 TOHERE(0)
-    *ptries = *peagains = 0;
+    send_stats_init(psend);
 
     /* Initialize array to send */
 TOHERE(0)
@@ -171,9 +475,16 @@ TOHERE(0)
     {
     size_t count_this_pass;
     ssize_t iwrite;
+    uint64_t t0;
+
+        /* Stop at end of soak (--duration=...), or on signal */
+        if (soak_over()) { break; }
+
+        /* Write latency probe, if due (--probe=...) */
+        if (send_probe_due(fd, psend)) { return -1; }
 
 TOHERE(0)
-        ++*ptries;
+        ++psend->tries;
 
         /* When start of chars to send is too early or late,
          * reset to send last three chars (NUL, CR, NL)
@@ -207,9 +518,14 @@ TOHERE(0)
 TOHERE(remaining)
         if (count_this_pass>remaining) { count_this_pass = remaining; }
 
+        /* Wait for rate pacer, if any, which may reduce count */
+        count_this_pass = pacer_wait(&send_pacer, count_this_pass);
+
         /* Write up to that many characters */
 TOHERE(count_this_pass)
+        t0 = monotonic_ns();
         iwrite = write(fd, pseq8->p, count_this_pass);
+        send_timed(psend, t0);
 
         /* Handle errors */
 TOHERE(iwrite)
@@ -220,9 +536,8 @@ TOHERE(iwrite)
 TOHERE(errno)
             if (EAGAIN==errno || EWOULDBLOCK==errno)
             {
-TOHERE(*peagains)
-                ++*peagains;
-                errno = 0;
+TOHERE(psend->eagains)
+                send_blocked(fd, psend);
                 continue;
             }
             /* Fail on all other errors */
@@ -232,11 +547,14 @@ TOHERE(-99)
         }
         /* Update counters and next-character pointer */
 TOHERE(0)
+        pacer_spend(&send_pacer, iwrite);
         remaining -= iwrite;
 TOHERE(remaining)
 #undef TOHERE
 #define TOHERE(I)
         lsent += iwrite;
+        psend->sent += iwrite;
+        send_publish(psend);
 TOHERE(0)
         pseq8->p += iwrite;
     }
@@ -245,32 +563,699 @@ TOHERE(0)
 } /* send_chars(...) */
 
 
+/**********************************************************************/
+/* Cycle of lines (cf. fill_cycle()), or one period of a pattern (cf.
+ * pattern.h), as a ring of data to send, built by send_ring_prepare(...)
+ * before the writes are timed, and kept for later runs (e.g. sweep
+ * steps) that ask for the same kind and data and no larger chunk
+ */
+static RING send_ring;
+static int send_ring_use = -1;   /* use_ring of send_ring, or -1 */
+static int send_ring_data = -1;  /* send_pattern of send_ring, or -1 */
+
+
+/**********************************************************************/
+/* Build send_ring, unless it is already built for use_ring, data and
+ * chunk:  for the cycle, a double-mapped memfd ring (cf. ring.h) if
+ * use_ring and it is at most RING_MAXSIZE, else a heap copy; for a
+ * pattern (--pattern=...), a memfd ring of one period of it if
+ * use_ring and it is at most RING_MAXSIZE (fixed patterns, prbs7),
+ * else none, and send_pattern_chunks(...) generates it as it writes
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+send_ring_prepare(size_t chunk, int use_ring)
+{
+    size_t lperiod;
+    char* period;
+    PATGEN gen;
+    int rtn;
+
+    if (!chunk) { return -1; }
+    if (use_ring == send_ring_use && send_pattern == send_ring_data
+     && (!send_ring.base || chunk <= send_ring.lwindow))
+    {
+        return 0;
+    }
+    ring_free(&send_ring);
+    send_ring_use = send_ring_data = -1;
+
+    /* Cycle of lines */
+    if (!send_pattern)
+    {
+        fill_cycle();
+        if (ring_make(&send_ring, cycle, LCYCLE, chunk, use_ring))
+        {
+            return -1;
+        }
+        if (use_ring && !send_ring.mapped)
+        {
+            fprintf(stderr, "WARNING:  --write-ring:  %d-char cycle needs"
+                            " a %lu-byte ring, over %lu; writing from a"
+                            " heap copy\n"
+                          , LCYCLE
+                          , (unsigned long) ring_period(LCYCLE, chunk)
+                          , RING_MAXSIZE);
+        }
+        send_ring_use = use_ring;
+        send_ring_data = send_pattern;
+        return 0;
+    }
+
+    /* One period of pattern, if its ring is small enough */
+    lperiod = pat_period(send_pattern);
+    if (use_ring
+     && (lperiod > RING_MAXSIZE || ring_period(lperiod, chunk) > RING_MAXSIZE))
+    {
+        fprintf(stderr, "WARNING:  --write-ring:  %s repeats after %lu"
+                        " bytes, too long for a ring of at most %lu;"
+                        " generating it as it is written\n"
+                      , pat_info[send_pattern].name
+                      , (unsigned long) lperiod, RING_MAXSIZE);
+    }
+    else if (use_ring)
+    {
+        if (pat_init(&gen, send_pattern))
+        {
+            fprintf(stderr, "send_ring_prepare=>pat_init:  unknown"
+                            " pattern %d\n", send_pattern);
+            return -1;
+        }
+        if (!(period = malloc(lperiod)))
+        {
+            perror("send_ring_prepare=>malloc");
+            return -1;
+        }
+        pat_fill(&gen, period, lperiod);
+        rtn = ring_create(&send_ring, period, lperiod, chunk);
+        free(period);
+        if (rtn) { return -1; }
+    }
+    send_ring_use = use_ring;
+    send_ring_data = send_pattern;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Routine to send the same stream as send_chars(...) above, but from
+ * a precomputed cycle of lines (cf. fill_cycle()), in writes of up to
+ * [chunk] characters that cross line and cycle boundaries; or, from a
+ * ring of one period of a pattern, the same stream as
+ * send_pattern_chunks(...) below
+ *
+ * Return value:  how many characters were sent:  sum of write()'s
+ *
+ * Input arguments:
+ *            fd - open file descriptor
+ *     remaining - How many total characters to send
+ *         chunk - Maximum count of characters per write()
+ *         pring - Cycle as ring of data to send, from
+ *                 send_ring_prepare(...)
+ *
+ * Output argument (pointer):
+ *         psend - pSENDSTATS struct (see above) with write counts
+ */
+static ssize_t
+send_chunks(int fd, size_t remaining, size_t chunk, pRING pring
+           , pSENDSTATS psend)
+{
+    size_t lsent = 0;
+    size_t pos = 0;          /* Offset in ring of next char to send */
+
+    /* Initialize counters */
+    send_stats_init(psend);
+    if (!chunk || !pring->base) { return -1; }
+    if (chunk > pring->lwindow) { chunk = pring->lwindow; }
+    psend->chunk = chunk;
+
+    /* Loop over writes until target character count has been sent */
+    while (remaining > 0)
+    {
+    size_t count_this_pass = remaining < chunk ? remaining : chunk;
+    ssize_t iwrite;
+    uint64_t t0;
+
+        /* Stop at end of soak (--duration=...), or on signal */
+        if (soak_over()) { break; }
+
+        /* Write latency probe, if due (--probe=...) */
+        if (send_probe_due(fd, psend)) { return -1; }
+
+        /* Wait for rate pacer, if any, which may reduce count */
+        count_this_pass = pacer_wait(&send_pacer, count_this_pass);
+
+        ++psend->tries;
+        t0 = monotonic_ns();
+        iwrite = write(fd, pring->base + pos, count_this_pass);
+        send_timed(psend, t0);
+
+        /* Handle errors */
+        if (iwrite < 0)
+        {
+            /* Ignore, but keep track of, blocked writes */
+            if (EAGAIN==errno || EWOULDBLOCK==errno)
+            {
+                send_blocked(fd, psend);
+                continue;
+            }
+            /* Fail on all other errors */
+            perror("send_chunks");
+            return -1;
+        }
+
+        /* Update counters and offset of next char in ring */
+        pacer_spend(&send_pacer, iwrite);
+        remaining -= iwrite;
+        lsent += iwrite;
+        psend->sent += iwrite;
+        send_publish(psend);
+        pos = (pos + iwrite) % pring->size;
+    }
+    return lsent;
+} /* send_chunks(...) */
+
+
+/**********************************************************************/
+/* Write the same data as send_chunks(...), with io_uring (cf. uring.h):
+ * queue up to send_uring_depth writes of consecutive chunks, linked so
+ * the kernel runs them in order, submit them and wait for all of them
+ * with one io_uring_enter(), then queue the next batch from where the
+ * first short or failed write stopped; write from the part of the ring
+ * written from, registered as a fixed buffer (IORING_OP_WRITE_FIXED),
+ * where the kernel allows
+ *
+ * Input arguments:
+ *            fd - open file descriptor
+ *     remaining - How many total characters to send
+ *         chunk - Maximum count of characters per write
+ *         pring - Cycle as ring of data to send, from
+ *                 send_ring_prepare(...)
+ *
+ * Output argument (pointer):
+ *         psend - pSENDSTATS struct (see above) with write counts
+ */
+static ssize_t
+send_uring(int fd, size_t remaining, size_t chunk, pRING pring
+          , pSENDSTATS psend)
+{
+    size_t lsent = 0;
+    size_t pos = 0;          /* Offset in ring of next char to send */
+    URING u;
+    unsigned depth = send_uring_depth;
+    size_t lens[URING_MAX];
+    int res[URING_MAX];
+
+    /* Initialize counters */
+    send_stats_init(psend);
+    if (depth > URING_MAX) { depth = URING_MAX; }
+    if (!depth) { depth = URING_DEPTH; }
+
+    if (!chunk || !pring->base) { return -1; }
+    if (chunk > pring->lwindow) { chunk = pring->lwindow; }
+    psend->chunk = chunk;
+
+    /* Ring of depth entries, and as a fixed buffer the part of the data
+     * ring written from:  any chunk from any pos < size
+     */
+    if (uring_init(&u, depth))
+    {
+        perror("send_uring=>io_uring_setup");
+        return -1;
+    }
+    psend->fixed = !uring_register_buffer(&u, pring->base
+                                         , pring->size + chunk);
+    errno = 0;
+
+    /* Loop over batches until target character count has been sent */
+    while (remaining > 0)
+    {
+    struct io_uring_sqe* sqe = NULL;
+    struct io_uring_cqe cqe;
+    unsigned n = 0;
+    unsigned got = 0;
+    unsigned i;
+    size_t queued = 0;
+    size_t batch;
+    size_t done = 0;
+    uint64_t t0;
+
+        /* Stop at end of soak (--duration=...), or on signal */
+        if (soak_over()) { break; }
+
+        /* Write latency probe, if due (--probe=...) */
+        if (send_probe_due(fd, psend))
+        {
+            uring_free(&u);
+            return -1;
+        }
+
+        /* Wait for rate pacer, if any, to allow the whole batch; chars
+         * written are charged to it once the writes complete, below
+         */
+        batch = (size_t) depth * chunk;
+        if (batch > remaining) { batch = remaining; }
+        batch = pacer_wait(&send_pacer, batch);
+
+        /* Queue linked writes of consecutive chunks of the batch */
+        while (n < depth && queued < batch)
+        {
+            size_t len = batch - queued < chunk ? batch - queued : chunk;
+            sqe = uring_sqe(&u);
+            sqe->opcode = psend->fixed ? IORING_OP_WRITE_FIXED
+                                       : IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t) (uintptr_t)
+                        (pring->base + (pos + queued) % pring->size);
+            sqe->len = len;
+            sqe->off = (uint64_t) -1;     /* Current position */
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = n;
+            lens[n++] = len;
+            queued += len;
+        }
+        sqe->flags = 0;                   /* Last of the chain */
+
+        /* Submit, and wait for every write of the batch */
+        psend->tries += n;
+        t0 = monotonic_ns();
+        while (got < n)
+        {
+            if (uring_enter(&u, n - got, 0))
+            {
+                perror("send_uring=>io_uring_enter");
+                uring_free(&u);
+                return -1;
+            }
+            while (uring_cqe(&u, &cqe))
+            {
+                if (cqe.user_data < n) { res[cqe.user_data] = cqe.res; }
+                ++got;
+            }
+        }
+        send_timed(psend, t0);
+
+        /* Count chars written, in order, to the first short or failed
+         * write; the kernel cancels writes linked after it
+         */
+        for (i=0; i<n; ++i)
+        {
+            if (res[i] < 0)
+            {
+                /* Ignore, but keep track of, blocked writes */
+                if (-EAGAIN==res[i] || -EWOULDBLOCK==res[i])
+                {
+                    send_blocked(fd, psend);
+                    break;
+                }
+                if (-ECANCELED==res[i] || -EINTR==res[i]) { break; }
+
+                /* Fail on all other errors */
+                errno = -res[i];
+                perror("send_uring");
+                uring_free(&u);
+                return -1;
+            }
+            done += res[i];
+            if ((size_t) res[i] < lens[i]) { break; }
+        }
+
+        /* Update counters and offset of next char in ring */
+        pacer_spend(&send_pacer, done);
+        remaining -= done;
+        lsent += done;
+        psend->sent += done;
+        send_publish(psend);
+        pos = (pos + done) % pring->size;
+    }
+    psend->enters = u.enters;
+    uring_free(&u);
+    return lsent;
+} /* send_uring(...) */
+
+
+/**********************************************************************/
+/* Count of frames of send_frame_payload chars of payload sent for a
+ * count of chars, rounded up to whole frames
+ */
+static uint64_t
+send_frame_count(size_t count)
+{
+    size_t lframe = send_frame_payload + FRAME_OVERHEAD;
+    return (count / lframe) + (count % lframe ? 1 : 0);
+}
+
+
+/**********************************************************************/
+/* Routine to send sequence-numbered frames (cf. frame.h), each with
+ * send_frame_payload chars of payload, in writes of up to [chunk]
+ * characters that cross frame boundaries
+ *
+ * Return value:  how many characters were sent:  sum of write()'s,
+ *                i.e. whole frames, at least [remaining] characters
+ *
+ * Input arguments:
+ *            fd - open file descriptor
+ *     remaining - How many total characters to send
+ *         chunk - Maximum count of characters per write()
+ *
+ * Output argument (pointer):
+ *         psend - pSENDSTATS struct (see above) with write counts
+ */
+static ssize_t
+send_frames(int fd, size_t remaining, size_t chunk, pSENDSTATS psend)
+{
+    size_t lframe = send_frame_payload + FRAME_OVERHEAD;
+    uint64_t nframes = send_frame_count(remaining);
+    uint64_t seq = 0;
+    size_t per = chunk > lframe ? chunk / lframe : 1;
+    size_t lbuf = 0;         /* Count of chars of frames in buf */
+    size_t pos = 0;          /* Offset in buf of next char to send */
+    size_t lsent = 0;
+    char* buf;
+
+    /* Initialize counters */
+    send_stats_init(psend);
+    psend->chunk = chunk < (per * lframe) ? chunk : (per * lframe);
+
+    if (!(buf = malloc(per * lframe)))
+    {
+        perror("send_frames=>malloc");
+        return -1;
+    }
+
+    /* Loop over writes until all frames have been sent */
+    while (pos < lbuf || seq < nframes)
+    {
+    size_t count_this_pass;
+    ssize_t iwrite;
+    uint64_t t0;
+
+        /* Build next batch of frames when previous batch is sent;
+         * stop there, i.e. after whole frames, at end of soak
+         * (--duration=...), or on signal
+         */
+        if (pos >= lbuf)
+        {
+            if (soak_over()) { break; }
+            for (lbuf=pos=0; lbuf < (per * lframe) && seq < nframes; ++seq)
+            {
+                lbuf += frame_build(buf + lbuf, seq, send_frame_payload);
+            }
+        }
+        count_this_pass = lbuf - pos;
+        if (count_this_pass > chunk) { count_this_pass = chunk; }
+
+        /* Wait for rate pacer, if any, which may reduce count */
+        count_this_pass = pacer_wait(&send_pacer, count_this_pass);
+
+        ++psend->tries;
+        t0 = monotonic_ns();
+        iwrite = write(fd, buf + pos, count_this_pass);
+        send_timed(psend, t0);
+
+        /* Handle errors */
+        if (iwrite < 0)
+        {
+            /* Ignore, but keep track of, blocked writes */
+            if (EAGAIN==errno || EWOULDBLOCK==errno)
+            {
+                send_blocked(fd, psend);
+                continue;
+            }
+            /* Fail on all other errors */
+            perror("send_frames");
+            free(buf);
+            return -1;
+        }
+
+        /* Update counters and offset of next char in buf */
+        pacer_spend(&send_pacer, iwrite);
+        lsent += iwrite;
+        psend->sent += iwrite;
+        send_publish(psend);
+        pos += iwrite;
+    }
+    free(buf);
+    return lsent;
+} /* send_frames(...) */
+
+
+/**********************************************************************/
+/* Routine to send a PRBS or stress pattern (cf. pattern.h) of kind
+ * send_pattern, generated a word at a time into a buffer of [chunk]
+ * characters, in writes of up to [chunk] characters
+ *
+ * Return value:  how many characters were sent:  sum of write()'s
+ *
+ * Input arguments:
+ *            fd - open file descriptor
+ *     remaining - How many total characters to send
+ *         chunk - Maximum count of characters per write()
+ *
+ * Output argument (pointer):
+ *         psend - pSENDSTATS struct (see above) with write counts
+ */
+static ssize_t
+send_pattern_chunks(int fd, size_t remaining, size_t chunk
+                   , pSENDSTATS psend)
+{
+    PATGEN gen;
+    size_t lbuf = 0;         /* Count of chars of pattern in buf */
+    size_t pos = 0;          /* Offset in buf of next char to send */
+    size_t lsent = 0;
+    char* buf;
+
+    /* Initialize counters */
+    send_stats_init(psend);
+
+    /* Whole words per buffer, so pattern continues across buffers */
+    chunk = (chunk + 7) & ~(size_t)7;
+    psend->chunk = chunk;
+    if (pat_init(&gen, send_pattern))
+    {
+        fprintf(stderr, "send_pattern_chunks=>pat_init:  unknown pattern"
+                        " %d\n", send_pattern);
+        return -1;
+    }
+    if (!(buf = malloc(chunk)))
+    {
+        perror("send_pattern_chunks=>malloc");
+        return -1;
+    }
+
+    /* Loop over writes until target character count has been sent */
+    while (remaining > 0)
+    {
+    size_t count_this_pass;
+    ssize_t iwrite;
+    uint64_t t0;
+
+        /* Stop at end of soak (--duration=...), or on signal */
+        if (soak_over()) { break; }
+
+        /* Generate next buffer of pattern when previous one is sent */
+        if (pos >= lbuf)
+        {
+            pat_fill(&gen, buf, chunk);
+            lbuf = chunk;
+            pos = 0;
+        }
+        count_this_pass = lbuf - pos;
+        if (count_this_pass > remaining) { count_this_pass = remaining; }
+
+        /* Wait for rate pacer, if any, which may reduce count */
+        count_this_pass = pacer_wait(&send_pacer, count_this_pass);
+
+        ++psend->tries;
+        t0 = monotonic_ns();
+        iwrite = write(fd, buf + pos, count_this_pass);
+        send_timed(psend, t0);
+
+        /* Handle errors */
+        if (iwrite < 0)
+        {
+            /* Ignore, but keep track of, blocked writes */
+            if (EAGAIN==errno || EWOULDBLOCK==errno)
+            {
+                send_blocked(fd, psend);
+                continue;
+            }
+            /* Fail on all other errors */
+            perror("send_pattern_chunks");
+            free(buf);
+            return -1;
+        }
+
+        /* Update counters and offset of next char in buf */
+        pacer_spend(&send_pacer, iwrite);
+        remaining -= iwrite;
+        lsent += iwrite;
+        psend->sent += iwrite;
+        send_publish(psend);
+        pos += iwrite;
+    }
+    free(buf);
+    return lsent;
+} /* send_pattern_chunks(...) */
+
+
 /**********************************************************************/
 /* Struct to return status from forked reader (cf. recv_char(...)) */
 typedef struct RECVSTATUSstr
 {
     int status;
     int m_errno;
-    size_t count;
-    size_t reads;
+    uint64_t count;
+    uint64_t reads;
+    uint64_t timeouts;     /* Count of waits of RECV_STALL_MS with no
+                            * data (stalls) while the writer writes;
+                            * the last, adaptive wait once it is done
+                            * (cf. recv_tail_ms(...)) is no stall */
+    uint64_t first_ns;     /* Time first data were read, or 0 */
+    uint64_t last_ns;      /* Time last data were read, or 0 */
+    VERIFYCOUNTS verify;   /* Byte-exact comparison with data sent */
+    FRAMECOUNTS frames;    /* Frames received (--framed=...) */
+    BERCOUNTS ber;         /* Bit errors in pattern (--pattern=...) */
+    PROBERX probes;        /* Latency probes received (--probe=...) */
+    READERCOUNTS reader;   /* Reader engine settings and wakeups */
+    RTSTATE rt;            /* Scheduling applied (--rt-reader=...) */
 } RECVSTATUS, *pRECVSTATUS;
 
+
+/**********************************************************************/
+/* Read forked reader status from pipe; RECVSTATUS is larger than
+ * PIPE_BUF, so it may take several reads
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+recv_status_read(int fd, pRECVSTATUS pbuf)
+{
+    char* p = (char*) pbuf;
+    size_t left = sizeof *pbuf;
+    ssize_t iread;
+
+    while (left > 0)
+    {
+        iread = read(fd, p, left);
+        if (iread < 0 && EINTR==errno) { errno = 0; continue; }
+        if (iread <= 0) { return -1; }
+        p += iread;
+        left -= iread;
+    }
+    return 0;
+}
+
 #undef TOHERE
 #define TOHERE(I)
 
 
 /**********************************************************************/
-/* Fork process to read loopback data sent by send_char(...) above */
+/* Errors found so far by the forked reader's checker:  bytes dropped,
+ * inserted, or corrupted; or, for frames, frames missing, duplicated,
+ * or with bad CRCs; or, for a pattern, bit errors and bytes hunted
+ */
+static uint64_t
+recv_errors(pVERIFY pverify, pFRAMERX pframes, pBERRX pber)
+{
+    if (send_frame_payload)
+    {
+        return pframes->counts.missing.total
+             + pframes->counts.duplicated.total + pframes->counts.bad_crc;
+    }
+    if (send_pattern)
+    {
+        return pber->counts.bit_errors + pber->counts.hunt_bytes;
+    }
+    return pverify->counts.dropped + pverify->counts.inserted
+         + pverify->counts.corrupted;
+}
+
+
+/**********************************************************************/
+/* Reader's waits for data:
+ * - RECV_READY_MS:  longest wait for the forked reader to report it is
+ *   ready; a reader that dies closes the pipe, which ends it at once
+ * - RECV_STALL_MS:  while the writer writes, a wait this long with no
+ *   data is counted as a stall, but does not end the read; the writer
+ *   wakes the reader when it is done (see soak.h)
+ * - RECV_LATENCY_MS:  allowance for data to reach the reader after the
+ *   last char has left the writer's UART (e.g. the 16ms latency timer
+ *   of USB serial adapters, and scheduling), used by recv_tail_ms(...)
+ */
+#define RECV_READY_MS 5000
+#define RECV_STALL_MS 3000
+#define RECV_LATENCY_MS 20
+
+
+/**********************************************************************/
+/* Reader's wait for data, once the writer is done (and its TX queue
+ * drained, cf. wiretime.h):  outstanding chars still to come, up to a
+ * read's worth (the larger of VMIN and the mean chars per read so
+ * far), at the rate the reader has seen (or, before it has seen any,
+ * the line rate, from baud and bits per char as applied; a pty's baud
+ * is no rate at all), plus 8 char times,
+ * RECV_LATENCY_MS, VTIME, and, when VMIN > 1 with VTIME 0, the tail
+ * wakeup interval READER_TAIL_MS (cf. reader.h); each read that brings
+ * data starts the next wait, so a lossy run ends within this time of
+ * the last char received, in place of 4 waits of 3s
+ *
+ * Input arguments:
+ *   outstanding - Chars sent but not yet received
+ *       char_ns - Time of one char at the line rate, or 0
+ *         count - Chars received so far, in reads read()'s with data
+ *      first_ns - Time first data were read, or 0
+ *       last_ns - Time last data were read, or 0
+ *           prc - Reader engine's VMIN and VTIME, or NULL for
+ *                 non-blocking reads (cf. multiport.h)
+ * Return value:  wait, ms
+ */
+static int
+recv_tail_ms(uint64_t outstanding, double char_ns, uint64_t count
+            , uint64_t reads, uint64_t first_ns, uint64_t last_ns
+            , pREADERCOUNTS prc)
+{
+    double batch = reads ? (double) count / reads : 1.0;
+    double seen_ns = count > 1 && last_ns > first_ns
+                   ? (double) (last_ns - first_ns) / (count - 1)
+                   : 0.0;
+    double ms;
+
+    if (prc && prc->vmin > batch) { batch = prc->vmin; }
+    if (outstanding < batch) { batch = outstanding; }
+    if (seen_ns > 0.0) { char_ns = seen_ns; }
+    ms = (batch + 8) * char_ns * 1e-6 + RECV_LATENCY_MS;
+    if (prc && prc->vtime > 0) { ms += prc->vtime * 100; }
+    if (prc && prc->vmin > 1 && !prc->vtime) { ms += READER_TAIL_MS; }
+    return ms < RECV_STALL_MS ? (int) (ms + 0.999) : RECV_STALL_MS;
+}
+
+
+/**********************************************************************/
+/* Fork process to read loopback data sent by send_char(...) above,
+ * from fd if it is not negative (e.g. a session.h fd, inherited by the
+ * reader), else from tty_name opened again
+ */
 /* Return value:  -1 or file descriptor of read pipe from data reader */
 static int
-recv_chars(char* tty_name, size_t count)
+recv_chars(char* tty_name, int fd, size_t count)
 {
     int fdtty;
     int fdpipes[2];
     pid_t gcpid;     /* Grandchild PID */
     pid_t ppid;      /* Parent (child of grandparent) PID */
     RECVSTATUS buf;
-    int timeouts_remaining = 4;
+    VERIFY verify;
+    FRAMERX frames;
+    BERRX ber;
+    READER rd;
+    uint64_t nframes = send_frame_payload ? send_frame_count(count) : 0;
+    int final = !soak_live;  /* Non-zero once count is final */
+    int woke = 0;            /* Non-zero once woken by the writer */
+    double char_ns = 0.0;    /* Time of one char on the wire */
+    unsigned long baud;
+    int bits;
+    int wait_ms;
     int iwrite;
 
 TOHERE(0)
@@ -328,9 +1313,9 @@ TOHERE(0)
 TOHERE(0)
         FD_SET(fdpipes[0], &rfds);
 TOHERE(0)
-        tv.tv_sec = 5;
+        tv.tv_sec = RECV_READY_MS / 1000;
 TOHERE(0)
-        tv.tv_usec = 0;
+        tv.tv_usec = (RECV_READY_MS % 1000) * 1000;
 
         /* Wait for data to be available on pipe */
 TOHERE(0)
@@ -358,7 +1343,7 @@ TOHERE(0)
 
         /* Read data from pipe */
 TOHERE(0)
-        if ((sizeof buf) != read(fdpipes[0],&buf,sizeof buf))
+        if (recv_status_read(fdpipes[0], &buf))
         {
 TOHERE(0)
             perror("recv_char=>read-pipe");
@@ -407,17 +1392,20 @@ TOHERE(0)
         exit(0);
     }
 
+    /* Grandchild records its own pid in the flight recorder, if any */
+    flightrec_after_fork();
+
     /* To here, this is grandchild process, with several tasks
-     * 1) Open TTY for read
+     * 1) Open TTY for read, and set up verifier of data read
      * 2) Send initial success status to pipe
-     * 3) Read data from TTY
+     * 3) Read and verify data from TTY
      * 4) Send final success status to pipe
      * 5) Exit
      */
 
-    /* 1) Open TTY for read */
+    /* 1) Open TTY for read, unless the fd was inherited */
 TOHERE(0)
-    if (0 > (fdtty=open(tty_name,O_RDONLY | O_NONBLOCK)))
+    if (0 > (fdtty = 0 <= fd ? fd : open(tty_name,O_RDONLY | O_NONBLOCK)))
     {
 TOHERE(0)
         buf.status = fdtty;
@@ -445,39 +1433,103 @@ TOHERE(0)
         exit(-1);
     }
 
+    /* Scheduling, CPU, and locked memory, before buffers are allocated
+     * (--rt-reader=..., --mlock); see rtsched.h
+     */
+    if (rt_reader.set || rt_mlock)
+    {
+        rt_apply(&rt_reader, rt_mlock, &buf.rt);
+    }
+    fill_cycle();
+    probe_rx_init(&buf.probes);
+    memset(&frames, 0, sizeof frames);
+    if (send_pattern) { ber_rx_init(&ber, send_pattern); }
+    if (reader_open(&rd, fdtty))
+    {
+        buf.status = -1;
+        buf.m_errno = errno ? errno : ENOMEM;
+        write(fdpipes[1],&buf,sizeof buf);
+        close(fdtty);
+        exit(-1);
+    }
+    if (verify_init(&verify, cycle, LCYCLE)
+     || (nframes && frame_rx_init(&frames, send_frame_payload)))
+    {
+        buf.status = -1;
+        buf.m_errno = ENOMEM;
+        write(fdpipes[1],&buf,sizeof buf);
+        close(fdtty);
+        exit(-1);
+    }
+
+    /* Wake when the writer is done (see soak.h); and time of one char
+     * on the wire, as applied, for the wait after that
+     */
+    if (soak_live) { reader_set_wake(&rd, soak_live_reader()); }
+    if (!stty_get_line_fd(fdtty, &baud, &bits) && baud)
+    {
+        char_ns = bits * 1e9 / baud;
+    }
+    errno = 0;
+
     /* 2) Send initial success status to pipe */
 TOHERE(0)
     write(fdpipes[1],&buf,sizeof buf);
 
-    /* 3) Read data from TTY */
+    /* 3) Read and verify data from TTY
+     *    - stop when every byte sent is received intact; after any
+     *      error, read on until no more data arrive, as drops and
+     *      insertions are only inferred (cf. verify_done(...))
+     *    - or, for frames, when every frame is accounted for
+     *    - or, for a pattern, when every byte sent is received
+     *    - count is final only once the writer is done, when it
+     *      shares counts (see soak.h); until then, read on, even if
+     *      errors seem to account for every byte, so the writer never
+     *      blocks on a reader that has left; in a soak (--duration=
+     *      ...), the count is not known before
+     *    - or when no data arrive within recv_tail_ms(...) after the
+     *      writer is done; until then, waits only count stalls
+     */
 TOHERE(0)
-    while (buf.count < count)
+    while (!final
+        || (nframes ? (frames.counts.next < nframes)
+           : send_pattern ? (buf.count < count)
+           : !verify_done(&verify, count)))
     {
-        char databuf[1024];
+        char* databuf;
         int retval;
-        struct timeval tv;
-        fd_set rfds;
 
 #undef TOHERE
 #define TOHERE(I) TOHEREI(I)
 
-        /* Setup for select with 3s timeout*/
-TOHERE(0)
-        tv.tv_sec = 3;
-TOHERE(0)
-        tv.tv_usec = 0;
-TOHERE(0)
-        FD_ZERO(&rfds);
-TOHERE(0)
-        FD_SET(fdtty, &rfds);
+        /* Take final count sent, once the writer is done */
+        if (!final && __atomic_load_n(&soak_live->done, __ATOMIC_ACQUIRE))
+        {
+            count = soak_live->sent;
+            if (nframes) { nframes = send_frame_count(count); }
+            final = 1;
+            continue;
+        }
 
-        /* Setup for select */
-TOHERE(0)
-        if (0 > (retval = select(fdtty+1,&rfds,0,0,&tv)))
+        /* Writer gone (end of file of wake pipe) without being done */
+        if (!final && woke)
         {
-TOHERE(0)
-            perror("recv_chars=>select(tty)");
-TOHERE(0)
+            fprintf(stderr, "recv_chars=>writer exited\n");
+            buf.status = -1;
+            break;
+        }
+
+        /* Wait for data, and read it (see reader.h) */
+        wait_ms = !final ? RECV_STALL_MS
+                : recv_tail_ms(count > buf.count ? count - buf.count : 0
+                              , char_ns, buf.count, buf.reads
+                              , buf.first_ns, buf.last_ns, &rd.counts);
+TOHERE(wait_ms)
+        if (0 > (retval = reader_read(&rd, wait_ms)))
+        {
+TOHERE(retval)
+            perror("recv_chars=>reader_read(tty)");
+TOHERE(errno)
             buf.m_errno = errno;
 TOHERE(0)
             buf.status = retval;
@@ -485,37 +1537,75 @@ TOHERE(0)
             break;
         }
 
-        /* Select timed out */
+        /* Woken by the writer:  take its count, above, if not yet */
 TOHERE(retval)
-        if (!retval)
+        if (!retval && rd.woken && !woke)
         {
-TOHERE(errno)
-            perror("recv_chars=>select(tty)=>timeout");
-TOHERE(timeouts_remaining)
-            if (--timeouts_remaining < 1) { break; }
-TOHERE(timeouts_remaining)
+            woke = 1;
             continue;
         }
 
-        /* Read data */
-TOHERE(buf.reads)
+        /* Wait timed out:  once the writer is done, no more data are
+         * coming, and the read ends; before then, it is a stall
+         */
+        if (!retval)
+        {
+TOHERE(wait_ms)
+            if (final) { break; }
+            fprintf(stderr, "recv_chars=>reader_read(tty)=>timeout"
+                            " (%dms)\n", wait_ms);
+            ++buf.timeouts;
+            soak_rx_publish(buf.count, recv_errors(&verify, &frames, &ber)
+                           , buf.timeouts);
+            continue;
+        }
         ++buf.reads;
-TOHERE(buf.reads)
-        if (0 > (retval = read(fdtty,databuf, 1024)))
+        databuf = rd.buf;
+        /* Remove and time any latency probes (--probe=...) */
+        if (send_probe_ns || send_probe_idle)
         {
-TOHERE(retval)
-            perror("recv_chars=>read(tty)");
-TOHERE(errno)
-            buf.m_errno = errno;
-TOHERE(0)
-            buf.status = retval;
-TOHERE(0)
-            break;
+            retval = probe_strip(&buf.probes, databuf, retval
+                                , monotonic_ns());
         }
 TOHERE(retval)
+        if (retval > 0)
+        {
+            buf.last_ns = monotonic_ns();
+            if (!buf.first_ns) { buf.first_ns = buf.last_ns; }
+        }
         buf.count += retval;
 TOHERE(buf.count)
+        if (nframes)           { frame_rx_feed(&frames, databuf, retval); }
+        else if (send_pattern) { ber_rx_feed(&ber, databuf, retval); }
+        else                   { verify_feed(&verify, databuf, retval); }
+        if (soak_live)
+        {
+            soak_rx_publish(buf.count, recv_errors(&verify, &frames, &ber)
+                           , buf.timeouts);
+        }
+    }
+
+    /* Count any bytes, or frames, not received as dropped */
+    if (nframes)
+    {
+        frame_rx_finish(&frames, nframes);
+        buf.frames = frames.counts;
+        frame_rx_free(&frames);
+    }
+    else if (send_pattern)
+    {
+        ber_rx_finish(&ber);
+        buf.ber = ber.counts;
+    }
+    else
+    {
+        verify_finish(&verify, count);
+        buf.verify = verify.counts;
     }
+    verify_free(&verify);
+    buf.reader = rd.counts;
+    reader_close(&rd);
+    rt_sample(&buf.rt);
 
     /* 4) Send status to pipe */
 #undef TOHERE
@@ -533,6 +1623,6 @@ TOHERE(0)
 
 TOHERE(0)
     exit(0*iwrite);
-} /* static int recv_chars(char* tty_name, size_t count) */
+} /* static int recv_chars(char* tty_name, int fd, size_t count) */
 
 #endif/*__SST_H__*/
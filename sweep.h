@@ -0,0 +1,256 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+/**********************************************************************/
+/*** Routines to sweep TTY speeds and find the highest rate that    ***/
+/*** passes a test with no errors, ramping up with a safety guard   ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * SWEEP_SAFE_MAX              - Default highest rate a sweep will try
+ * typedef ... *pSWEEP         - Struct with sweep options and results
+ * sweep_init(...)             - Default sweep options
+ * sweep_step(...)             - Set speed, run one test, classify result
+ * sweep_table(...)            - Walk speeds[] table from stty_info.h
+ * sweep_search(...)           - Ramp up, then bisect, over any rates
+ * run_sweep(...)              - Run sweep, report highest clean rate
+ *
+ * Safety guard
+ * ============
+ * Rates of 8M and above can hang some hardware (e.g. Jetson UARTs), so
+ * both kinds of sweep only ever move upward from rates that have passed,
+ * and stop at the first rate that shows an early-warning signal:
+ *
+ * - any dropped, inserted or corrupted character found by the reader,
+ *   or any missing, duplicated or corrupted frame (--framed=...);
+ * - any growth of UART overrun, framing, parity or break counters;
+ * - any reader stall (3s with no data while writing, or chars never
+ *   received after the writer is done) or reader error;
+ * - a short or failed write, or a failure to set the speed.
+ *
+ * A binary search then only tries rates between the highest clean rate
+ * and the lowest warning rate.  No rate above the sweep maximum, which
+ * defaults to SWEEP_SAFE_MAX, is ever tried, and the settings the TTY
+ * had before the sweep are restored afterwards.
+ *
+ * The TTY's settings are read once, as a profile.h termios2 image, and
+ * each step only changes the speed in that image and applies it with
+ * one TCSETSF2, on the run's session.h fd if it has one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/* run_test(...), stty_set_speed(...), speeds[] */
+#include "raw_settings.h"
+/* Compiled termios2 image:  each step sets its speed with one ioctl */
+#include "profile.h"
+#include "run.h"
+
+#define SWEEP_SAFE_MAX 4000000UL
+
+
+/**********************************************************************/
+/* Sweep options and results */
+typedef struct SWEEPstr
+{
+    unsigned long min;       /* Lowest rate to try */
+    unsigned long max;       /* Highest rate to try; safety guard */
+    unsigned long lo;        /* Binary search:  known-clean start rate */
+    unsigned long hi;        /* Binary search:  highest rate; 0 => table */
+    unsigned long resolution;/* Binary search:  stop at this rate step */
+    unsigned long best;      /* Result:  highest clean rate, or 0 */
+    unsigned long warned;    /* Result:  lowest warning rate, or 0 */
+    size_t steps;            /* Result:  count of tests run */
+    PROFILE prof;            /* TTY settings; each step sets the speed */
+    int have_prof;           /* Non-zero if prof holds the TTY settings */
+} SWEEP, *pSWEEP;
+
+
+/**********************************************************************/
+/* Default sweep options */
+static void
+sweep_init(pSWEEP psw)
+{
+    memset(psw, 0, sizeof *psw);
+    psw->max = SWEEP_SAFE_MAX;
+}
+
+
+/**********************************************************************/
+/* Set speed, run one test, and classify the result
+ *
+ * Return value:  1 if clean; 0 if any early-warning signal
+ */
+static int
+sweep_step(pSWEEP psw, pRUNCONFIG pcfg, unsigned long baud)
+{
+    RUNRESULT res;
+    char token[32];
+    const char* why = NULL;
+
+    ++psw->steps;
+    snprintf(token, sizeof token, "%lu", baud);
+    if (psw->have_prof
+        ? (profile_set_speed(&psw->prof, token)
+          || (pcfg->session
+              ? session_apply(pcfg->session, &psw->prof)
+              : profile_apply_name(pcfg->tty_name, &psw->prof, 1)))
+        : stty_set_speed(pcfg->tty_name, token))
+    {
+        why = "cannot set speed";
+    }
+    else if (run_test(pcfg, &res))
+    {
+        why = "test failed";
+    }
+    else if ((size_t) res.sent < pcfg->send_count)
+    {
+        why = "short write";
+    }
+    else if (!res.have_recv || res.recv.status)
+    {
+        why = "reader error";
+    }
+    else if (res.recv.timeouts)
+    {
+        why = "reader stalled";
+    }
+    else if (run_errors(&res))
+    {
+        why = "data errors";
+    }
+    else if (res.have_icount && icount_errors(&res.icount))
+    {
+        why = "UART error counters grew";
+    }
+
+    if (why)
+    {
+        fprintf(stderr,"Sweep %lubaud:  WARNING, %s\n"
+                      , baud, why);
+        if (!psw->warned || baud < psw->warned) { psw->warned = baud; }
+        return 0;
+    }
+
+    fprintf(stderr,"Sweep %lubaud:  clean; %lu chars in %.6fs\n"
+                  , baud, (unsigned long) res.sent, res.write_ns * 1e-9);
+    if (baud > psw->best) { psw->best = baud; }
+    return 1;
+}
+
+
+/**********************************************************************/
+/* Walk unique rates in speeds[] table, ascending, from min to max, and
+ * stop at first warning
+ */
+static void
+sweep_table(pSWEEP psw, pRUNCONFIG pcfg)
+{
+    struct speed_map const* pspeed;
+    unsigned long last = 0;
+
+    for (pspeed = speeds; pspeed->string; ++pspeed)
+    {
+        /* Skip aliases (e.g. exta), repeats, and out-of-range rates */
+        if (pspeed->value <= last) { continue; }
+        last = pspeed->value;
+        if (last < psw->min || last > psw->max) { continue; }
+        if (!sweep_step(psw, pcfg, last)) { break; }
+    }
+}
+
+
+/**********************************************************************/
+/* Binary search over any rates (BOTHER) from lo to hi:  ramp up from
+ * lo, doubling the rate, until a warning or hi; then bisect between the
+ * highest clean rate and the lowest warning rate
+ */
+static void
+sweep_search(pSWEEP psw, pRUNCONFIG pcfg)
+{
+    unsigned long baud = psw->lo;
+    unsigned long hi = psw->hi < psw->max ? psw->hi : psw->max;
+    unsigned long resolution;
+
+    /* Ramp up */
+    while (sweep_step(psw, pcfg, baud))
+    {
+        if (baud >= hi) { return; }
+        baud = (baud * 2) < hi ? (baud * 2) : hi;
+    }
+    if (!psw->best) { return; }
+
+    /* Bisect; default resolution is 1% of the clean rate */
+    resolution = psw->resolution ? psw->resolution : (psw->best / 100);
+    if (resolution < 1) { resolution = 1; }
+    while ((psw->warned - psw->best) > resolution)
+    {
+        sweep_step(psw, pcfg, psw->best + ((psw->warned - psw->best) / 2));
+    }
+}
+
+
+/**********************************************************************/
+/* Run sweep, restore TTY speed, and report highest clean rate
+ *
+ * Return value:  0 if a clean rate was found; -1 otherwise
+ */
+static int
+run_sweep(pSWEEP psw, pRUNCONFIG pcfg)
+{
+    PROFILE prof0;
+
+    if (!pcfg->tty_name || !pcfg->send_count)
+    {
+        fprintf(stderr,"ERROR:  sweep needs --tty=... and --send-count=...\n");
+        return -1;
+    }
+    if (psw->hi && (!psw->lo || psw->lo > psw->hi))
+    {
+        fprintf(stderr,"ERROR:  bad sweep search range %lu:%lu\n"
+                      , psw->lo, psw->hi);
+        return -1;
+    }
+    if (psw->lo > psw->max)
+    {
+        fprintf(stderr,"ERROR:  sweep search start %lu is above"
+                       " sweep maximum %lu\n", psw->lo, psw->max);
+        return -1;
+    }
+    psw->have_prof = pcfg->session
+                   ? !session_get(pcfg->session, &psw->prof)
+                   : !profile_get_name(pcfg->tty_name, &psw->prof);
+    prof0 = psw->prof;
+
+    if (psw->hi) { sweep_search(psw, pcfg); }
+    else         { sweep_table(psw, pcfg); }
+
+    /* Restore settings TTY had before sweep */
+    if (psw->have_prof && pcfg->session)
+    {
+        session_apply(pcfg->session, &prof0);
+    }
+    else if (psw->have_prof)
+    {
+        profile_apply_name(pcfg->tty_name, &prof0, 1);
+    }
+
+    fprintf(stderr,"Sweep of [%s] with %lu chars per step, %lu steps"
+                   "; highest clean rate=%lubaud"
+                  , pcfg->tty_name, (unsigned long) pcfg->send_count
+                  , (unsigned long) psw->steps, psw->best);
+    if (psw->warned)
+    {
+        fprintf(stderr,"; lowest warning rate=%lubaud\n", psw->warned);
+    }
+    else
+    {
+        fprintf(stderr,"; no warnings up to %lubaud\n"
+                      , psw->hi && psw->hi < psw->max ? psw->hi : psw->max);
+    }
+    return psw->best ? 0 : -1;
+}
+
+#endif/*__SWEEP_H__*/
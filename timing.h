@@ -0,0 +1,42 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+/**********************************************************************/
+/*** Clocks used to time writes, reads, sleeps, and whole runs      ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * monotonic_ns()              - Monotonic clock, ns
+ * cpu_seconds()               - CPU time used by this process
+ */
+
+#include <time.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+
+/**********************************************************************/
+/* Monotonic clock, in ns */
+static uint64_t
+monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+
+/**********************************************************************/
+/* CPU time (user + system) used so far by this process, in s */
+static double
+cpu_seconds()
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru)) { return 0.0; }
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+         + ((ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6);
+}
+
+#endif/*__TIMING_H__*/
@@ -0,0 +1,275 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+/**********************************************************************/
+/*** Minimal io_uring, with raw syscalls:  submission and           ***/
+/*** completion queues, registered buffers, waits with a timeout    ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * URING_DEPTH                 - Default writes in flight
+ * URING_MAX                   - Most writes in flight
+ * typedef ... *pURING         - Struct with the ring fd and mappings
+ * uring_setup(...)            - Raw syscalls
+ * uring_enter_raw(...)
+ * uring_register(...)
+ * uring_free(...)             - Unmap and close ring
+ * uring_init(...)             - Create ring, map its queues
+ * uring_sqe(...)              - Next free submission entry, cleared
+ * uring_enter(...)            - Submit entries, wait for completions
+ * uring_cqe(...)              - Take one completion, if any
+ * uring_register_buffer(...)  - Register one buffer, as index 0
+ *
+ * Usage
+ * =====
+ * No liburing:  the few pieces sst needs are here, on the syscalls and
+ * <linux/io_uring.h>, so the build needs no extra library.
+ *
+ *   URING u;
+ *   struct io_uring_sqe* sqe;
+ *   struct io_uring_cqe cqe;
+ *
+ *   uring_init(&u, 8);
+ *   sqe = uring_sqe(&u);
+ *   sqe->opcode = IORING_OP_WRITE; sqe->fd = fd; ...
+ *   uring_enter(&u, 1, 0);             // submit, wait for 1
+ *   while (uring_cqe(&u, &cqe)) { ... cqe.res ... }
+ *   uring_free(&u);
+ *
+ * A TTY has no non-blocking read or write path for io_uring, so the
+ * kernel runs each request in an io-wq worker thread; requests of one
+ * byte stream must therefore be linked (IOSQE_IO_LINK) to keep their
+ * order.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#define URING_DEPTH 4
+#define URING_MAX 64
+
+
+/**********************************************************************/
+/* The ring fd, and its queues as mapped */
+typedef struct URINGstr
+{
+    int fd;                  /* Ring fd, or -1 */
+    unsigned features;       /* IORING_FEAT_... */
+    void* sq_ptr;            /* Submission queue ring mapping */
+    size_t sq_len;
+    void* cq_ptr;            /* Completion queue ring mapping */
+    size_t cq_len;           /* 0 if shared with sq_ptr */
+    struct io_uring_sqe* sqes;
+    size_t sqes_len;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned pending;        /* Entries filled, not yet submitted */
+    size_t enters;           /* Count of io_uring_enter() calls */
+} URING, *pURING;
+
+
+/**********************************************************************/
+/* Raw syscalls */
+static int
+uring_setup(unsigned entries, struct io_uring_params* pp)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, pp);
+}
+
+static int
+uring_enter_raw(int fd, unsigned to_submit, unsigned min_complete
+               , unsigned flags, void* arg, size_t argsz)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete
+                        , flags, arg, argsz);
+}
+
+static int
+uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+/**********************************************************************/
+/* Unmap and close ring */
+static void
+uring_free(pURING pu)
+{
+    if (pu->sqes)   { munmap(pu->sqes, pu->sqes_len); }
+    if (pu->cq_ptr) { munmap(pu->cq_ptr, pu->cq_len); }
+    if (pu->sq_ptr) { munmap(pu->sq_ptr, pu->sq_len); }
+    if (0 <= pu->fd) { close(pu->fd); }
+    memset(pu, 0, sizeof *pu);
+    pu->fd = -1;
+}
+
+
+/**********************************************************************/
+/* Create ring of entries, map its queues
+ * Return value:  0 on success; -1 on failure (e.g. ENOSYS, or io_uring
+ *                disabled by sysctl kernel.io_uring_disabled)
+ */
+static int
+uring_init(pURING pu, unsigned entries)
+{
+    struct io_uring_params p;
+    char* sq;
+    char* cq;
+
+    memset(pu, 0, sizeof *pu);
+    memset(&p, 0, sizeof p);
+    if (0 > (pu->fd = uring_setup(entries, &p))) { return -1; }
+    pu->features = p.features;
+
+    pu->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    pu->cq_len = p.cq_off.cqes
+               + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (pu->cq_len > pu->sq_len) { pu->sq_len = pu->cq_len; }
+        pu->cq_len = 0;
+    }
+    pu->sq_ptr = mmap(NULL, pu->sq_len, PROT_READ | PROT_WRITE
+                     , MAP_SHARED | MAP_POPULATE, pu->fd
+                     , IORING_OFF_SQ_RING);
+    if (MAP_FAILED == pu->sq_ptr) { pu->sq_ptr = NULL; goto fail; }
+    if (pu->cq_len)
+    {
+        pu->cq_ptr = mmap(NULL, pu->cq_len, PROT_READ | PROT_WRITE
+                         , MAP_SHARED | MAP_POPULATE, pu->fd
+                         , IORING_OFF_CQ_RING);
+        if (MAP_FAILED == pu->cq_ptr) { pu->cq_ptr = NULL; goto fail; }
+    }
+    pu->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    pu->sqes = mmap(NULL, pu->sqes_len, PROT_READ | PROT_WRITE
+                   , MAP_SHARED | MAP_POPULATE, pu->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == pu->sqes) { pu->sqes = NULL; goto fail; }
+
+    sq = pu->sq_ptr;
+    cq = pu->cq_len ? pu->cq_ptr : pu->sq_ptr;
+    pu->sq_head = (unsigned*) (sq + p.sq_off.head);
+    pu->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    pu->sq_mask = *(unsigned*) (sq + p.sq_off.ring_mask);
+    pu->sq_array = (unsigned*) (sq + p.sq_off.array);
+    pu->sq_entries = p.sq_entries;
+    pu->cq_head = (unsigned*) (cq + p.cq_off.head);
+    pu->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    pu->cq_mask = *(unsigned*) (cq + p.cq_off.ring_mask);
+    pu->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+    return 0;
+
+fail:
+    perror("uring_init=>mmap");
+    uring_free(pu);
+    return -1;
+}
+
+
+/**********************************************************************/
+/* Next free submission entry, cleared; it is submitted by the next
+ * uring_enter(...)
+ * Return value:  pointer to entry; NULL if the queue is full
+ */
+static struct io_uring_sqe*
+uring_sqe(pURING pu)
+{
+    unsigned head = __atomic_load_n(pu->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *pu->sq_tail + pu->pending;
+    unsigned idx;
+
+    if (tail - head >= pu->sq_entries) { return NULL; }
+    idx = tail & pu->sq_mask;
+    pu->sq_array[idx] = idx;
+    ++pu->pending;
+    memset(pu->sqes + idx, 0, sizeof *pu->sqes);
+    return pu->sqes + idx;
+}
+
+
+/**********************************************************************/
+/* Submit pending entries, and wait for at least min_complete
+ * completions, for at most timeout_ns if it is non-zero and the kernel
+ * has IORING_FEAT_EXT_ARG (Linux 5.11; else with no time limit)
+ * Return value:  0 on success; -1 on failure, or ETIME on timeout
+ */
+static int
+uring_enter(pURING pu, unsigned min_complete, uint64_t timeout_ns)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned submit = pu->pending;
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int rtn;
+
+    __atomic_store_n(pu->sq_tail, *pu->sq_tail + pu->pending
+                    , __ATOMIC_RELEASE);
+    pu->pending = 0;
+
+    memset(&arg, 0, sizeof arg);
+    if (timeout_ns && (pu->features & IORING_FEAT_EXT_ARG))
+    {
+        ts.tv_sec = timeout_ns / 1000000000;
+        ts.tv_nsec = timeout_ns % 1000000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    do
+    {
+        ++pu->enters;
+        rtn = uring_enter_raw(pu->fd, submit, min_complete, flags
+                             , (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL
+                             , (flags & IORING_ENTER_EXT_ARG) ? sizeof arg
+                                                              : 0);
+        if (rtn > 0) { submit -= rtn; }
+    } while (0 > rtn && EINTR==errno);
+    return 0 > rtn ? -1 : 0;
+}
+
+
+/**********************************************************************/
+/* Take one completion, if any, into *pcqe
+ * Return value:  1 if a completion was taken; 0 if none
+ */
+static int
+uring_cqe(pURING pu, struct io_uring_cqe* pcqe)
+{
+    unsigned head = *pu->cq_head;
+
+    if (head == __atomic_load_n(pu->cq_tail, __ATOMIC_ACQUIRE)) { return 0; }
+    *pcqe = pu->cqes[head & pu->cq_mask];
+    __atomic_store_n(pu->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+/**********************************************************************/
+/* Register one buffer, as buffer index 0 for IORING_OP_..._FIXED
+ * Return value:  0 on success; -1 on failure (e.g. RLIMIT_MEMLOCK)
+ */
+static int
+uring_register_buffer(pURING pu, void* base, size_t len)
+{
+    struct iovec iov;
+    iov.iov_base = base;
+    iov.iov_len = len;
+    return uring_register(pu->fd, IORING_REGISTER_BUFFERS, &iov, 1)
+           ? -1 : 0;
+}
+
+#endif/*__URING_H__*/
@@ -0,0 +1,338 @@
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+/**********************************************************************/
+/*** Routines to verify, byte for byte, a received stream against   ***/
+/*** a cyclic reference pattern (e.g. the to_send sawtooth in sst.h)***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pVERIFYCOUNTS  - Struct with verification results
+ * typedef ... *pVERIFY        - Struct with verifier state
+ * verify_init(...)            - Set up verifier for a cyclic reference
+ * verify_free(...)            - Release verifier copy of reference
+ * verify_mismatch(...)        - Find first differing byte, word at a time
+ * verify_find_drop(...)       - Find window later in reference
+ * verify_feed(...)            - Verify one chunk of received bytes
+ * verify_resync(...)          - Classify a mismatch and resynchronize
+ * verify_done(...)            - Every byte sent received intact
+ * verify_finish(...)          - Resolve look-ahead and missing tail bytes
+ *
+ * Method
+ * ======
+ * The reference cycle is stored twice, back-to-back, so any window of
+ * up to one cycle starting at any offset is contiguous.  Received data
+ * are compared against that window with memcmp(), which the C library
+ * implements with word/SIMD compares, so an error-free stream costs one
+ * memcmp per read().
+ *
+ * On a mismatch, VERIFY_WINDOW received bytes are collected and the
+ * least-cost explanation is chosen, in this order:
+ * a) one corrupted byte:   window[1..] matches expected[1..]
+ * b) dropped bytes:        window matches expected[d..] for smallest d
+ *                          (within half a cycle; anywhere in the cycle
+ *                          only after lock is lost i.e. after a run of
+ *                          unexplained bytes)
+ * c) inserted bytes:       window[n..] matches expected[0..]
+ * d) unexplained:          count one corrupted byte, keep hunting
+ * trying the whole window first, then its leading half, quarter, etc.
+ * down to VERIFY_MINWINDOW bytes, in case the window spans more than one
+ * error; after which the rest of the window is re-scanned in step with the
+ * (resynchronized) reference.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define VERIFY_WINDOW 16          /* Look-ahead bytes used to resync */
+#define VERIFY_MINWINDOW 4        /* Shortest part of window to resync */
+#define VERIFY_NONE ((size_t)-1)  /* No mismatch seen */
+
+
+/**********************************************************************/
+/* Verification results; also passed from forked reader via pipe */
+typedef struct VERIFYCOUNTSstr
+{
+    uint64_t matched;        /* Received bytes equal to reference */
+    uint64_t dropped;        /* Reference bytes never received */
+    uint64_t inserted;       /* Received bytes not in reference */
+    uint64_t corrupted;      /* Received bytes replacing reference bytes */
+    uint64_t resyncs;        /* Count of mismatch events */
+    size_t first_mismatch;   /* Received-stream offset, or VERIFY_NONE */
+} VERIFYCOUNTS, *pVERIFYCOUNTS;
+
+
+/**********************************************************************/
+/* Verifier state */
+typedef struct VERIFYstr
+{
+    char* ref;               /* Two cycles of reference + VERIFY_WINDOW */
+    size_t lref;             /* Length of one cycle of reference */
+    size_t pos;              /* Offset in ref of next expected byte */
+    size_t expected;         /* Reference-stream bytes accounted for */
+    size_t rxpos;            /* Received-stream bytes accounted for */
+    int hunting;             /* Non-zero after a mismatch */
+    size_t unexplained;      /* Consecutive unexplained mismatches */
+    size_t lhunt;            /* Count of bytes in hunt[] */
+    char hunt[VERIFY_WINDOW];
+    VERIFYCOUNTS counts;
+} VERIFY, *pVERIFY;
+
+
+/**********************************************************************/
+/* Set up verifier with a copy of a cyclic reference pattern
+ * Return value:  0 on success; -1 on failure
+ */
+static int
+verify_init(pVERIFY pv, const char* pattern, size_t lpattern)
+{
+    size_t i;
+    size_t lcopy = (2 * lpattern) + VERIFY_WINDOW;
+
+    memset(pv, 0, sizeof *pv);
+    pv->counts.first_mismatch = VERIFY_NONE;
+    if (!pattern || !lpattern) { return -1; }
+    if (!(pv->ref = malloc(lcopy))) { return -1; }
+    for (i=0; i<lcopy; ++i) { pv->ref[i] = pattern[i % lpattern]; }
+    pv->lref = lpattern;
+    return 0;
+}
+
+
+/**********************************************************************/
+/* Release verifier copy of reference */
+static void
+verify_free(pVERIFY pv)
+{
+    free(pv->ref);
+    pv->ref = NULL;
+}
+
+
+/**********************************************************************/
+/* Return offset of first byte that differs, 8 bytes at a time */
+static size_t
+verify_mismatch(const char* a, const char* b, size_t n)
+{
+    size_t i = 0;
+    uint64_t wa;
+    uint64_t wb;
+    while ((i+8) <= n)
+    {
+        memcpy(&wa, a+i, 8);
+        memcpy(&wb, b+i, 8);
+        if (wa != wb) { break; }
+        i += 8;
+    }
+    while (i<n && a[i]==b[i]) { ++i; }
+    return i;
+}
+
+
+/**********************************************************************/
+/* Advance expected position in reference by n bytes */
+static void
+verify_advance(pVERIFY pv, size_t n)
+{
+    pv->expected += n;
+    pv->pos = (pv->pos + n) % pv->lref;
+}
+
+
+/**********************************************************************/
+/* Return smallest offset d, 0 < d < maxd, at which reference matches
+ * window w, or 0 if none; memchr() skips to candidates with the right
+ * first byte
+ */
+static size_t
+verify_find_drop(const char* pexp, size_t maxd, const char* w, size_t lw)
+{
+    const char* p;
+    const char* pend = pexp + maxd;
+    for (p=pexp+1; p<pend && (p=memchr(p, w[0], pend-p)); ++p)
+    {
+        if (!memcmp(p, w, lw)) { return p - pexp; }
+    }
+    return 0;
+}
+
+
+static void verify_resync(pVERIFY pv);
+
+/**********************************************************************/
+/* Verify one chunk of received bytes against reference; start hunting
+ * for resync on mismatch
+ */
+static void
+verify_feed(pVERIFY pv, const char* data, size_t len)
+{
+    while (len > 0)
+    {
+    size_t n;
+
+        /* After mismatch, collect look-ahead window, then resync */
+        if (pv->hunting)
+        {
+            n = VERIFY_WINDOW - pv->lhunt;
+            if (n > len) { n = len; }
+            memcpy(pv->hunt + pv->lhunt, data, n);
+            pv->lhunt += n;
+            data += n;
+            len -= n;
+            if (VERIFY_WINDOW == pv->lhunt) { verify_resync(pv); }
+            continue;
+        }
+
+        /* Fast path:  up to one cycle is contiguous in pv->ref */
+        n = len < pv->lref ? len : pv->lref;
+        if (memcmp(data, pv->ref + pv->pos, n))
+        {
+            /* Slow path:  match up to mismatch, then start hunting */
+            n = verify_mismatch(data, pv->ref + pv->pos, n);
+            if (VERIFY_NONE == pv->counts.first_mismatch)
+            {
+                pv->counts.first_mismatch = pv->rxpos + n;
+            }
+            pv->hunting = 1;
+            pv->lhunt = 0;
+        }
+        pv->counts.matched += n;
+        pv->rxpos += n;
+        verify_advance(pv, n);
+        data += n;
+        len -= n;
+    }
+}
+
+
+/**********************************************************************/
+/* Classify mismatch using look-ahead window in pv->hunt, update counts,
+ * then re-scan whatever part of the window was not consumed
+ */
+static void
+verify_resync(pVERIFY pv)
+{
+    char w[VERIFY_WINDOW];
+    size_t lhunt = pv->lhunt;
+    size_t lw;
+    const char* pexp = pv->ref + pv->pos;
+    size_t n;
+
+    memcpy(w, pv->hunt, lhunt);
+    pv->hunting = 0;
+    pv->lhunt = 0;
+    if (!lhunt) { return; }
+    ++pv->counts.resyncs;
+
+    /* Try whole window, then shorter leading parts of it, in case the
+     * window itself includes a second error
+     */
+    for (lw=lhunt; ; lw/=2)
+    {
+        /* a) One corrupted byte */
+        if (lw < 2 || !memcmp(w+1, pexp+1, lw-1))
+        {
+            pv->unexplained = 0;
+            ++pv->counts.corrupted;
+            ++pv->rxpos;
+            verify_advance(pv, 1);
+            verify_feed(pv, w+1, lhunt-1);
+            return;
+        }
+
+        /* b) Dropped bytes, up to half a cycle:  a match further ahead
+         *    of a window with a second error in it is more likely to be
+         *    a (wrong) position behind, one cycle later
+         */
+        if ((n = verify_find_drop(pexp, pv->lref / 2, w, lw)))
+        {
+            pv->unexplained = 0;
+            pv->counts.dropped += n;
+            verify_advance(pv, n);
+            verify_feed(pv, w, lhunt);
+            return;
+        }
+
+        /* c) Inserted bytes */
+        for (n=1; n<=(lw/2); ++n)
+        {
+            if (!memcmp(w+n, pexp, lw-n))
+            {
+                pv->unexplained = 0;
+                pv->counts.inserted += n;
+                pv->rxpos += n;
+                verify_feed(pv, w+n, lhunt-n);
+                return;
+            }
+        }
+
+        if ((lw/2) < VERIFY_MINWINDOW) { break; }
+    }
+
+    /* b) Dropped bytes, anywhere in the cycle, with the whole window,
+     *    but only after a run of unexplained bytes i.e. lost lock after
+     *    a drop of more than half a cycle
+     */
+    if (pv->unexplained >= VERIFY_WINDOW
+     && (n = verify_find_drop(pexp, pv->lref, w, lhunt)))
+    {
+        pv->unexplained = 0;
+        pv->counts.dropped += n;
+        verify_advance(pv, n);
+        verify_feed(pv, w, lhunt);
+        return;
+    }
+
+    /* d) Unexplained:  count one corrupted byte; re-scan will resume
+     *    hunting at next byte if still out of step
+     */
+    ++pv->unexplained;
+    ++pv->counts.corrupted;
+    ++pv->rxpos;
+    verify_advance(pv, 1);
+    verify_feed(pv, w+1, lhunt-1);
+}
+
+
+/**********************************************************************/
+/* Return non-zero if every one of total_sent reference bytes has been
+ * received intact; a reader can stop then, once total_sent is final
+ * - After any mismatch, drops and insertions are inferred, and an
+ *   insertion of n bytes is indistinguishable from a drop of one cycle
+ *   less n bytes, so the reference bytes accounted for may run ahead
+ *   of those received; a reader must then read until no more data
+ *   arrive, and verify_finish(...) counts the rest as dropped
+ */
+static int
+verify_done(pVERIFY pv, size_t total_sent)
+{
+    return VERIFY_NONE == pv->counts.first_mismatch
+        && pv->expected >= total_sent;
+}
+
+
+/**********************************************************************/
+/* Resolve any partial look-ahead window, then count reference bytes
+ * that never arrived, out of total_sent, as dropped
+ */
+static void
+verify_finish(pVERIFY pv, size_t total_sent)
+{
+    while (pv->hunting && pv->lhunt) { verify_resync(pv); }
+    pv->hunting = 0;
+
+    if (pv->expected < total_sent)
+    {
+        if (VERIFY_NONE == pv->counts.first_mismatch)
+        {
+            pv->counts.first_mismatch = pv->rxpos;
+        }
+        pv->counts.dropped += total_sent - pv->expected;
+        pv->expected = total_sent;
+    }
+}
+
+#endif/*__VERIFY_H__*/
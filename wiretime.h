@@ -0,0 +1,178 @@
+#ifndef __WIRETIME_H__
+#define __WIRETIME_H__
+
+/**********************************************************************/
+/*** Wire time:  from the first write() to the end of tcdrain(), and ***/
+/*** a line model from the applied termios:  throughput on the wire, ***/
+/*** efficiency versus theoretical, and effective baud              ***/
+/**********************************************************************/
+
+/* Contents
+ * ========
+ * typedef ... *pWIRETIME      - Struct with wire time and line model
+ * wire_tcdrain(...)           - Wait for TX queue to drain
+ * wire_drain(...)             - Wait for TX queue to drain; time it
+ * wire_model(...)             - Wire throughput, from applied termios
+ * wire_print(...)             - One-line summary
+ *
+ * Why
+ * ===
+ * write() returns when the kernel has taken the data, not when they
+ * have left the UART, so chars written per second of writes overstates
+ * the line rate by up to the TX buffer (e.g. 4kB, or more with DMA).
+ * Here the writes are timed from the start of the first write() to the
+ * end of tcdrain(fd) (cf. wire_tcdrain(...)), which returns when the UART
+ * has sent the last char.
+ *
+ * The line model takes baud (termios2 .c_ospeed) and bits per char
+ * (start bit, data bits, parity bit, stop bits; 12 for raw_settings,
+ * i.e. cs8, parenb, cstopb) as applied, so:
+ *
+ *   theoretical chars/s = baud / bits per char
+ *   efficiency          = wire chars/s / theoretical chars/s
+ *   effective baud      = wire chars/s * bits per char
+ *
+ * An efficiency well under 100% is idle time between chars (e.g. a
+ * writer that cannot keep the TX FIFO full, pacing, flow control); an
+ * effective baud above the applied baud is a UART clock divider faster
+ * than asked for.  Also reported is the nominal baud asked for, when it
+ * differs from the baud applied, e.g. speeds[] in stty_info.h sets
+ * 8390625 baud for "8M".
+ *
+ * The model needs a UART:  for a TTY that is not a serial port (no
+ * TIOCGSERIAL, e.g. a pty), only the wire time and rate are reported.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+/* monotonic_ns() */
+#include "timing.h"
+/* stty_get_line_fd(...) */
+#include "raw_settings.h"
+
+
+/**********************************************************************/
+/* Wire time and line model of one run */
+typedef struct WIRETIMEstr
+{
+    int drained;             /* Non-zero if tcdrain() succeeded */
+    int modeled;             /* Non-zero if line model below is valid */
+    uint64_t chars;          /* Chars written */
+    uint64_t start_ns;       /* Start of first write() */
+    uint64_t end_ns;         /* End of tcdrain() */
+    uint64_t drain_ns;       /* Time in tcdrain(), after last write() */
+    double wire_s;           /* end_ns - start_ns, s */
+    double wire_cps;         /* chars / wire_s */
+    unsigned long baud;      /* Applied, termios2 .c_ospeed */
+    unsigned long nominal;   /* Asked for (e.g. --speed=8M), or 0 */
+    int bits;                /* Bits per char on the wire */
+    double model_cps;        /* baud / bits */
+    double efficiency;       /* wire_cps / model_cps */
+    double effective_baud;   /* wire_cps * bits */
+} WIRETIME, *pWIRETIME;
+
+
+/**********************************************************************/
+/* Wait for TX queue of fd to drain, retrying when interrupted
+ * - This is tcdrain(fd), as the ioctl glibc uses for it, TCSBRK with
+ *   arg 1:  tcdrain(...) is declared in termios.h, which conflicts with
+ *   the termios2 definitions stty_info.h uses
+ * Return value:  0 on success; -1 on failure, with errno set (e.g.
+ *                ENOTTY if fd is not a TTY)
+ */
+static int
+wire_tcdrain(int fd)
+{
+    int rtn;
+    while ((rtn = ioctl(fd, TCSBRK, 1)) && EINTR==errno) ;
+    return rtn ? -1 : 0;
+}
+
+
+/**********************************************************************/
+/* Wait for TX queue of fd to drain (cf. wire_tcdrain(...)); time it,
+ * from the end of the writes
+ * Return value:  0 on success; -1 if fd is not a TTY
+ */
+static int
+wire_drain(int fd, pWIRETIME pw)
+{
+    uint64_t t0 = monotonic_ns();
+    int rtn;
+
+    rtn = wire_tcdrain(fd);
+    pw->end_ns = monotonic_ns();
+    pw->drain_ns = pw->end_ns - t0;
+    pw->drained = !rtn;
+    errno = 0;
+    return rtn ? -1 : 0;
+}
+
+
+/**********************************************************************/
+/* Wire throughput of chars written from start_ns (start of first
+ * write()) to the end of wire_drain(...); and line model, from the
+ * termios applied to fd, if it is a serial port; nominal is the baud
+ * asked for, or 0
+ */
+static void
+wire_model(int fd, pWIRETIME pw, uint64_t chars, uint64_t start_ns
+          , unsigned long nominal)
+{
+    struct serial_struct ss;
+
+    pw->chars = chars;
+    pw->start_ns = start_ns;
+    pw->nominal = nominal;
+    pw->modeled = 0;
+    if (!pw->drained || !start_ns || pw->end_ns <= start_ns) { return; }
+    pw->wire_s = (pw->end_ns - start_ns) * 1e-9;
+    pw->wire_cps = chars / pw->wire_s;
+
+    if (ioctl(fd, TIOCGSERIAL, &ss)
+     || stty_get_line_fd(fd, &pw->baud, &pw->bits) || !pw->baud)
+    {
+        errno = 0;
+        return;
+    }
+    pw->model_cps = (double) pw->baud / pw->bits;
+    pw->efficiency = pw->wire_cps / pw->model_cps;
+    pw->effective_baud = pw->wire_cps * pw->bits;
+    pw->modeled = 1;
+}
+
+
+/**********************************************************************/
+/* One-line summary, if drained */
+static void
+wire_print(FILE* f, const char* tty_name, pWIRETIME pw)
+{
+    if (!pw->drained || !pw->wire_s) { return; }
+    fprintf(f, "Wire [%s]:  %llu chars in %.6fs (drain=%.3fms)"
+               "; %.1f chars/s"
+             , tty_name, (unsigned long long) pw->chars, pw->wire_s
+             , pw->drain_ns * 1e-6, pw->wire_cps);
+    if (!pw->modeled)
+    {
+        fprintf(f, "; no line model (not a serial port)\n");
+        return;
+    }
+    fprintf(f, "; model=%lubaud/%d bits=%.1f chars/s; efficiency=%.2f%%"
+               "; effective=%.0fbaud"
+             , pw->baud, pw->bits, pw->model_cps, pw->efficiency * 100.0
+             , pw->effective_baud);
+    if (pw->nominal && pw->nominal != pw->baud)
+    {
+        fprintf(f, "; nominal=%lubaud (applied %+.2f%%)"
+                 , pw->nominal
+                 , ((double) pw->baud / pw->nominal - 1.0) * 100.0);
+    }
+    fputc('\n', f);
+}
+
+#endif/*__WIRETIME_H__*/